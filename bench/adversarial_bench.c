@@ -0,0 +1,198 @@
+/* Pages built to find superlinear spots in the markdown pipeline: huge
+ * paragraphs and lines, 100k-item lists, deep nesting, and inline markup
+ * that never resolves. Each page is generated at two sizes and run
+ * through parse_markdown; if time per byte grows by more than
+ * MAX_SLOWDOWN from the small page to the large one, the check fails.
+ * Run with `make bench`. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+#include "arena.h"
+#include "parser/markdown.h"
+
+#define SMALL_SIZE   (512u << 10)
+#define LARGE_SIZE   (4u << 20)   /* 8x: quadratic work would cost 8x per byte */
+#define MAX_SLOWDOWN 2.5
+#define RUNS         5
+
+typedef struct {
+    char  *data;
+    size_t len, cap;
+} Page;
+
+static void put(Page *p, const char *s, size_t n) {
+    if (p->len + n > p->cap) n = p->cap - p->len;
+    memcpy(p->data + p->len, s, n);
+    p->len += n;
+}
+
+static void puts_page(Page *p, const char *s) {
+    put(p, s, strlen(s));
+}
+
+static void put_repeat(Page *p, const char *s, size_t times) {
+    for (size_t i = 0; i < times && p->len < p->cap; i++) puts_page(p, s);
+}
+
+static int full(const Page *p) {
+    return p->len >= p->cap;
+}
+
+/* One paragraph of many lines, with emphasis and links that close. */
+static void huge_paragraph(Page *p) {
+    while (!full(p)) puts_page(p, "lorem *ipsum* dolor `sit` amet, [consectetur](adipiscing.md) elit\n");
+}
+
+/* A paragraph that is one line. */
+static void long_line(Page *p) {
+    while (!full(p)) puts_page(p, "lorem ipsum **dolor** sit amet ");
+}
+
+static void flat_list(Page *p) {
+    for (size_t i = 0; !full(p); i++) {
+        char line[64];
+        snprintf(line, sizeof(line), "- item %zu with *emphasis*\n", i);
+        puts_page(p, line);
+    }
+}
+
+/* Blank lines between items make the list loose, which the tree parser
+ * handles. */
+static void loose_list(Page *p) {
+    while (!full(p)) puts_page(p, "1. first line\n   second line\n\n");
+}
+
+/* The shape of a generated changelog: a heading per release, then many
+ * one-line entries. */
+static void changelog(Page *p) {
+    for (size_t i = 0; !full(p); i++) {
+        char line[96];
+        snprintf(line, sizeof(line), "## v1.%zu.0\n\n", i);
+        puts_page(p, line);
+        for (int k = 0; k < 40 && !full(p); k++) {
+            snprintf(line, sizeof(line), "- fixed `module_%d` crash when *flag* is set (#%zu)\n", k, i * 40 + k);
+            puts_page(p, line);
+        }
+        puts_page(p, "\n");
+    }
+}
+
+/* Block quotes and list items nested past the parser's limit, again and
+ * again. */
+static void deep_nesting(Page *p) {
+    while (!full(p)) {
+        put_repeat(p, "> ", 64);
+        puts_page(p, "quoted\n");
+        for (int d = 0; d < 64 && !full(p); d++) {
+            put_repeat(p, "  ", (size_t)d);
+            puts_page(p, "- nested\n");
+        }
+        puts_page(p, "\n");
+    }
+}
+
+/* Openers with no closers: each emphasis closer, bracket and backtick
+ * run is the kind that makes naive parsers search back to the start. */
+static void unmatched_emphasis(Page *p) {
+    while (!full(p)) puts_page(p, "*a _b **c __d ");
+    puts_page(p, "\n");
+}
+
+static void unmatched_brackets(Page *p) {
+    while (!full(p)) puts_page(p, "[a ![b [c](d ");
+    puts_page(p, "\n");
+}
+
+/* Backtick runs of every length up to a few hundred, none closed. */
+static void backtick_runs(Page *p) {
+    for (size_t run = 1; !full(p); run = run % 300 + 1) {
+        put_repeat(p, "`", run);
+        puts_page(p, " x ");
+    }
+    puts_page(p, "\n");
+}
+
+static void closers_first(Page *p) {
+    while (!full(p)) puts_page(p, "a* b_ c** d__ e] ");
+    puts_page(p, "\n");
+}
+
+static void wide_table(Page *p) {
+    puts_page(p, "|");
+    put_repeat(p, " h |", 200);
+    puts_page(p, "\n|");
+    put_repeat(p, ":-:|", 200);
+    puts_page(p, "\n");
+    while (!full(p)) puts_page(p, "| a | `b` |\n");
+}
+
+typedef struct {
+    const char *name;
+    void (*build)(Page *);
+} Corpus;
+
+static const Corpus CORPORA[] = {
+    { "huge paragraph",     huge_paragraph },
+    { "long line",          long_line },
+    { "flat list",          flat_list },
+    { "loose list",         loose_list },
+    { "changelog",          changelog },
+    { "deep nesting",       deep_nesting },
+    { "unmatched emphasis", unmatched_emphasis },
+    { "unmatched brackets", unmatched_brackets },
+    { "backtick runs",      backtick_runs },
+    { "closers first",      closers_first },
+    { "wide table",         wide_table },
+};
+
+/* Best of RUNS, in nanoseconds per input byte. */
+static double time_per_byte(Arena *arena, const Page *p) {
+    double best = 0;
+    for (int r = 0; r < RUNS; r++) {
+        arena_reset(arena);
+        double start = omp_get_wtime();
+        MarkdownDoc doc = parse_markdown(arena, p->data, p->len);
+        double elapsed = omp_get_wtime() - start;
+        if (!doc.html) return -1;
+        if (r == 0 || elapsed < best) best = elapsed;
+    }
+    return best * 1e9 / (double)p->len;
+}
+
+int main(void) {
+    char *data = malloc(LARGE_SIZE);
+    Arena arena;
+    arena_init(&arena, 1 << 20);
+    if (!data) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    int failed = 0;
+    for (size_t i = 0; i < sizeof(CORPORA) / sizeof(CORPORA[0]); i++) {
+        Page small = { data, 0, SMALL_SIZE };
+        CORPORA[i].build(&small);
+        double small_ns = time_per_byte(&arena, &small);
+
+        Page large = { data, 0, LARGE_SIZE };
+        CORPORA[i].build(&large);
+        double large_ns = time_per_byte(&arena, &large);
+
+        if (small_ns < 0 || large_ns < 0) {
+            printf("%-19s render failed\n", CORPORA[i].name);
+            failed = 1;
+            continue;
+        }
+        double growth = large_ns / small_ns;
+        int ok = growth <= MAX_SLOWDOWN;
+        printf("%-19s %6.2f ns/B at %4zu KB  %6.2f ns/B at %4zu KB  x%.2f  %s\n",
+               CORPORA[i].name, small_ns, small.len >> 10, large_ns, large.len >> 10,
+               growth, ok ? "ok" : "SUPERLINEAR");
+        failed |= !ok;
+    }
+
+    arena_free(&arena);
+    free(data);
+    return failed;
+}
@@ -0,0 +1,166 @@
+/* Throughput of hash_from_memory against the byte-at-a-time FNV-1a it
+ * replaced, at path, front-matter, page and large-asset sizes. Before
+ * timing anything, checks that the vectorized hash gives the same digest
+ * as a plain C model of the algorithm over every short length and a few
+ * large ones. Run with `make bench`. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+#include "utils/hash.h"
+
+#define BUFFER_SIZE (1u << 20)
+#define MAX_SHIFT   64              /* rounds start at shifting offsets */
+#define BYTES_TIMED (256u << 20)    /* hashed per function and size */
+#define CHECK_UP_TO 4200            /* past four 1 KiB blocks and a tail */
+
+static uint64_t fnv1a(const char *data, size_t size) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < size; i++) {
+        h ^= (unsigned char)data[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+/* The stripe hash one lane at a time, straight from its description in
+ * utils/hash.h; the constants are copied from src/utils/hash.c. */
+static const uint64_t PRIME_1 = 0x9E3779B185EBCA87ULL;
+static const uint64_t PRIME_2 = 0xC2B2AE3D27D4EB4FULL;
+static const uint64_t PRIME_32 = 0x9E3779B1ULL;
+
+static const uint64_t SECRET[32] = {
+    0x184d394efc39172aULL, 0x0446af79126cbf55ULL, 0x9fbf372959ca09deULL, 0x6ffdbd67e921a260ULL,
+    0xf028d4de32e887c3ULL, 0x13d8620348d6a5ffULL, 0x8b844a87d50e4971ULL, 0x37f8888c47db91aeULL,
+    0x8e38614b2d72b691ULL, 0xeb9c05c19ab06b22ULL, 0x8c9f80f26007dd3aULL, 0xeee468f8b6eae59aULL,
+    0x49020ce480dca140ULL, 0x3da10b9aa3533d1eULL, 0xe21a627ff729b997ULL, 0x99af907c014abb08ULL,
+    0x5b80c0e7a5930c96ULL, 0x367df2f4a049f100ULL, 0x809b0243601186f6ULL, 0x6290d5ac0a179a9eULL,
+    0xcab250bbf45e68beULL, 0x812f38cc39168e2aULL, 0x49a31fe534c0f6d1ULL, 0x6387855a7ac7340eULL,
+    0xfd607855aab101c1ULL, 0xd11babbbc76f7dfcULL, 0x77dcf77482e81ad8ULL, 0xa6d05b4a2fca2a20ULL,
+    0x160a75d5cac8353eULL, 0x02fc4db20de8bec5ULL, 0xefd6e8aa72b31829ULL, 0x2dc16dee4965608aULL,
+};
+
+static uint64_t word_at(const char *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint64_t rotl(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static uint64_t mix(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+static uint64_t stripe_scalar(const char *data, size_t size) {
+    uint64_t acc[HASH_LANES];
+    for (int j = 0; j < HASH_LANES; j++) acc[j] = SECRET[j] ^ PRIME_1;
+
+    size_t stripes = size / HASH_STRIPE;
+    for (size_t s = 0; s < stripes; s++) {
+        const char *p = data + s * HASH_STRIPE;
+        const uint64_t *key = SECRET + s % 16;
+        for (int j = 0; j < HASH_LANES; j++) {
+            uint64_t v = word_at(p + 8 * j);
+            uint64_t k = v ^ key[j];
+            acc[j ^ 1] += v;
+            acc[j] += (k & 0xffffffffULL) * (k >> 32);
+        }
+        if ((s + 1) % 16 == 0) {
+            for (int j = 0; j < HASH_LANES; j++) {
+                uint64_t a = acc[j] ^ (acc[j] >> 47);
+                acc[j] = (a ^ SECRET[24 + j]) * PRIME_32;
+            }
+        }
+    }
+
+    uint64_t h = size * PRIME_1;
+    if (stripes) {
+        for (int j = 0; j < HASH_LANES; j++) h = rotl(h ^ mix(acc[j]), 27) * PRIME_1;
+    } else {
+        h ^= PRIME_2;
+    }
+
+    const char *tail = data + stripes * HASH_STRIPE;
+    size_t rest = size - stripes * HASH_STRIPE;
+    int word = 0;
+    for (; rest >= 8; rest -= 8, tail += 8) {
+        h = rotl(h ^ mix(word_at(tail) ^ SECRET[word++]), 27) * PRIME_1 + PRIME_2;
+    }
+    if (rest) {
+        uint64_t last = 0;
+        memcpy(&last, tail, rest);
+        h = rotl(h ^ mix(last ^ SECRET[word] ^ rest), 27) * PRIME_1 + PRIME_2;
+    }
+    return mix(h);
+}
+
+/* Every length up to CHECK_UP_TO and the sizes timed below, from an
+ * aligned and an odd start. */
+static int check_digests(const char *buf) {
+    static const size_t LARGE[] = { 1u << 12, (1u << 16) + 17, BUFFER_SIZE };
+    size_t checked = 0, mismatches = 0;
+
+    for (size_t start = 0; start < 2; start++) {
+        const char *p = buf + start * 3;
+        for (size_t len = 0; len <= CHECK_UP_TO; len++, checked++) {
+            mismatches += hash_from_memory(p, len) != stripe_scalar(p, len);
+        }
+        for (size_t i = 0; i < sizeof(LARGE) / sizeof(LARGE[0]); i++, checked++) {
+            mismatches += hash_from_memory(p, LARGE[i]) != stripe_scalar(p, LARGE[i]);
+        }
+    }
+
+    printf("digests: %zu lengths, %zu mismatches against the scalar model\n", checked, mismatches);
+    return mismatches != 0;
+}
+
+typedef uint64_t (*HashFn)(const char *, size_t);
+
+/* Hashes size bytes from a shifting offset until BYTES_TIMED have gone
+ * through; the digests are folded into *sink so no call can be dropped. */
+static double run(HashFn fn, const char *buf, size_t size, uint64_t *sink) {
+    size_t rounds = BYTES_TIMED / size;
+    fn(buf, size);  /* warm the caches untimed */
+    double start = omp_get_wtime();
+    for (size_t r = 0; r < rounds; r++) {
+        *sink += fn(buf + r % MAX_SHIFT, size);
+    }
+    return (double)size * rounds / (omp_get_wtime() - start) / 1e9;
+}
+
+int main(void) {
+    char *buf = malloc(BUFFER_SIZE + MAX_SHIFT);
+    if (!buf) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    unsigned seed = 1;
+    for (size_t i = 0; i < BUFFER_SIZE + MAX_SHIFT; i++) {
+        seed = seed * 1103515245u + 12345u;
+        buf[i] = (char)(seed >> 16);
+    }
+
+    int failed = check_digests(buf);
+
+    static const size_t SIZES[] = { 32, 256, 4u << 10, 1u << 20 };
+    uint64_t sink = 0;
+    for (size_t i = 0; i < sizeof(SIZES) / sizeof(SIZES[0]); i++) {
+        size_t size = SIZES[i];
+        double stripe_rate = run(hash_from_memory, buf, size, &sink);
+        double fnv_rate = run(fnv1a, buf, size, &sink);
+        printf("%8zu B  stripe %6.2f GB/s  fnv1a %5.2f GB/s  %5.1fx\n",
+               size, stripe_rate, fnv_rate, stripe_rate / fnv_rate);
+    }
+    printf("(checksum %016llx)\n", (unsigned long long)sink);
+
+    free(buf);
+    return failed;
+}
@@ -0,0 +1,194 @@
+/* Single-core throughput of the two passes built on the structural index:
+ * tokenize, and the one-pass render_stream. tokenize is set against a
+ * line-at-a-time tokenizer, which finds each line end with memchr and
+ * classifies the whole line byte by byte, as tokenize did before the index;
+ * both must produce the same tokens. Runs on a prose page (headings,
+ * three-line paragraphs and short lists, about 1.8 MB) and on a page of
+ * 60k short lines, where per-line costs dominate. Each figure is the mean
+ * over ROUNDS passes, each into a freshly reset arena. The prose page must
+ * stream; the short-line page has lazy list continuations, which send it
+ * to the tree path. Run with `make bench`. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+#include "arena.h"
+#include "parser/mlindown_token.h"
+#include "parser/mlindown_stream.h"
+
+#define PROSE_SECTIONS 3000
+#define SHORT_LINES    60000
+#define PAGE_CAP       (4u << 20)
+#define ARENA_SIZE     (1u << 20)
+#define ROUNDS         300
+
+typedef struct {
+    char  *data;
+    size_t len, cap;
+} Page;
+
+static void puts_page(Page *p, const char *s) {
+    size_t n = strlen(s);
+    if (p->len + n > p->cap) n = p->cap - p->len;
+    memcpy(p->data + p->len, s, n);
+    p->len += n;
+}
+
+static unsigned seed = 1;
+
+static unsigned next_random(unsigned n) {
+    seed = seed * 1103515245u + 12345u;
+    return (seed >> 16) % n;
+}
+
+static const char *const WORDS[] = {
+    "lorem", "ipsum", "dolor", "sit", "amet", "consectetur",
+    "adipiscing", "elit", "sed", "do", "eiusmod", "tempor",
+};
+
+static void words(Page *p, int n) {
+    for (int i = 0; i < n; i++) {
+        if (i) puts_page(p, " ");
+        puts_page(p, WORDS[next_random(sizeof(WORDS) / sizeof(WORDS[0]))]);
+    }
+}
+
+/* Plain text lines, so nearly every line is classified without reading
+ * its bytes. */
+static void prose_page(Page *p) {
+    char line[64];
+    p->len = 0;
+    puts_page(p, "---\ntitle: bench\n---\n");
+    for (int s = 0; s < PROSE_SECTIONS; s++) {
+        snprintf(line, sizeof(line), "%.*s Section %d\n\n", 1 + (int)next_random(3), "###", s);
+        puts_page(p, line);
+        for (int para = 0; para < 2; para++) {
+            for (int l = 0; l < 3; l++) {
+                words(p, 12);
+                puts_page(p, "\n");
+            }
+            puts_page(p, "\n");
+        }
+        for (int i = 0; i < 4; i++) {
+            puts_page(p, "- ");
+            words(p, 5);
+            puts_page(p, "\n");
+        }
+        puts_page(p, "\n");
+    }
+}
+
+/* Headings, list items and blank lines between runs of a few words. */
+static void short_page(Page *p) {
+    char line[64];
+    p->len = 0;
+    for (int i = 0; i < SHORT_LINES; i++) {
+        unsigned r = next_random(100);
+        if (r < 10) {
+            snprintf(line, sizeof(line), "# h%d\n", i);
+        } else if (r < 30) {
+            snprintf(line, sizeof(line), "- item %d\n", i);
+        } else if (r < 45) {
+            snprintf(line, sizeof(line), "\n");
+        } else {
+            snprintf(line, sizeof(line), "%.*s\n", 5 * (1 + (int)next_random(4)), "word word word word ");
+        }
+        puts_page(p, line);
+    }
+}
+
+static TokenList tokenize_lines(Arena *arena, const char *input, size_t len) {
+    TokenList tl = { .data = NULL, .count = 0, .source = input, .length = len };
+    const char *end = input + len;
+    size_t lines = 0;
+
+    for (const char *p = input; p < end; lines++) {
+        const char *nl = memchr(p, '\n', (size_t)(end - p));
+        p = nl ? nl + 1 : end;
+    }
+    if (lines == 0) return tl;
+    tl.data = ARENA_ALLOC_ARRAY(arena, Token, lines);
+    if (!tl.data) return tl;
+
+    for (size_t pos = 0; pos < len;) {
+        const char *nl = memchr(input + pos, '\n', len - pos);
+        size_t line_end = nl ? (size_t)(nl - input) : len;
+        tl.data[tl.count++] = token_classify(input, pos, line_end);
+        pos = line_end + 1;
+    }
+    return tl;
+}
+
+/* Both tokenizers, compared token by token. */
+static int same_tokens(const Page *page) {
+    Arena arena;
+    arena_init(&arena, ARENA_SIZE);
+    TokenList indexed = tokenize(&arena, page->data, page->len);
+    TokenList lines = tokenize_lines(&arena, page->data, page->len);
+    int same = indexed.count == lines.count &&
+               memcmp(indexed.data, lines.data, indexed.count * sizeof(Token)) == 0;
+    arena_free(&arena);
+    return same;
+}
+
+static double rate(const Page *p, double seconds) {
+    return (double)p->len * ROUNDS / seconds / 1e6;
+}
+
+static int bench(const char *name, const Page *page, int must_stream) {
+    Arena arena;
+    arena_init(&arena, ARENA_SIZE);
+    size_t tokens = 0, html_len = 0;
+    int streamed = 1;
+
+    double start = omp_get_wtime();
+    for (int r = 0; r < ROUNDS; r++) {
+        arena_reset(&arena);
+        tokens = tokenize(&arena, page->data, page->len).count;
+    }
+    double tokenize_time = omp_get_wtime() - start;
+
+    start = omp_get_wtime();
+    for (int r = 0; r < ROUNDS; r++) {
+        arena_reset(&arena);
+        tokenize_lines(&arena, page->data, page->len);
+    }
+    double lines_time = omp_get_wtime() - start;
+    int same = same_tokens(page);
+
+    start = omp_get_wtime();
+    for (int r = 0; r < ROUNDS && streamed; r++) {
+        arena_reset(&arena);
+        streamed = render_stream(&arena, page->data, page->len, &html_len) != NULL;
+    }
+    double stream_time = omp_get_wtime() - start;
+
+    printf("%-12s %5.2f MB  tokenize %7.1f MB/s  by line %7.1f MB/s (%zu tokens, %s)", name,
+           page->len / 1e6, rate(page, tokenize_time), rate(page, lines_time), tokens,
+           same ? "same" : "MISMATCH");
+    if (streamed) {
+        printf("  stream %7.1f MB/s (%zu bytes)\n", rate(page, stream_time), html_len);
+    } else {
+        printf("  stream %s: tree path\n", must_stream ? "FAILED" : "n/a");
+    }
+
+    arena_free(&arena);
+    return !same || (must_stream && !streamed);
+}
+
+int main(void) {
+    Page page = { malloc(PAGE_CAP), 0, PAGE_CAP };
+    if (!page.data) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    int failed = 0;
+    prose_page(&page);
+    failed |= bench("prose", &page, 1);
+    short_page(&page);
+    failed |= bench("short lines", &page, 0);
+
+    free(page.data);
+    return failed;
+}
@@ -27,8 +27,12 @@ void arena_free(Arena* arena);
 void* arena_alloc(Arena* arena, size_t size);
 void* arena_alloc_aligned(Arena* arena, size_t size, size_t alignment);
 void arena_reset(Arena* arena);
+// Gives back the end of the most recent allocation; a no-op for any other.
+void arena_shrink(Arena* arena, void* ptr, size_t old_size, size_t new_size);
 
-#define ARENA_ALLOC(arena, type) (type*)arena_alloc((arena), sizeof(type))
-#define ARENA_ALLOC_ARRAY(arena, type, count) (type*)arena_alloc((arena), sizeof(type) * (count))
+#define ARENA_ALLOC(arena, type) \
+    (type*)arena_alloc_aligned((arena), sizeof(type), alignof(type))
+#define ARENA_ALLOC_ARRAY(arena, type, count) \
+    (type*)arena_alloc_aligned((arena), sizeof(type) * (count), alignof(type))
 
 #endif // ARENA_H
@@ -0,0 +1,59 @@
+#ifndef FRONTMATTER_H
+#define FRONTMATTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "arena.h"
+
+// The YAML block between a "---" first line and the next "---" line, read
+// in one pass into a table of spans over the page source. Nothing is
+// copied, so the source must outlive the table, and quoted values are
+// their raw text between the quotes.
+
+typedef struct {
+    const char* data;
+    size_t len;
+} FrontMatterSpan;
+
+typedef enum {
+    FM_STRING,
+    FM_NUMBER,   // a plain integer
+    FM_BOOL,     // true/false, yes/no
+    FM_DATE,     // YYYY-MM-DD, with an optional time and UTC offset
+    FM_LIST      // [a, b] or "- item" lines under an empty value
+} FrontMatterType;
+
+typedef struct {
+    FrontMatterSpan key;
+    FrontMatterSpan value;          // scalars: the text; lists: all of it
+    FrontMatterType type;
+    int64_t number;                 // FM_NUMBER and FM_BOOL; FM_DATE in Unix seconds
+    const FrontMatterSpan* items;   // FM_LIST entries
+    size_t item_count;
+} FrontMatterField;
+
+typedef struct {
+    // Every key in source order; a repeated key appears twice, and the
+    // fields below follow the last one.
+    FrontMatterField* fields;
+    size_t field_count;
+
+    FrontMatterSpan title;
+    FrontMatterSpan layout;
+    FrontMatterSpan slug;
+    const FrontMatterSpan* tags;   // a scalar tags value is one tag
+    size_t tag_count;
+    int64_t date;                  // Unix seconds; 0 when missing or unparsable
+    int64_t weight;
+    int draft;
+    int has_date;
+} FrontMatter;
+
+// Fills fm from the frontmatter at the start of content and returns how
+// many bytes the markdown body starts after, or 0 when there is none.
+size_t frontmatter_parse(Arena* arena, const char* content, size_t len, FrontMatter* fm);
+
+// The last field named key, or NULL.
+const FrontMatterField* frontmatter_get(const FrontMatter* fm, const char* key);
+
+#endif
@@ -3,17 +3,20 @@
 
 #include <stddef.h>
 #include "arena.h"
-
-typedef struct {
-    char* title;
-} FrontMatter;
+#include "parser/frontmatter.h"
+#include "utils/blockcache.h"
 
 typedef struct {
     FrontMatter frontmatter;
     char* html;
+    size_t html_len;
 } MarkdownDoc;
 
 MarkdownDoc parse_markdown(Arena* arena, const char* input, size_t len);
 
+// Large pages are rendered a chunk of top-level blocks at a time, reusing
+// the HTML memo already has for a chunk and adding what it has not.
+MarkdownDoc parse_markdown_memo(Arena* arena, const char* input, size_t len, BlockMemo* memo);
+
 #endif 
 
@@ -2,27 +2,57 @@
 #define PARSER_AST_H
 
 #include <stddef.h>
+#include "arena.h"
 
 typedef enum {
     MLINDOWN_NODE_DOCUMENT,
     MLINDOWN_NODE_HEADING,
     MLINDOWN_NODE_PARAGRAPH,
     MLINDOWN_NODE_LIST,
-    MLINDOWN_NODE_LIST_ITEM
+    MLINDOWN_NODE_LIST_ITEM,
+    MLINDOWN_NODE_ORDERED_LIST,
+    MLINDOWN_NODE_BLOCKQUOTE,
+    MLINDOWN_NODE_CODE_BLOCK,
+    MLINDOWN_NODE_THEMATIC_BREAK,
+    MLINDOWN_NODE_TABLE,
+    MLINDOWN_NODE_TABLE_ROW,
+    MLINDOWN_NODE_TABLE_CELL
 } NodeType;
 
+/* Table cell alignment, kept in Node.level. */
+typedef enum {
+    MLINDOWN_ALIGN_NONE,
+    MLINDOWN_ALIGN_LEFT,
+    MLINDOWN_ALIGN_CENTER,
+    MLINDOWN_ALIGN_RIGHT
+} CellAlign;
+
+/* Node.flags */
+#define MLINDOWN_LIST_TIGHT      0x1  /* list items render their paragraphs bare */
+#define MLINDOWN_LAST_LINE_BLANK 0x2  /* parse-time: the block ended on a blank line */
+
+/* Nodes live in the page arena and never own memory: text is a span into
+ * the source buffer, or into the arena when a block's lines are not
+ * consecutive in the source (a paragraph inside a block quote), and
+ * children form a singly linked list. The whole tree goes away with the
+ * arena. */
 typedef struct Node {
     NodeType      type;         /* which kind of node */
-    int           level;        /* for headings: 1–6; unused otherwise */
-    char         *text;         /* leaf text (heading text, paragraph text, list‐item text) */
-    struct Node **children;     /* child nodes (e.g. items in a list) */
+    int           level;        /* headings: 1–6; ordered lists: start number;
+                                   table rows: 1 for the header; cells: CellAlign */
+    unsigned      flags;
+    const char   *text;         /* leaf text span (heading, paragraph, code, cell) */
+    size_t        text_len;     /* length of the span; text is not NUL-terminated */
+    const char   *info;         /* code blocks: language from the fence, or NULL */
+    size_t        info_len;
+    struct Node  *first_child;
+    struct Node  *last_child;
+    struct Node  *next;         /* next sibling */
     size_t        child_count;  /* number of children */
 } Node;
 
-Node *node_new(NodeType type, int level, const char *text);
+Node *node_new(Arena *arena, NodeType type, int level, const char *text, size_t text_len);
 
 void node_add_child(Node *parent, Node *child);
 
-void node_free(Node *root);
-
-#endif 
\ No newline at end of file
+#endif 
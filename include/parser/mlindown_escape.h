@@ -0,0 +1,27 @@
+#ifndef PARSER_ESCAPE_H
+#define PARSER_ESCAPE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* HTML escaping of page text: < > & " and ' become entities, everything
+ * else is copied as is. The bytes to replace are found 64 at a time with
+ * the block index's nibble classifier (32 per AVX2 vector, 16 per NEON
+ * one), and the clean runs between them are copied whole. */
+
+/* Most bytes escaping adds per input byte: '"' becomes "&quot;". */
+#define ESCAPE_GROWTH 5
+
+/* Bytes in text that escaping replaces. */
+size_t escape_count(const char *text, size_t len);
+
+/* Bit i is set where p[i] needs escaping, for scans that classify the
+ * block anyway. p must have 64 readable bytes. */
+uint64_t escape_match_block(const unsigned char *p);
+
+/* Writes text escaped to out, which needs room for
+ * len + escape_count(text, len) * ESCAPE_GROWTH bytes, and returns the end
+ * of what was written. */
+char *escape_html(char *out, const char *text, size_t len);
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef PARSER_INDEX_H
+#define PARSER_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* First stage of block parsing, after simdjson: the input is classified 64
+ * bytes at a time into bitmaps of newlines, in-line whitespace and block
+ * marker bytes (# - * + > = _ : 0-9 ` ~ |), so line splitting and
+ * indentation skips are bit scans and only lines that start with a marker
+ * look at bytes.
+ *
+ * Classifying a block needs nothing from its neighbours, so the index keeps
+ * only the block the cursor is in. Callers that walk forward classify each
+ * block once; stepping back just classifies it again. */
+#define INDEX_BLOCK 64
+
+typedef struct {
+    const char *input;
+    size_t      len;
+    size_t      block;    /* offset of the classified block */
+    uint64_t    newline;
+    uint64_t    space;    /* ' ' \t \v \f \r */
+    uint64_t    marker;
+} StructuralIndex;
+
+void index_init(StructuralIndex *idx, const char *input, size_t len);
+void index_load(StructuralIndex *idx, size_t block);
+
+/* Slow path of the queries below, for hits outside the current block. */
+size_t index_scan(StructuralIndex *idx, size_t pos, size_t end, int skip_space);
+
+#define INDEX_BLOCK_OF(pos) ((pos) & ~(size_t)(INDEX_BLOCK - 1))
+
+/* Offset of the first '\n' at or after pos, or len if there is none. */
+static inline size_t index_next_newline(StructuralIndex *idx, size_t pos) {
+    if (INDEX_BLOCK_OF(pos) == idx->block) {
+        uint64_t word = idx->newline & (~0ULL << (pos % INDEX_BLOCK));
+        if (word) return idx->block + (size_t)__builtin_ctzll(word);
+    }
+    return index_scan(idx, pos, idx->len, 0);
+}
+
+/* Offset of the first non-whitespace byte in [pos, end), or end. A '\n'
+ * is not whitespace here, so an unbounded skip stops at the line end. */
+static inline size_t index_skip_space(StructuralIndex *idx, size_t pos, size_t end) {
+    if (pos >= end) return end;
+    if (INDEX_BLOCK_OF(pos) == idx->block && !((idx->space >> (pos % INDEX_BLOCK)) & 1)) {
+        return pos;
+    }
+    return index_scan(idx, pos, end, 1);
+}
+
+static inline int index_is_marker(StructuralIndex *idx, size_t pos) {
+    if (INDEX_BLOCK_OF(pos) != idx->block) index_load(idx, INDEX_BLOCK_OF(pos));
+    return (int)((idx->marker >> (pos % INDEX_BLOCK)) & 1);
+}
+
+/* Lines the tokenizer sees in input: one per '\n', plus an unterminated
+ * last line. */
+size_t index_count_lines(const char *input, size_t len);
+
+/* Bit i is set where p[i] belongs to a byte set given as two nibble tables
+ * (a byte matches if low[b & 15] & high[b >> 4] is non-zero), for later
+ * stages that scan for their own delimiters. p must have 64 readable bytes. */
+uint64_t index_match_block(const unsigned char *p, const uint8_t low[16], const uint8_t high[16]);
+
+#endif
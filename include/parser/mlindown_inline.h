@@ -0,0 +1,47 @@
+#ifndef PARSER_INLINE_H
+#define PARSER_INLINE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "arena.h"
+#include "parser/mlindown_escape.h"
+
+/* Inline markup inside a block's text: emphasis, strong emphasis, code
+ * spans, backslash escapes, links and images. Delimiter bytes are found
+ * 64 at a time with the block index's SIMD classifier, emphasis is
+ * resolved with the CommonMark delimiter stack, and relative links to .md
+ * pages point at the .html files the build writes instead.
+ *
+ * Every step is linear in the span: each closer searches back only as far
+ * as the last failed search for its kind allows, and a backtick run with
+ * no closer is found out once per span. */
+
+/* Most output bytes one delimiter byte (* _ ` [ ] \) can add on top of
+ * itself, e.g. `![a](b "c")` -> `<img src="b" alt="a" title="c" />`.
+ * Escaping is on top of this: each source byte is written once, so every
+ * < > & " ' adds at most ESCAPE_GROWTH more. */
+#define INLINE_GROWTH 12
+
+typedef struct InlineDelim InlineDelim;
+
+typedef struct {
+    InlineDelim *delims;
+    int32_t     *brackets;
+    size_t       cap;
+} InlineScratch;
+
+/* Delimiter bytes in text; a span needs at most this many records. The
+ * same pass counts the bytes escaping replaces into *escapes. */
+size_t inline_count_delims(const char *text, size_t len, size_t *escapes);
+
+/* Makes room in scratch for spans with up to delims delimiter bytes.
+ * Returns 0 if the arena is out of memory. */
+int inline_reserve(InlineScratch *scratch, Arena *arena, size_t delims);
+
+/* Renders the span to out, HTML-escaping its text, and returns the end of
+ * what was written. out needs room for
+ * len + delims * INLINE_GROWTH + escapes * ESCAPE_GROWTH bytes, with both
+ * counts from inline_count_delims. */
+char *render_inline(InlineScratch *scratch, char *out, const char *text, size_t len);
+
+#endif
@@ -5,6 +5,6 @@
 #include "parser/mlindown_token.h"
 
 
-Node *parse_tokens(const TokenList *tokens);
+Node *parse_tokens(Arena *arena, const TokenList *tokens);
 
 #endif /* PARSER_PARSER_H */
\ No newline at end of file
@@ -3,9 +3,13 @@
 
 #include <stdio.h>
 #include "parser/mlindown_ast.h"
+#include "arena.h"
 
 void render_html(const Node *node, FILE *out);
 
-char *render_html_str(const Node *node);
+/* Returns the HTML for node's tree, NUL-terminated and sized into
+ * *out_len, in arena memory that lives until the arena is reset. NULL if
+ * the arena is out of memory. */
+char *render_html_str(Arena *arena, const Node *node, size_t *out_len);
 
 #endif 
\ No newline at end of file
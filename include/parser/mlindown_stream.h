@@ -0,0 +1,14 @@
+#ifndef PARSER_STREAM_H
+#define PARSER_STREAM_H
+
+#include <stddef.h>
+#include "arena.h"
+
+/* Renders len bytes of markdown to HTML in one forward pass, with no token
+ * list or tree, straight into a single arena buffer sized up front.
+ * Returns NULL when the page uses something that needs look-ahead; the
+ * caller then takes the tokenize -> parse_tokens -> render_html_str path,
+ * which produces the same HTML for everything this one accepts. */
+char *render_stream(Arena *arena, const char *input, size_t len, size_t *out_len);
+
+#endif
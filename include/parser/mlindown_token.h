@@ -2,28 +2,72 @@
 #define PARSER_TOKEN_H
 
 #include <stddef.h>
+#include <stdint.h>
+#include "arena.h"
+#include "parser/mlindown_index.h"
 
 typedef enum {
-    TOKEN_HEADING,    /* an ATX heading line (e.g. "# Heading") */
-    TOKEN_LIST_ITEM,  /* an unordered-list item line (e.g. "- Item") */
-    TOKEN_BLANK,      /* an empty or all-whitespace line */
-    TOKEN_TEXT        /* any other text line */
+    TOKEN_HEADING,       /* an ATX heading line (e.g. "# Heading") */
+    TOKEN_LIST_ITEM,     /* a bullet list item line ("- Item", "* Item", "+ Item") */
+    TOKEN_BLANK,         /* an empty or all-whitespace line */
+    TOKEN_TEXT,          /* any other text line */
+    TOKEN_ORDERED_ITEM,  /* an ordered list item line ("1. Item", "1) Item") */
+    TOKEN_QUOTE,         /* a block quote line ("> Quote") */
+    TOKEN_FENCE,         /* an opening or closing code fence ("```c", "~~~") */
+    TOKEN_BREAK,         /* a thematic break ("***", "- - -") */
+    TOKEN_UNDERLINE,     /* a bare run of '=' or '-': a setext underline after
+                            a paragraph, else a break, an empty item or text */
+    TOKEN_TABLE_DELIM    /* a table delimiter row ("| --- | :-: |") */
 } TokenType;
 
-/* A single line token */
+/* A single line token. The text is the rest of the line, trimmed of marker
+ * & leading spaces, as a span of the input: it is never copied, and it
+ * always ends at the line end. Lines indented four columns or more are
+ * TEXT whatever they start with. */
 typedef struct {
-    TokenType type;
-    int       level; /* for headings: number of leading '#'; else unused */
-    char     *text;  /* the rest of the line, trimmed of marker & leading spaces */
+    uint32_t offset;  /* span start, from the beginning of the input */
+    uint32_t length;
+    uint8_t  type;    /* TokenType */
+    uint8_t  level;   /* headings: number of '#'; list items: width of the
+                         marker and the spaces after it; fences and
+                         underlines: length of the run, at most 255 */
+    uint8_t  indent;  /* columns before the first non-space byte, at most 255 */
+    uint8_t  marker;  /* list items: the bullet, or '.' / ')' after the
+                         number; fences and underlines: the run's byte */
 } Token;
 
 typedef struct {
-    Token  *data;
-    size_t  count;
+    Token      *data;
+    size_t      count;
+    const char *source;  /* the input the offsets refer to */
+    size_t      length;  /* bytes of it that were tokenized */
 } TokenList;
 
-TokenList tokenize(const char *input);
+/* Tokenizes len bytes of input, which need not be NUL-terminated and is
+ * only read, so a read-only mapping works. Lines are counted first and the
+ * token array is one arena allocation; lines are then split off the
+ * structural index. Inputs over 4 GiB are cut short. */
+TokenList tokenize(Arena *arena, const char *input, size_t len);
 
-void free_tokens(TokenList *list);
+/* Classifies the line starting at *pos in the indexed input and moves *pos
+ * past its '\n'. Shared by tokenize and the streaming renderer so both
+ * agree on what a line is. */
+Token token_next(StructuralIndex *idx, size_t *pos);
 
-#endif 
\ No newline at end of file
+/* Classifies [start, end) of input, the rest of a line, as token_next
+ * would a whole line. The tree parser uses it on what is left of a line
+ * after block quote and list item prefixes. */
+Token token_classify(const char *input, size_t start, size_t end);
+
+/* Length of a heading's text without the optional closing run of '#' and
+ * trailing whitespace. */
+size_t token_heading_length(const char *text, size_t len);
+
+/* Length of the first word of a fence's info string, the code language. */
+size_t token_info_length(const char *text, size_t len);
+
+static inline const char *token_text(const TokenList *tl, const Token *t) {
+    return tl->source + t->offset;
+}
+
+#endif 
@@ -7,6 +7,10 @@ typedef struct {
     const char* input_dir;
     const char* output_dir;
     const char* tmpl;
+    const char* template_dir;
+    int threads;
+    int trust_dir_mtimes;   // skip directories whose mtime is unchanged;
+                            // misses pages edited in place
 } YamlConfig;
 
 int parse_yaml(const char* filename, YamlConfig* config);
@@ -0,0 +1,101 @@
+#ifndef TEMPLATE_H
+#define TEMPLATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+#include "arena.h"
+#include "parser/frontmatter.h"
+#include "utils/uthash.h"
+
+// Page templates, compiled once at startup into a flat list of literal
+// slices and variable slots that every thread runs read-only.
+//
+//   {{name}}            a frontmatter value, HTML-escaped; lists are joined
+//                       with ", "
+//   {{{name}}}          the same, unescaped ({{& name}} too)
+//   {{content}}         the page HTML, never escaped
+//   {{#name}}..{{/name}} the body once per item of a list, where {{.}} is
+//                       the item, or once if the value is set, not empty
+//                       and not false
+//   {{^name}}..{{/name}} the body if the value is missing, empty or false
+//   {{> file}}          another template, from the including template's
+//                       directory, ".html" added when file has no extension
+//   {{! comment}}       nothing
+
+typedef enum {
+    TPL_TEXT,
+    TPL_VAR,
+    TPL_RAW,
+    TPL_SECTION,
+    TPL_INVERTED,
+    TPL_END
+} TemplateOp;
+
+typedef enum {
+    TPL_SLOT_FIELD,     // the frontmatter key in name
+    TPL_SLOT_CONTENT,
+    TPL_SLOT_ITEM       // {{.}}
+} TemplateSlot;
+
+typedef struct {
+    uint8_t op;         // TemplateOp
+    uint8_t slot;       // TemplateSlot, for everything but TPL_TEXT
+    uint32_t jump;      // sections: past their end; TPL_END: its section
+    const char* text;   // TPL_TEXT: the literal; otherwise the key
+    size_t len;
+} TemplateInstr;
+
+typedef struct {
+    TemplateInstr* code;
+    size_t count;
+    char** sources;     // template and partial texts, and key names
+    size_t source_count;
+    uint64_t hash;      // of the template and partial texts, in order
+} Template;
+
+// Reads and compiles the template at path and every partial it includes.
+// Returns 0 and prints why on error.
+int template_compile(Template* tpl, const char* path);
+void template_free(Template* tpl);
+
+// Fills slices with the page: literals and content are referenced where
+// they are, everything else is written to arena. Returns how many slices
+// were used, at most max_slices (which must be at least 1), or -1 when
+// arena is out of memory.
+int template_render(const Template* tpl, const FrontMatter* fm,
+                    const char* content, size_t content_len,
+                    Arena* arena, struct iovec* slices, int max_slices);
+
+// Every template under a directory, compiled once at startup and shared
+// read-only by the render threads. A template is named by its path below
+// the directory without ".html", so templates/blog/post.html is
+// "blog/post".
+typedef struct {
+    char* name;
+    Template tpl;
+    UT_hash_handle hh;
+} TemplateEntry;
+
+typedef struct {
+    TemplateEntry* entries;
+    size_t count;
+} TemplateRegistry;
+
+// Compiles every .html file below dir, skipping dot files. Returns 0 and
+// prints why when any of them fails.
+int template_registry_load(TemplateRegistry* reg, const char* dir);
+void template_registry_free(TemplateRegistry* reg);
+const Template* template_registry_find(const TemplateRegistry* reg, const char* name, size_t len);
+
+// The template for a page at rel_path below the input directory: the one
+// its layout value names, else the nearest "default" in the registry on the
+// way up from the page's directory (blog/2024/default, blog/default,
+// default), else fallback.
+const Template* template_select(const TemplateRegistry* reg, FrontMatterSpan layout,
+                                const char* rel_path, const Template* fallback);
+
+// The template a layout value names, or NULL.
+const Template* template_layout(const TemplateRegistry* reg, FrontMatterSpan layout);
+
+#endif
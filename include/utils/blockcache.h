@@ -0,0 +1,72 @@
+#ifndef BLOCKCACHE_H
+#define BLOCKCACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "uthash.h"
+
+// Rendered HTML of top-level markdown blocks, keyed by the hash and length
+// of their source bytes, so a large page re-renders only the blocks that
+// changed since the last build. Like the page cache, the file from the
+// last build is mapped read-only for the whole run and workers look it up
+// without locks; what they render or reuse goes to their own BlockMemo,
+// and the memos are merged into the next file by block_cache_save.
+
+// Every fragment is only valid for the renderer that wrote it: bump this
+// whenever the HTML produced for some markdown changes.
+#define BLOCK_CACHE_RENDERER 1
+
+typedef struct {
+    uint64_t hash;
+    uint64_t source_len;
+    uint64_t html_off;       // into the fragment pool
+    uint64_t html_len;
+    int64_t last_used;       // build time that last rendered or reused it
+} BlockRecord;
+
+typedef struct {
+    const char* base;
+    size_t size;
+    const BlockRecord* records;
+    size_t count;
+    const uint32_t* slots;   // open addressing, record index + 1, 0 = empty
+    size_t slot_mask;
+    const char* pool;
+    size_t pool_size;
+} BlockSnapshot;
+
+typedef struct {
+    uint64_t key[2];         // hash, source length
+    const char* html;        // malloc'd when owned, else in the snapshot
+    size_t html_len;
+    int owned;
+    UT_hash_handle hh;
+} BlockEntry;
+
+typedef struct {
+    const BlockSnapshot* snapshot;
+    BlockEntry* entries;     // every block this worker rendered or reused
+    size_t hits;
+    size_t misses;
+} BlockMemo;
+
+int block_cache_load(BlockSnapshot* snap, const char* path);
+void block_snapshot_free(BlockSnapshot* snap);
+
+// Keeps what this run used, then older fragments, newest first, while
+// they fit in budget bytes of HTML.
+int block_cache_save(const BlockMemo* memo, const BlockSnapshot* snap, const char* path,
+                     size_t budget);
+
+// The cached HTML for a block, or NULL. A hit is remembered, so the
+// fragment survives the next save.
+const char* block_memo_find(BlockMemo* memo, uint64_t hash, size_t source_len, size_t* html_len);
+void block_memo_store(BlockMemo* memo, uint64_t hash, size_t source_len,
+                      const char* html, size_t html_len);
+
+// Moves src's entries and counts into dst and leaves src empty.
+void block_memo_merge(BlockMemo* dst, BlockMemo* src);
+void block_memo_free(BlockMemo* memo);
+
+#endif
@@ -3,8 +3,10 @@
 
 #include <stdint.h>
 #include <time.h>
+#include <pthread.h>
 
 #include "uthash.h"
+#include "utils/hash.h"
 
 
 typedef struct {
@@ -12,36 +14,133 @@ typedef struct {
     char* output_path;
     time_t last_modified;
     uint64_t content_hash;
+    uint64_t output_hash; // hash of the rendered page as last written
+    uint64_t build_ns;    // how long the last build of this page took
+    char* layout;         // the page's layout key, "" without one
+    uint64_t deps_hash;   // everything but the source that made the output
     UT_hash_handle hh;    
 } CacheEntry;
 
 
 typedef CacheEntry* BuildCache;
 
+// One fixed-width record of the cache file. Paths are offsets into the
+// string pool, so a mapped file is used exactly as it lies on disk.
+typedef struct {
+    uint64_t path_hash;
+    uint64_t input_off;
+    uint64_t output_off;
+    int64_t last_modified;
+    uint64_t content_hash;
+    uint64_t output_hash;
+    uint64_t build_ns;
+    uint64_t layout_off;
+    uint64_t deps_hash;
+} CacheRecord;
+
+// The cache as it was when the build started: the mapped cache file, or an
+// image built in memory when an older format had to be converted, with the
+// records of the journal laid over it. Nothing in it is written during the
+// build, so worker threads look pages up concurrently without any lock.
+// Pages rebuilt this run are appended to the journal as they are written,
+// and go to a BuildCache that cache_save merges over the snapshot.
+typedef struct CacheSnapshot {
+    const char* base;        // the whole image
+    size_t size;
+    int mapped;              // base is a file mapping rather than malloc'd
+    const CacheRecord* records;
+    size_t count;
+    const uint32_t* slots;   // open addressing, record index + 1, 0 = empty
+    size_t slot_mask;
+    const char* strings;
+    size_t strings_size;
+    struct CacheSnapshot* journal;   // replayed journal records, found first
+    uint64_t journal_size;           // bytes of the journal that replayed, 0 = none
+    size_t journal_records;
+} CacheSnapshot;
+
+// Appends cache entries to the journal beside the cache file as pages are
+// written, so a build that is killed keeps what it finished. Any thread may
+// append; records are buffered and written by cache_journal_flush, or when
+// the buffer fills.
+typedef struct {
+    int fd;                  // -1: no journal, cache_save must keep everything
+    pthread_mutex_t lock;
+    char* buffer;
+    size_t used;
+    size_t capacity;
+    size_t records;          // in the file, from earlier runs too
+    int failed;
+} CacheJournal;
 
 
+typedef struct {
+    double busy_time;
+    size_t files;
+    size_t steals;
+} WorkerStats;
+
 typedef struct {
     size_t total_files;
     size_t built_files;
     size_t copied_files;
     double total_time;
+    double first_output_time;
+    size_t directories;
+    const char* write_backend;
+    size_t io_submitted;
+    size_t io_completed;
+    size_t sync_writes;
+    size_t write_errors;
+    size_t skipped_writes;   // rebuilt, but byte-identical to the file on disk
+    size_t block_hits;       // chunks of large pages reused from the block cache
+    size_t block_misses;
+    size_t directories_replayed;   // listed from the directory cache instead
+    int worker_count;
+    WorkerStats* workers;
 } BuildMetrics;
 
 
 
 
-int cache_save(const BuildCache* cache, const char* path);
-int cache_load(BuildCache* cache, const char* path);
+int cache_load(CacheSnapshot* snap, const char* path);
+
+// Compacts the snapshot, the journal and cache into a new cache file,
+// which replaces the old one by rename, and then drops the journal.
+int cache_save(const BuildCache* cache, const CacheSnapshot* base, const char* path);
+
+// Opens the journal of the cache at path for appending, cutting off any
+// torn record a killed build left at its end.
+int cache_journal_open(CacheJournal* journal, const char* path, const CacheSnapshot* snap);
+void cache_journal_append(CacheJournal* journal, const CacheEntry* entry);
+int cache_journal_flush(CacheJournal* journal);
+// Flushes, syncs and closes. Returns 0 if any record may be lost.
+int cache_journal_close(CacheJournal* journal);
+// Whether the journal has grown enough against the snapshot, or failed,
+// that cache_save should run.
+int cache_journal_should_compact(const CacheJournal* journal, const CacheSnapshot* snap);
 void cache_free(BuildCache* cache);
 void cache_update_entry(BuildCache* cache, const char* in_path,
-                       const char* out_path, time_t mtime, uint64_t hash);
-void cache_purge_missing(BuildCache* cache);
-
-int needs_rebuild(const char* in_path, BuildCache* cache);
+                       const char* out_path, time_t mtime, uint64_t hash,
+                       uint64_t output_hash, uint64_t build_ns,
+                       const char* layout, uint64_t deps_hash);
+
+const CacheRecord* cache_snapshot_find(const CacheSnapshot* snap, const char* in_path);
+const char* cache_record_input(const CacheSnapshot* snap, const CacheRecord* rec);
+const char* cache_record_output(const CacheSnapshot* snap, const CacheRecord* rec);
+const char* cache_record_layout(const CacheSnapshot* snap, const CacheRecord* rec);
+void cache_snapshot_free(CacheSnapshot* snap);
+
+// What a page's output would depend on now, besides its source: the
+// caller hashes the template its layout selects, the config and the
+// generator version. A page whose record holds a different hash is rebuilt.
+typedef uint64_t (*DepsHashFn)(void* ctx, const char* in_path, const char* layout);
+
+// output_known skips the check that the output still exists, for pages
+// whose output directory has not changed since it was last checked.
+int needs_rebuild(const char* in_path, time_t mtime, int output_known,
+                  const CacheSnapshot* snap, DepsHashFn deps_hash, void* ctx);
 int needs_copy(const char* src, const char* dst);
 
-uint64_t file_hash(const char* path);
-uint64_t hash_from_memory(const char* data, size_t size);
-
 
 #endif // CACHE_H
\ No newline at end of file
@@ -0,0 +1,109 @@
+#ifndef DIRCACHE_H
+#define DIRCACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+// Directory listings from the last build, so the walk can skip getdents
+// and the per-page stat and access in directories that have not changed.
+// A directory's mtime moves when entries are added, removed or renamed in
+// it, but not when a file in it is rewritten in place, so this is opt-in:
+// editors that save by rename are seen, in-place writes are not.
+//
+// Like the page cache, the file from the last build is mapped read-only
+// and looked up without locks. Directories listed again this run are
+// collected in memory and merged into the next file by dir_cache_save.
+
+// mtimes this close to when a listing was taken could still change within
+// the same timestamp tick (FAT has 2 second ones), so such listings are
+// never trusted and the directory is listed again.
+#define DIR_MTIME_SLACK 2
+
+typedef enum {
+    DIR_CHILD_FILE,
+    DIR_CHILD_DIR
+} DirChildType;
+
+typedef struct {
+    uint64_t name_off;       // into the name pool
+    uint64_t size;           // files only
+    int64_t mtime;
+    uint32_t type;           // DirChildType
+    uint32_t reserved;
+} DirChild;
+
+typedef struct {
+    uint64_t path_hash;
+    uint64_t rel_off;        // into the name pool, "" for the root
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    int64_t out_mtime_sec;   // the output directory mirroring it
+    int64_t out_mtime_nsec;
+    int64_t listed_at;
+    uint64_t first_child;
+    uint64_t child_count;
+} DirRecord;
+
+typedef struct {
+    const char* base;
+    size_t size;
+    const DirRecord* records;
+    size_t count;
+    const uint32_t* slots;   // open addressing, record index + 1, 0 = empty
+    size_t slot_mask;
+    const DirChild* children;
+    size_t child_count;
+    const char* names;
+    size_t names_size;
+} DirSnapshot;
+
+// A directory listed this run, with its children and names in one block.
+typedef struct DirUpdate {
+    struct DirUpdate* next;
+    DirRecord record;        // offsets are into this update's names
+    DirChild* children;
+    char* names;
+    size_t names_size;
+} DirUpdate;
+
+typedef struct {
+    DirSnapshot snapshot;
+    uint8_t* replayed;       // per snapshot record: reused this run
+    pthread_mutex_t lock;
+    DirUpdate* updates;
+    size_t listed;
+    size_t skipped;
+} DirCache;
+
+int dir_cache_load(DirCache* cache, const char* path);
+void dir_cache_free(DirCache* cache);
+
+// The last listing of rel, if in and out, the directory and its output
+// mirror, still have the mtimes it was taken with.
+const DirRecord* dir_cache_fresh(DirCache* cache, const char* rel, size_t rel_len,
+                                 const struct stat* in, const struct stat* out);
+const DirChild* dir_record_children(const DirCache* cache, const DirRecord* rec);
+const char* dir_child_name(const DirCache* cache, const DirChild* child);
+
+// Collects one directory's listing while it is being read.
+typedef struct {
+    DirChild* children;
+    size_t count;
+    size_t capacity;
+    char* names;
+    size_t names_size;
+    size_t names_capacity;
+} DirListing;
+
+void dir_listing_add(DirListing* listing, const char* name, size_t name_len,
+                     DirChildType type, uint64_t size, int64_t mtime);
+// Hands the listing to cache, which takes its memory.
+void dir_cache_store(DirCache* cache, const char* rel, size_t rel_len,
+                     const struct stat* in, const struct stat* out, DirListing* listing);
+
+// Writes the directories seen this run, if any had to be listed.
+int dir_cache_save(const DirCache* cache, const char* path);
+
+#endif
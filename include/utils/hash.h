@@ -0,0 +1,41 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Content and path hashing. The hash reads 64-byte stripes as eight
+// independent 64-bit lanes (multiply-accumulate, as in XXH3), so it runs
+// on AVX2 or NEON where available and as plain C elsewhere. Every code
+// path produces the same value.
+//
+// The cache records which algorithm its hashes came from; bump the ID
+// whenever the output of these functions changes.
+typedef enum {
+    HASH_ALGO_FNV1A = 0,       // byte-at-a-time FNV-1a, caches before this field
+    HASH_ALGO_STRIPE64 = 1,
+} HashAlgo;
+
+#define HASH_ALGO_CURRENT HASH_ALGO_STRIPE64
+
+#define HASH_STRIPE 64
+#define HASH_LANES 8
+
+// Incremental form for data that arrives in pieces: feeding consecutive
+// pieces gives the same value as hash_from_memory over their concatenation.
+typedef struct {
+    uint64_t acc[HASH_LANES];
+    unsigned char buffer[HASH_STRIPE];
+    size_t buffered;
+    uint64_t stripes;
+    uint64_t total;
+} HashState;
+
+void hash_init(HashState* state);
+void hash_feed(HashState* state, const void* data, size_t size);
+uint64_t hash_final(const HashState* state);
+
+uint64_t hash_from_memory(const char* data, size_t size);
+uint64_t file_hash(const char* path);
+
+#endif
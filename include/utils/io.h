@@ -2,17 +2,41 @@
 #define IO_H
 
 #include <stddef.h>
+#include <sys/uio.h>
+#include "utils/uring.h"
 
 #define BATCH_SIZE 64
+#define PAGE_MAX_SLICES 8      // most slices batch_add accepts for one page
 
 typedef struct {
-    char* contents[BATCH_SIZE];
+    size_t submitted;     // io_uring operations submitted
+    size_t completed;     // io_uring completions reaped
+    size_t sync_writes;   // pages written with blocking open/write/close
+    size_t errors;        // pages that could not be written at all
+} WriteStats;
+
+// The batch only references path and slices; the slice array and every
+// byte it points at must stay alive until batch_wait (or batch_flush)
+// returns. done then says which pages reached their files in full, until
+// the next batch_add.
+typedef struct {
+    const struct iovec* slices[BATCH_SIZE];
+    int slice_counts[BATCH_SIZE];
     const char* paths[BATCH_SIZE];
-    size_t sizes[BATCH_SIZE];
+    size_t sizes[BATCH_SIZE];   // total bytes across a page's slices
+    unsigned char done[BATCH_SIZE];
     int count;
+    int in_flight;        // io_uring operations not yet reaped
+    IoRing* ring;         // NULL: synchronous writes
+    WriteStats stats;
 } WriteBatch;
 
-void batch_add(WriteBatch* batch, const char* path, const char* content, size_t size);
+int batch_use_uring(WriteBatch* batch);
+void batch_release(WriteBatch* batch);
+
+void batch_add(WriteBatch* batch, const char* path, const struct iovec* slices, int count);
+void batch_submit(WriteBatch* batch);
+void batch_wait(WriteBatch* batch);
 void batch_flush(WriteBatch* batch);
 
-#endif
\ No newline at end of file
+#endif
@@ -1,7 +1,11 @@
 #ifndef PATH_H
 #define PATH_H
 
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
 #include <sys/stat.h>
+#include "utils/dircache.h"
 
 #ifndef PATH_MAX
 #define PATH_MAX 4096
@@ -12,6 +16,53 @@ const char* get_filename(const char* path);
 void mkpath(const char* path, mode_t mode);
 void create_directory(const char* path);
 const char* dirname(const char* path);
-void copy_directory_structure(const char* input_dir, const char* output_dir);
+
+// Single-pass parallel walk of the input tree. Any number of threads call
+// walk_step; each call lists one directory relative to its parent's fd,
+// mirrors its subdirectories under the output root and reports matching
+// files through on_file. d_type decides what an entry is, so only the
+// matching files (and entries of unknown type) are stat'ed.
+//
+// With a DirCache, a directory whose mtime and output mirror's mtime are
+// what its last listing saw is not read at all: its subdirectories and
+// files come from that listing, and its files are reported with
+// output_known set, since nothing has been removed from the mirror.
+typedef void (*WalkFileFn)(void* ctx, const char* path, uint64_t size, time_t mtime,
+                           int output_known);
+
+typedef enum {
+    WALK_IDLE,       // nothing to list right now
+    WALK_PROGRESS,   // listed a directory
+    WALK_FINISHED    // listed the last directory of the tree
+} WalkStatus;
+
+typedef struct {
+    int fd;          // open directory, or -1 to reopen from the root
+    char* rel;       // path below the roots, "" for the roots themselves
+    size_t rel_len;
+} DirTask;
+
+typedef struct {
+    pthread_mutex_t lock;
+    DirTask* tasks;
+    size_t task_count;
+    size_t task_capacity;
+    size_t pending;          // queued plus in-progress directories
+    int open_fds;
+    int in_root_fd;
+    int out_root_fd;
+    const char* input_dir;
+    size_t input_len;
+    const char* extension;
+    size_t extension_len;
+    WalkFileFn on_file;
+    DirCache* dirs;          // optional, set after walk_init
+    size_t dir_count;
+} DirWalk;
+
+int walk_init(DirWalk* walk, const char* input_dir, const char* output_dir,
+              const char* extension, WalkFileFn on_file);
+WalkStatus walk_step(DirWalk* walk, void* ctx);
+void walk_free(DirWalk* walk);
 
 #endif
@@ -0,0 +1,50 @@
+#ifndef QUEUE_H
+#define QUEUE_H
+
+#include <stddef.h>
+#include <pthread.h>
+
+// Fixed-capacity FIFO of fixed-size elements shared between pipeline
+// stages. Producers block while it is full, consumers while it is empty;
+// once closed, consumers drain what is left and then see 0.
+//
+// An ordered queue is a binary heap instead: pops return the element that
+// comes first by before(a, b), however late it was pushed.
+typedef int (*QueueOrder)(const void* a, const void* b);
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    char* slots;
+    size_t elem_size;
+    size_t capacity;
+    size_t head;
+    size_t count;
+    QueueOrder before;     // NULL: FIFO
+    unsigned wakeups;      // queue_wake calls so far
+    int closed;
+} BoundedQueue;
+
+void queue_init(BoundedQueue* q, size_t capacity, size_t elem_size);
+void queue_init_ordered(BoundedQueue* q, size_t capacity, size_t elem_size, QueueOrder before);
+void queue_destroy(BoundedQueue* q);
+void queue_close(BoundedQueue* q);
+
+void queue_push(BoundedQueue* q, const void* elem);
+int queue_try_push(BoundedQueue* q, const void* elem);
+int queue_pop(BoundedQueue* q, void* elem);
+int queue_try_pop(BoundedQueue* q, void* elem);
+size_t queue_try_pop_batch(BoundedQueue* q, void* elems, size_t max);
+
+// For consumers that have other work to look for, such as directories to
+// list: read queue_wakeups, look, and if nothing turned up call queue_wait
+// with what was read. It returns once there is something to pop, the queue
+// is closed, or queue_wake has been called since, so a wake that comes
+// between the look and the wait is not lost. Returns 0 only once the queue
+// is closed and drained.
+unsigned queue_wakeups(BoundedQueue* q);
+void queue_wake(BoundedQueue* q);
+int queue_wait(BoundedQueue* q, unsigned seen);
+
+#endif
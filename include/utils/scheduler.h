@@ -0,0 +1,49 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdalign.h>
+#include <time.h>
+#include <omp.h>
+
+#define SCHED_CACHE_LINE 64
+
+typedef struct {
+    const char* path;
+    uint64_t size;
+    time_t mtime;
+    uint64_t cost;      /* estimated build time in nanoseconds */
+    int output_known;   /* replayed from an unchanged directory listing */
+} WorkItem;
+
+/* One deque per worker. The owner pops from the head (most expensive
+ * pending item), thieves take from the tail. Padded to a cache line so
+ * workers never false-share each other's counters. */
+typedef struct {
+    alignas(SCHED_CACHE_LINE) omp_lock_t lock;
+    WorkItem* items;
+    size_t head;
+    size_t tail;
+    size_t capacity;
+    double busy_time;
+    size_t completed;
+    size_t steals;
+} WorkerQueue;
+
+typedef struct {
+    WorkerQueue* queues;
+    int worker_count;
+} WorkScheduler;
+
+int scheduler_default_workers(void);
+void scheduler_init(WorkScheduler* sched, int workers);
+void scheduler_free(WorkScheduler* sched);
+
+/* Longest first: nonzero when a's estimated cost is above b's. */
+int scheduler_costlier(const void* a, const void* b);
+void scheduler_push(WorkScheduler* sched, int worker, const WorkItem* items, size_t count);
+int scheduler_next(WorkScheduler* sched, int worker, WorkItem* out);
+void scheduler_account(WorkScheduler* sched, int worker, double elapsed);
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef URING_H
+#define URING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Minimal io_uring binding on the raw syscalls, so the write backend needs
+// no liburing. Built only where <linux/io_uring.h> is new enough to have
+// direct descriptors (file_index); elsewhere ring_init always fails and
+// callers keep their synchronous path.
+#if defined(__linux__) && !defined(CSSG_NO_URING) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#ifdef IORING_FILE_INDEX_ALLOC
+#define CSSG_HAVE_URING 1
+#endif
+#endif
+#endif
+
+#ifdef CSSG_HAVE_URING
+
+typedef struct {
+    int fd;
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    struct io_uring_sqe* sqes;
+    struct io_uring_cqe* cqes;
+    void* sq_ring;
+    size_t sq_ring_size;
+    void* cq_ring;
+    size_t cq_ring_size;
+    size_t sqes_size;
+    unsigned sq_entries;
+    unsigned prepared;     // filled in but not yet published
+    unsigned pending;      // published but not yet taken by the kernel
+} IoRing;
+
+struct io_uring_sqe* ring_get_sqe(IoRing* ring);
+// Blocks until a completion is available, submitting nothing.
+int ring_wait(IoRing* ring);
+struct io_uring_cqe* ring_peek_cqe(IoRing* ring);
+void ring_cqe_seen(IoRing* ring);
+int ring_update_files(IoRing* ring, unsigned offset, const int* fds, unsigned count);
+
+#else
+
+typedef struct {
+    int fd;
+} IoRing;
+
+#endif
+
+int ring_init(IoRing* ring, unsigned entries, unsigned fixed_files);
+void ring_exit(IoRing* ring);
+int ring_submit(IoRing* ring, unsigned wait_nr);
+
+#endif
@@ -10,7 +10,7 @@ typedef struct {
 } FileVector;
 
 void vec_init(FileVector* vec);
-void vec_push(FileVector* vec, const char* item);
+const char* vec_push(FileVector* vec, const char* item);
 void vec_free(FileVector* vec);
 
 #endif
@@ -1,5 +1,4 @@
 #include <stdio.h>
-#include <dirent.h>
 #include <sys/stat.h>
 #include <string.h>
 #include <stdlib.h>
@@ -10,58 +9,125 @@
 
 #include "arena.h"
 #include "parser/markdown.h"
+#include "parser/template.h"
 #include "utils/cache.h"
 #include "utils/vector.h"
 #include "utils/path.h"
 #include "utils/mmap.h"
 #include "utils/io.h"
-#include "utils/simd.h"
+#include "utils/scheduler.h"
+#include "utils/queue.h"
 #include "parser/mlinyaml.h"
 
 #define TEMPLATE_PATH "templates/default.html"
 char *template_path = "templates/default.html";
 #define CACHE_FILE ".cssg_cache"
+#define BLOCK_CACHE_FILE ".cssg_blocks"
+#define DIR_CACHE_FILE ".cssg_dirs"
+#define BLOCK_CACHE_BUDGET ((size_t)256 << 20)   // HTML kept for pages not rebuilt
+
+// Part of every page's dependency hash: bump it whenever the same source,
+// template and config would render to different bytes.
+#define GENERATOR_VERSION 1
+
+#define PAGE_ARENA_SIZE (512 * 1024)
+#define DISCOVER_QUEUE_DEPTH 4096
+#define DISCOVER_BATCH 8        // pages a worker takes from the discovered heap at once
+
+// Pages pick a template from the registry; the template key is for
+// pages none of it covers, and is only loaded when set or needed.
+static TemplateRegistry templates;
+static Template page_template;
+static const Template* fallback_template;
+
+// What every page depends on besides its source and template.
+static uint64_t site_hash;
+
+// A rendered page travelling from a render worker to the writer. The pool
+// of these is the only per-page memory, so its size bounds the pipeline.
+// The page is never assembled: slices point at the compiled template and at
+// this page's arena, and go to the kernel as one vectored write. Its cache
+// record is journaled once that write is done; the record's strings are
+// borrowed from the page's arena and the file list.
+typedef struct {
+    Arena arena;
+    CacheEntry record;
+    struct iovec slices[PAGE_MAX_SLICES];
+    int slice_count;
+} PageBuffer;
+
+typedef struct BuildPipeline BuildPipeline;
 
 typedef struct {
-    const char* head;
-    size_t head_len;
-    const char* middle;
-    size_t middle_len;
-    const char* tail;
-    size_t tail_len;
-} TemplateParts;
-
-static TemplateParts template_parts;
-
-static void collect_markdown_files(const char* input_dir, FileVector* files);
-static void process_files_parallel(FileVector* files, const char* output_dir, 
-                                  BuildCache* global_cache, BuildMetrics* metrics,
-                                  const char* input_base);
-static void process_file(Arena* process_arena,
-                        const char* input_path, const char* output_path,
-                        BuildCache* cache, WriteBatch* batch);
-char* render_template(Arena* arena, const FrontMatter* fm, const char* content);
+    BuildPipeline* pipeline;
+    int worker;
+    BuildCache cache;
+    BlockMemo blocks;
+    size_t built;
+    size_t unchanged;
+} RenderState;
+
+struct BuildPipeline {
+    const char* input_dir;
+    const char* output_dir;
+    FileVector* files;
+    BuildCache* global_cache;
+    BlockMemo* blocks;         // merged from every worker's memo at the end
+    BuildMetrics* metrics;
+    const CacheSnapshot* snapshot;   // cache as loaded, read-only
+    CacheJournal* journal;     // records of pages as they are written
+    WorkScheduler sched;
+    BoundedQueue discovered;   // WorkItem, walker -> render workers, costliest first
+    BoundedQueue rendered;     // PageBuffer*, render workers -> writer
+    BoundedQueue free_pages;   // PageBuffer*, writer -> render workers
+    DirWalk walk;
+    uint64_t known_ns;         // build time of discovered pages with history
+    uint64_t known_bytes;      // and their size, to cost pages without it
+    PageBuffer* pages;
+    size_t page_count;
+    int active_renderers;
+    int has_writer;
+    double start;
+};
+
+static void on_markdown_file(void* ctx, const char* path, uint64_t size, time_t mtime,
+                             int output_known);
+static void run_build_pipeline(FileVector* files, const char* input_dir, const char* output_dir,
+                               const CacheSnapshot* snapshot, CacheJournal* journal,
+                               BuildCache* global_cache, BlockMemo* blocks, DirCache* dirs,
+                               BuildMetrics* metrics, int workers, double start);
+static void estimate_cost(BuildPipeline* p, WorkItem* item);
+static void render_item(BuildPipeline* p, RenderState* rs, const WorkItem* item);
+static uint64_t page_deps(void* ctx, const char* in_path, const char* layout);
+static int process_file(PageBuffer* page, const WorkItem* item,
+                        const char* input_base, const char* output_dir, BlockMemo* blocks);
 static void log_metrics(const BuildMetrics* metrics);
-static void load_template(void);
-static void unload_template(void);
-static char* generate_output_path(const char* base, const char* input, const char* output_dir);
-static void ensure_directory_exists(const char* filepath);
-
-static MappedFile global_template = {0};
-static BuildCache thread_cache;
-#pragma omp threadprivate(thread_cache)
+static char* generate_output_path(Arena* arena, const char* base, const char* input, const char* output_dir);
 
 
 
 int main(int argc, char** argv) {
-    if (argc < 2) {
-        fprintf(stderr, "Usage: %s <config-file>\n", argv[0]);
+    const char* config_path = NULL;
+    int threads = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (strncmp(argv[i], "-j", 2) == 0 && argv[i][2]) {
+            threads = atoi(argv[i] + 2);
+        } else {
+            config_path = argv[i];
+        }
+    }
+
+    if (!config_path) {
+        fprintf(stderr, "Usage: %s [-j threads] <config-file>\n", argv[0]);
         return 1;
     }
 
 
     YamlConfig config = {0};
-    if (parse_yaml(argv[1], &config) != 0) {
+    if (parse_yaml(config_path, &config) != 0) {
         fprintf(stderr, "Error parsing config file\n");
         return 1;
     }
@@ -70,245 +136,567 @@ int main(int argc, char** argv) {
         template_path = (char*)config.tmpl;
     }
 
-    load_template();
-    
+    if (config.template_dir && !template_registry_load(&templates, config.template_dir)) {
+        fprintf(stderr, "Error loading templates\n");
+        return 1;
+    }
+    if (config.tmpl || !template_registry_find(&templates, "default", 7)) {
+        if (!template_compile(&page_template, template_path)) {
+            fprintf(stderr, "Error loading template\n");
+            return 1;
+        }
+        fallback_template = &page_template;
+    }
+
+    HashState site;
+    uint32_t versions[2] = { GENERATOR_VERSION, BLOCK_CACHE_RENDERER };
+    hash_init(&site);
+    hash_feed(&site, versions, sizeof(versions));
+    hash_feed(&site, config.output_dir, strlen(config.output_dir) + 1);
+    site_hash = hash_final(&site);
 
-    omp_set_num_threads(4); // Optimized for M1 Pro performance
+    // -j wins over the config file; otherwise use every core we have.
+    if (threads <= 0) threads = config.threads;
+    if (threads <= 0) threads = scheduler_default_workers();
 
     Arena arena;
-    BuildCache global_cache = NULL;
+    BuildCache global_cache = NULL;   // pages rebuilt this run
+    CacheSnapshot snapshot;
+    CacheJournal journal;
+    BlockSnapshot block_snapshot;
+    BlockMemo blocks = { .snapshot = &block_snapshot };
+    DirCache dirs;
     FileVector files;
     BuildMetrics metrics = {0};
 
     arena_init(&arena, 4 * 1024 * 1024); // 4MB arena
     vec_init(&files);
 
-    cache_load(&global_cache, CACHE_FILE);
-    collect_markdown_files(config.input_dir, &files);
+    double start = omp_get_wtime();
+    cache_load(&snapshot, CACHE_FILE);
+    cache_journal_open(&journal, CACHE_FILE, &snapshot);
+    block_cache_load(&block_snapshot, BLOCK_CACHE_FILE);
+    // Listings kept while the option was off could hide edits made since.
+    if (config.trust_dir_mtimes) {
+        dir_cache_load(&dirs, DIR_CACHE_FILE);
+    } else {
+        unlink(DIR_CACHE_FILE);
+    }
     create_directory(config.output_dir); 
-    copy_directory_structure(config.input_dir, config.output_dir);
-
-    clock_t start = clock();
-    process_files_parallel(&files, config.output_dir, &global_cache, &metrics, config.input_dir);
+    run_build_pipeline(&files, config.input_dir, config.output_dir,
+                       &snapshot, &journal, &global_cache, &blocks,
+                       config.trust_dir_mtimes ? &dirs : NULL, &metrics, threads, start);
 
-    metrics.total_time = (double)(clock() - start) / CLOCKS_PER_SEC;
+    metrics.total_time = omp_get_wtime() - start;
 
     metrics.total_files = files.count;
+    metrics.block_hits = blocks.hits;
+    metrics.block_misses = blocks.misses;
     log_metrics(&metrics);
 
-    cache_purge_missing(&global_cache);
-    cache_save(&global_cache, CACHE_FILE);
+    // Pages are already journaled; only fold the journal into the cache
+    // file once it has grown, or if it could not be kept.
+    int journaled = cache_journal_close(&journal);
+    if ((!journaled || cache_journal_should_compact(&journal, &snapshot)) &&
+        !cache_save(&global_cache, &snapshot, CACHE_FILE)) {
+        fprintf(stderr, "Cannot save cache: %s\n", CACHE_FILE);
+    }
+    // Only new fragments change the file; a run that reused them all
+    // leaves it as it is.
+    if (blocks.misses) block_cache_save(&blocks, &block_snapshot, BLOCK_CACHE_FILE, BLOCK_CACHE_BUDGET);
+    if (config.trust_dir_mtimes) {
+        dir_cache_save(&dirs, DIR_CACHE_FILE);
+        dir_cache_free(&dirs);
+    }
     
 
     vec_free(&files);
+    free(metrics.workers);
     cache_free(&global_cache);
+    cache_snapshot_free(&snapshot);
+    block_memo_free(&blocks);
+    block_snapshot_free(&block_snapshot);
     arena_free(&arena);
-    unload_template();
+    template_free(&page_template);
+    template_registry_free(&templates);
     return 0;
 }
 
 
-static void load_template() {
-    global_template = mmap_file(template_path);
-    if (global_template.data) {
-        char* copy = malloc(global_template.size + 1);
-        memcpy(copy, global_template.data, global_template.size);
-        copy[global_template.size] = '\0';
-        global_template.data = copy;
+// Hands a discovered page to the render workers. When they are behind and
+// the queue is full, the walker renders the costliest page itself instead
+// of blocking, which also keeps single-threaded runs from deadlocking.
+static void discover_push(BuildPipeline* p, RenderState* rs, const WorkItem* item) {
+    while (!queue_try_push(&p->discovered, item)) {
+        WorkItem pending;
+        if (queue_try_pop(&p->discovered, &pending)) {
+            render_item(p, rs, &pending);
+        }
     }
+}
 
-    char* title_start = simd_strstr((char*)global_template.data, "{{title}}");
-    char* content_start = simd_strstr(title_start + 9, "{{content}}");
-    
-    template_parts.head = global_template.data;
-    template_parts.head_len = title_start - global_template.data;
-    
-    template_parts.middle = title_start + 9;
-    template_parts.middle_len = content_start - template_parts.middle;
-    
-    template_parts.tail = content_start + 11;
-    template_parts.tail_len = global_template.size - (content_start - global_template.data) - 11;
+// Called by whichever thread listed the file's directory.
+static void on_markdown_file(void* ctx, const char* path, uint64_t size, time_t mtime,
+                             int output_known) {
+    RenderState* rs = ctx;
+    BuildPipeline* p = rs->pipeline;
+    const char* stored;
+
+    #pragma omp critical(FileList)
+    stored = vec_push(p->files, path);
 
+    WorkItem item = { .path = stored, .size = size, .mtime = mtime, .output_known = output_known };
+    estimate_cost(p, &item);
+    discover_push(p, rs, &item);
 }
 
-static void unload_template() {
-    if (global_template.data) {
-        free((void*)global_template.data);
-        global_template.data = NULL;
+
+// Pages with build history are costed by their last build time. The rest
+// are scaled by the ns/byte observed across the pages discovered so far,
+// so both kinds order on the same axis.
+static void estimate_cost(BuildPipeline* p, WorkItem* item) {
+    const CacheRecord* entry = cache_snapshot_find(p->snapshot, item->path);
+
+    if (entry && entry->build_ns) {
+        item->cost = entry->build_ns;
+        #pragma omp atomic
+        p->known_ns += entry->build_ns;
+        #pragma omp atomic
+        p->known_bytes += item->size;
+        return;
     }
+
+    uint64_t known_ns, known_bytes;
+    #pragma omp atomic read
+    known_ns = p->known_ns;
+    #pragma omp atomic read
+    known_bytes = p->known_bytes;
+
+    double ns_per_byte = known_bytes ? (double)known_ns / known_bytes : 1.0;
+    item->cost = (uint64_t)(item->size * ns_per_byte) + 1;
 }
 
-static void collect_markdown_files(const char* input_dir, FileVector* files) {
-    DIR* dir = opendir(input_dir);
-    if (!dir) return;
+// Records a page whose output is on disk, in cache and in the journal. A
+// page whose write failed is left out, so the next build retries it.
+static void record_page(BuildPipeline* p, BuildCache* cache, const CacheEntry* rec) {
+    cache_update_entry(cache, rec->input_path, rec->output_path, rec->last_modified,
+                       rec->content_hash, rec->output_hash, rec->build_ns,
+                       rec->layout, rec->deps_hash);
+    cache_journal_append(p->journal, rec);
+}
 
-    struct dirent* entry;
-    while ((entry = readdir(dir)) != NULL) {
-        if (entry->d_name[0] == '.') continue;
+static void submit_page(BuildPipeline* p, RenderState* rs, PageBuffer* page) {
+    if (p->has_writer) {
+        queue_push(&p->rendered, &page);
+        return;
+    }
 
-        char path[PATH_MAX];
-        snprintf(path, sizeof(path), "%s/%s", input_dir, entry->d_name);
+    // No spare thread for a writer: write in place and recycle at once.
+    WriteBatch batch = {0};
+    batch_add(&batch, page->record.output_path, page->slices, page->slice_count);
+    batch_flush(&batch);
+    if (batch.done[0]) record_page(p, &rs->cache, &page->record);
+    p->metrics->sync_writes += batch.stats.sync_writes;
+    p->metrics->write_errors += batch.stats.errors;
+    if (p->metrics->first_output_time == 0) {
+        p->metrics->first_output_time = omp_get_wtime() - p->start;
+    }
+    queue_push(&p->free_pages, &page);
+}
 
-        struct stat st;
-        if (lstat(path, &st) != 0) continue;
+// A rebuilt page whose bytes match what we last wrote, to a file that is
+// still there, is left alone so its mtime (and downstream syncs) stay put.
+static int output_unchanged(const BuildPipeline* p, const WorkItem* item, const PageBuffer* page) {
+    const CacheRecord* entry = cache_snapshot_find(p->snapshot, item->path);
+    return entry &&
+           entry->output_hash == page->record.output_hash &&
+           strcmp(cache_record_output(p->snapshot, entry), page->record.output_path) == 0 &&
+           access(page->record.output_path, F_OK) == 0;
+}
 
-        if (S_ISDIR(st.st_mode)) {
-            collect_markdown_files(path, files);
-        } else if (S_ISREG(st.st_mode)) {
-            const char* ext = strrchr(entry->d_name, '.');
-            if (ext && strcmp(ext, ".md") == 0) {
-                vec_push(files, path);
-            }
+static void render_item(BuildPipeline* p, RenderState* rs, const WorkItem* item) {
+    double item_start = omp_get_wtime();
+
+    if (needs_rebuild(item->path, item->mtime, item->output_known, p->snapshot, page_deps, p)) {
+        PageBuffer* page;
+        queue_pop(&p->free_pages, &page);
+        arena_reset(&page->arena);
+
+        if (!process_file(page, item, p->input_dir, p->output_dir, &rs->blocks)) {
+            queue_push(&p->free_pages, &page);
+        } else if (output_unchanged(p, item, page)) {
+            record_page(p, &rs->cache, &page->record);
+            queue_push(&p->free_pages, &page);
+            rs->built++;
+            rs->unchanged++;
+        } else {
+            submit_page(p, rs, page);
+            rs->built++;
         }
     }
-    closedir(dir);
+
+    scheduler_account(&p->sched, rs->worker, omp_get_wtime() - item_start);
 }
 
+// Pages are costed as they are found and wait in one heap, so a worker
+// that runs dry takes the costliest pages discovered so far, wherever in
+// the walk they turned up. Only the DISCOVER_BATCH pages each worker has
+// already taken go ahead of a long page found late. The heap's depth
+// bounds how far the walk runs ahead of rendering.
+static void render_stage(BuildPipeline* p, RenderState* rs) {
+    WorkItem batch[DISCOVER_BATCH];
+    WorkItem item;
+
+    for (;;) {
+        if (scheduler_next(&p->sched, rs->worker, &item)) {
+            render_item(p, rs, &item);
+            continue;
+        }
 
-char* render_template(Arena* arena, const FrontMatter* fm, const char* content) {
-    size_t title_len = fm->title ? strlen(fm->title) : 0;
-    size_t content_len = content ? strlen(content) : 0;
+        // Nothing to render or steal: help list directories while any are
+        // left, and wake idle workers to take the ones this listing queued.
+        unsigned seen = queue_wakeups(&p->discovered);
+        WalkStatus status = walk_step(&p->walk, rs);
+        if (status == WALK_FINISHED) queue_close(&p->discovered);
+        if (status == WALK_PROGRESS) queue_wake(&p->discovered);
+        if (status != WALK_IDLE) continue;
+
+        size_t n = queue_try_pop_batch(&p->discovered, batch, DISCOVER_BATCH);
+        if (n > 0) {
+            scheduler_push(&p->sched, rs->worker, batch, n);
+            continue;
+        }
 
-    size_t total_size = template_parts.head_len + title_len + 
-                       template_parts.middle_len + content_len + 
-                       template_parts.tail_len + 1;
-    
-    char* output = arena_alloc(arena, total_size);
-    char* ptr = output;
-    
-    memcpy(ptr, template_parts.head, template_parts.head_len);
-    ptr += template_parts.head_len;
-    
-    if (fm->title) {
-        memcpy(ptr, fm->title, title_len);
-        ptr += title_len;
+        // Sleep until a page is found, another listing finishes or the
+        // walk ends; then look again.
+        if (!queue_wait(&p->discovered, seen)) break;
     }
-    
-    memcpy(ptr, template_parts.middle, template_parts.middle_len);
-    ptr += template_parts.middle_len;
-    
-    if (content) {
-        memcpy(ptr, content, content_len);
-        ptr += content_len;
+}
+
+// Waits for a submitted batch, records the pages it wrote and hands them
+// all back to the renderers.
+static void retire_batch(BuildPipeline* p, BuildCache* written, WriteBatch* batch,
+                         PageBuffer** held, int* held_count) {
+    batch_wait(batch);
+    if (*held_count > 0 && p->metrics->first_output_time == 0) {
+        p->metrics->first_output_time = omp_get_wtime() - p->start;
     }
-    
-    memcpy(ptr, template_parts.tail, template_parts.tail_len);
-    ptr += template_parts.tail_len;
-    *ptr = '\0';
-    
-    return output;
+    for (int i = 0; i < *held_count; i++) {
+        if (batch->done[i]) record_page(p, written, &held[i]->record);
+        queue_push(&p->free_pages, &held[i]);
+    }
+    if (*held_count > 0) cache_journal_flush(p->journal);
+    *held_count = 0;
 }
 
+static void write_stage(BuildPipeline* p) {
+    // Two batches alternate: one is in flight in the kernel while the
+    // other fills with pages still arriving from the renderers.
+    WriteBatch batches[2] = {0};
+    PageBuffer* held[2][BATCH_SIZE];
+    int held_count[2] = {0, 0};
+    int cur = 0;
+    PageBuffer* page;
+    BuildCache written = NULL;
+
+    if (!batch_use_uring(&batches[0]) || !batch_use_uring(&batches[1])) {
+        batch_release(&batches[0]);
+    }
+    p->metrics->write_backend = batches[0].ring ? "io_uring" : "sync";
 
-static void process_files_parallel(FileVector* files, const char* output_dir,
-                                  BuildCache* global_cache, BuildMetrics* metrics,
-                                  const char* input_base) {
-    #pragma omp parallel
-    {
-        WriteBatch local_batch = {0};
-        Arena thread_arena;
-        BuildCache thread_cache = NULL; 
-        size_t local_built = 0;
-
-        arena_init(&thread_arena, 4 * 1024 * 1024);
-
-        #pragma omp for schedule(static, 100)
-        for (size_t i = 0; i < files->count; i++) {
-            const char* input_path = files->items[i];
-            
-            int should_rebuild = 0;
-            #pragma omp critical(CacheCheck)
-            {
-                should_rebuild = needs_rebuild(input_path, global_cache);
-            }
+    for (;;) {
+        int have_page = queue_try_pop(&p->rendered, &page);
 
-            if (should_rebuild) {
-                char* output_path = generate_output_path(input_base, input_path, output_dir);
-                ensure_directory_exists(output_path);
+        if (held_count[cur] == BATCH_SIZE) {
+            batch_submit(&batches[cur]);
+            cur ^= 1;
+            retire_batch(p, &written, &batches[cur], held[cur], &held_count[cur]);
+        }
 
-                process_file(&thread_arena, input_path, output_path, &thread_cache, &local_batch);
-                local_built++;
+        // Renderers have nothing ready: push everything out rather than
+        // sit on pages while we sleep.
+        if (!have_page) {
+            batch_submit(&batches[cur]);
+            retire_batch(p, &written, &batches[cur], held[cur], &held_count[cur]);
+            retire_batch(p, &written, &batches[cur ^ 1], held[cur ^ 1], &held_count[cur ^ 1]);
+            if (!queue_pop(&p->rendered, &page)) break;
+        }
 
-                free(output_path);
-            }
+        batch_add(&batches[cur], page->record.output_path, page->slices, page->slice_count);
+        held[cur][held_count[cur]++] = page;
+    }
+
+    for (int i = 0; i < 2; i++) {
+        p->metrics->io_submitted += batches[i].stats.submitted;
+        p->metrics->io_completed += batches[i].stats.completed;
+        p->metrics->sync_writes += batches[i].stats.sync_writes;
+        p->metrics->write_errors += batches[i].stats.errors;
+        batch_release(&batches[i]);
+    }
+
+    #pragma omp critical(CacheUpdate)
+    {
+        CacheEntry *entry, *tmp;
+        HASH_ITER(hh, written, entry, tmp) {
+            cache_update_entry(p->global_cache,
+                             entry->input_path,
+                             entry->output_path,
+                             entry->last_modified,
+                             entry->content_hash,
+                             entry->output_hash,
+                             entry->build_ns,
+                             entry->layout,
+                             entry->deps_hash);
         }
-        
-        batch_flush(&local_batch);
+    }
+    cache_free(&written);
+}
 
-        #pragma omp atomic
-        metrics->built_files += local_built;
+static void run_build_pipeline(FileVector* files, const char* input_dir, const char* output_dir,
+                               const CacheSnapshot* snapshot, CacheJournal* journal,
+                               BuildCache* global_cache, BlockMemo* blocks, DirCache* dirs,
+                               BuildMetrics* metrics, int workers, double start) {
+    BuildPipeline p = {
+        .input_dir = input_dir,
+        .output_dir = output_dir,
+        .files = files,
+        .snapshot = snapshot,
+        .journal = journal,
+        .global_cache = global_cache,
+        .blocks = blocks,
+        .metrics = metrics,
+        .start = start,
+    };
+
+    scheduler_init(&p.sched, workers);
+
+    // Enough pages for every worker to have one in flight and one queued,
+    // plus the two batches the writer can hold.
+    p.page_count = (size_t)workers * 2 + BATCH_SIZE * 2;
+    p.pages = calloc(p.page_count, sizeof(PageBuffer));
+    queue_init_ordered(&p.discovered, DISCOVER_QUEUE_DEPTH, sizeof(WorkItem), scheduler_costlier);
+    queue_init(&p.rendered, p.page_count, sizeof(PageBuffer*));
+    queue_init(&p.free_pages, p.page_count, sizeof(PageBuffer*));
+    for (size_t i = 0; i < p.page_count; i++) {
+        PageBuffer* page = &p.pages[i];
+        arena_init(&page->arena, PAGE_ARENA_SIZE);
+        queue_push(&p.free_pages, &page);
+    }
+
+    if (!walk_init(&p.walk, input_dir, output_dir, ".md", on_markdown_file)) {
+        fprintf(stderr, "Cannot open input or output directory: %s, %s\n", input_dir, output_dir);
+        queue_close(&p.discovered);
+    }
+    p.walk.dirs = dirs;
+
+    omp_set_dynamic(0);
+
+    // The last thread is the writer. Everyone else renders, and lists
+    // directories whenever they have nothing to render.
+    #pragma omp parallel num_threads(workers + 1)
+    {
+        int team = omp_get_num_threads();
+        int tid = omp_get_thread_num();
 
-        #pragma omp critical(CacheUpdate)
+        #pragma omp single
         {
-            CacheEntry *entry, *tmp;
-            HASH_ITER(hh, thread_cache, entry, tmp) {
-                cache_update_entry(global_cache,
-                                 entry->input_path,
-                                 entry->output_path,
-                                 entry->last_modified,
-                                 entry->content_hash);
+            p.has_writer = team > 1;
+            p.active_renderers = p.has_writer ? team - 1 : 1;
+        }
+
+        if (p.has_writer && tid == team - 1) {
+            write_stage(&p);
+        } else {
+            RenderState rs = {
+                .pipeline = &p,
+                .worker = tid % p.sched.worker_count,
+                .blocks = { .snapshot = blocks->snapshot },
+            };
+
+            render_stage(&p, &rs);
+
+            #pragma omp atomic
+            metrics->built_files += rs.built;
+            #pragma omp atomic
+            metrics->skipped_writes += rs.unchanged;
+
+            #pragma omp critical(CacheUpdate)
+            {
+                CacheEntry *entry, *tmp;
+                HASH_ITER(hh, rs.cache, entry, tmp) {
+                    cache_update_entry(global_cache,
+                                     entry->input_path,
+                                     entry->output_path,
+                                     entry->last_modified,
+                                     entry->content_hash,
+                                     entry->output_hash,
+                                     entry->build_ns,
+                                     entry->layout,
+                                     entry->deps_hash);
+                }
+                block_memo_merge(blocks, &rs.blocks);
             }
+            cache_free(&rs.cache);
+
+            int remaining;
+            #pragma omp atomic capture
+            remaining = --p.active_renderers;
+            if (remaining == 0) queue_close(&p.rendered);
         }
+    }
+
+    metrics->worker_count = p.sched.worker_count;
+    metrics->workers = calloc(p.sched.worker_count, sizeof(WorkerStats));
+    for (int i = 0; i < p.sched.worker_count; i++) {
+        metrics->workers[i].busy_time = p.sched.queues[i].busy_time;
+        metrics->workers[i].files = p.sched.queues[i].completed;
+        metrics->workers[i].steals = p.sched.queues[i].steals;
+    }
+
+    metrics->directories = p.walk.dir_count;
+    metrics->directories_replayed = dirs ? dirs->skipped : 0;
 
-        arena_free(&thread_arena);
-        cache_free(&thread_cache);
+    for (size_t i = 0; i < p.page_count; i++) {
+        arena_free(&p.pages[i].arena);
     }
+    walk_free(&p.walk);
+    free(p.pages);
+    queue_destroy(&p.discovered);
+    queue_destroy(&p.rendered);
+    queue_destroy(&p.free_pages);
+    scheduler_free(&p.sched);
 }
 
-static char* generate_output_path(const char* base, const char* input, const char* output_dir) {
+// The page's path below the input directory.
+static const char* page_rel_path(const char* base, const char* input) {
     const char* rel_path = input + strlen(base);
     if (*rel_path == '/') rel_path++;
+    return rel_path;
+}
+
+static uint64_t deps_hash_of(const Template* tpl) {
+    uint64_t parts[2] = { site_hash, tpl->hash };
+    return hash_from_memory((const char*)parts, sizeof(parts));
+}
+
+// The dependency hash a page with this layout would be built with now.
+static uint64_t page_deps(void* ctx, const char* in_path, const char* layout) {
+    const BuildPipeline* p = ctx;
+    FrontMatterSpan span = { layout, strlen(layout) };
+    return deps_hash_of(template_select(&templates, span, page_rel_path(p->input_dir, in_path),
+                                        fallback_template));
+}
+
+static char* generate_output_path(Arena* arena, const char* base, const char* input, const char* output_dir) {
+    const char* rel_path = page_rel_path(base, input);
     
-    char* copy = strdup(rel_path);
-    char* dot = strrchr(copy, '.');
-    if (dot && strcmp(dot, ".md") == 0) {
-        *dot = '\0';
+    size_t rel_len = strlen(rel_path);
+    if (rel_len >= 3 && strcmp(rel_path + rel_len - 3, ".md") == 0) {
+        rel_len -= 3;
     }
     
-    char* path = malloc(PATH_MAX);
-    snprintf(path, PATH_MAX, "%s/%s.html", output_dir, copy);
-    free(copy);
+    size_t size = strlen(output_dir) + rel_len + sizeof("/.html");
+    char* path = arena_alloc(arena, size);
+    snprintf(path, size, "%s/%.*s.html", output_dir, (int)rel_len, rel_path);
     
     return path;
 }
 
-static void ensure_directory_exists(const char* filepath) {
-    char* dir = strdup(filepath);
-    char* slash = strrchr(dir, '/');
-    if (slash) {
-        *slash = '\0';
-        mkpath(dir, 0755);
-    }
-    free(dir);
-}
-
-static void process_file(Arena* process_arena, const char* input_path,
-                        const char* output_path, BuildCache* local_cache,
-                        WriteBatch* batch) {
+static int process_file(PageBuffer* page, const WorkItem* item,
+                        const char* input_base, const char* output_dir, BlockMemo* blocks) {
+    double started = omp_get_wtime();
+    const char* input_path = item->path;
     MappedFile input = mmap_file(input_path);
-    if (!input.data) return;
+    if (!input.data) return 0;
+
+    // The walk mirrored the output directory before reporting this page.
+    char* output_path = generate_output_path(&page->arena, input_base, input_path, output_dir);
 
     uint64_t content_hash = hash_from_memory(input.data, input.size);
-    MarkdownDoc doc = parse_markdown(process_arena, input.data, input.size);
+    MarkdownDoc doc = parse_markdown_memo(&page->arena, input.data, input.size, blocks);
+
+    const char* rel_path = page_rel_path(input_base, input_path);
+    FrontMatterSpan layout = doc.frontmatter.layout;
+    const Template* tpl = template_select(&templates, layout, rel_path, fallback_template);
+    if (layout.len && !template_layout(&templates, layout)) {
+        fprintf(stderr, "%s: no layout named \"%.*s\"\n", rel_path, (int)layout.len, layout.data);
+    }
+
+    // The cache keeps the layout so a later build can tell which template
+    // this page would use without reading it.
+    char* layout_name = arena_alloc(&page->arena, layout.len + 1);
+    if (!layout_name) {
+        munmap_file(input);
+        return 0;
+    }
+    if (layout.len) memcpy(layout_name, layout.data, layout.len);
+    layout_name[layout.len] = '\0';
+
+    // Frontmatter spans point into the mapping: the template copies what
+    // it uses into the arena before the mapping goes.
+    int slice_count = template_render(tpl, &doc.frontmatter, doc.html, doc.html_len,
+                                      &page->arena, page->slices, PAGE_MAX_SLICES);
     munmap_file(input);
+    if (slice_count < 0) return 0;
 
-    char* html = render_template(process_arena, &doc.frontmatter, doc.html);
-    size_t html_len = strlen(html);
-    batch_add(batch, output_path, html, html_len);
+    page->slice_count = slice_count;
 
-    struct stat st;
-    if (stat(input_path, &st) == 0) {
-        // Add the build artifact to this thread's LOCAL cache.
-        cache_update_entry(local_cache, input_path, output_path, st.st_mtime, content_hash);
+    HashState output_hash;
+    hash_init(&output_hash);
+    for (int i = 0; i < page->slice_count; i++) {
+        hash_feed(&output_hash, page->slices[i].iov_base, page->slices[i].iov_len);
     }
+
+    CacheEntry* rec = &page->record;
+    rec->input_path = (char*)input_path;
+    rec->output_path = output_path;
+    rec->last_modified = item->mtime;
+    rec->content_hash = content_hash;
+    rec->output_hash = hash_final(&output_hash);
+    rec->build_ns = (uint64_t)((omp_get_wtime() - started) * 1e9);
+    rec->layout = layout_name;
+    rec->deps_hash = deps_hash_of(tpl);
+    return 1;
 }
 
 void log_metrics(const BuildMetrics* metrics) {
     printf("\nBuild Report:\n"
            "  Total files:   %zu\n"
+           "  Directories:   %zu\n"
            "  Rebuilt:       %zu\n"
+           "  First output:  %.2fms\n"
            "  Time elapsed:  %.2fms\n\n",
            metrics->total_files,
+           metrics->directories,
            metrics->built_files,
+           metrics->first_output_time * 1000,
            metrics->total_time * 1000);
+
+    printf("  Writes:        %s, %zu sync, %zu unchanged, %zu errors",
+           metrics->write_backend ? metrics->write_backend : "sync",
+           metrics->sync_writes, metrics->skipped_writes, metrics->write_errors);
+    if (metrics->io_submitted) {
+        printf(", %zu/%zu io_uring ops completed", metrics->io_completed, metrics->io_submitted);
+    }
+    printf("\n");
+
+    if (metrics->directories_replayed) {
+        printf("  Listings:      %zu/%zu directories unchanged\n",
+               metrics->directories_replayed, metrics->directories);
+    }
+
+    size_t blocks = metrics->block_hits + metrics->block_misses;
+    if (blocks) {
+        printf("  Blocks:        %zu/%zu reused (%.1f%%)\n",
+               metrics->block_hits, blocks, 100.0 * metrics->block_hits / blocks);
+    }
+    printf("\n");
+
+    for (int i = 0; i < metrics->worker_count; i++) {
+        const WorkerStats* w = &metrics->workers[i];
+        double busy = metrics->total_time > 0 ? w->busy_time / metrics->total_time * 100 : 0;
+        printf("  Worker %-3d     %5.1f%% busy, %zu files, %zu stolen\n",
+               i, busy, w->files, w->steals);
+    }
+    if (metrics->worker_count) printf("\n");
 }
\ No newline at end of file
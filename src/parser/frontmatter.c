@@ -0,0 +1,333 @@
+#define _GNU_SOURCE
+#include <string.h>
+#include "parser/frontmatter.h"
+
+#define FRONTMATTER_DELIMITER "---"
+
+static int is_blank(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static int is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static FrontMatterSpan span(const char* start, const char* end) {
+    while (start < end && is_blank(*start)) start++;
+    while (end > start && is_blank(end[-1])) end--;
+    return (FrontMatterSpan){ start, (size_t)(end - start) };
+}
+
+static int span_is(FrontMatterSpan s, const char* word) {
+    size_t n = strlen(word);
+    return s.len == n && memcmp(s.data, word, n) == 0;
+}
+
+static int span_is_nocase(FrontMatterSpan s, const char* word) {
+    size_t n = strlen(word);
+    if (s.len != n) return 0;
+    for (size_t i = 0; i < n; i++) {
+        if ((s.data[i] | 0x20) != word[i]) return 0;
+    }
+    return 1;
+}
+
+// Whether a line of only "---" (and trailing blanks) starts at line.
+static int is_delimiter(const char* line, const char* end) {
+    if (end - line < 3 || memcmp(line, FRONTMATTER_DELIMITER, 3) != 0) return 0;
+    const char* p = line + 3;
+    while (p < end && is_blank(*p)) p++;
+    return p == end || *p == '\n';
+}
+
+// Where a quoted value opening at p closes: '' is a quote inside single
+// quotes, \" one inside double quotes. NULL when it never does.
+static const char* closing_quote(const char* p, const char* end) {
+    char q = *p++;
+    for (; p < end; p++) {
+        if (q == '"' && *p == '\\') {
+            p++;
+        } else if (*p == q) {
+            if (q == '\'' && p + 1 < end && p[1] == '\'') p++;
+            else return p;
+        }
+    }
+    return NULL;
+}
+
+// A scalar as written, without its quotes.
+static FrontMatterSpan unquote(FrontMatterSpan s) {
+    if (s.len >= 2 && (s.data[0] == '"' || s.data[0] == '\'') && s.data[s.len - 1] == s.data[0]) {
+        return (FrontMatterSpan){ s.data + 1, s.len - 2 };
+    }
+    return s;
+}
+
+static int parse_int(FrontMatterSpan s, int64_t* out) {
+    size_t i = s.len && (s.data[0] == '-' || s.data[0] == '+');
+    if (i == s.len || s.len - i > 18) return 0;
+    int64_t n = 0;
+    for (size_t k = i; k < s.len; k++) {
+        if (!is_digit(s.data[k])) return 0;
+        n = n * 10 + (s.data[k] - '0');
+    }
+    *out = s.data[0] == '-' ? -n : n;
+    return 1;
+}
+
+static int digits(const char* p, int n) {
+    int v = 0;
+    for (int i = 0; i < n; i++) v = v * 10 + (p[i] - '0');
+    return v;
+}
+
+static int all_digits(const char* p, const char* end, int n) {
+    if (end - p < n) return 0;
+    for (int i = 0; i < n; i++) {
+        if (!is_digit(p[i])) return 0;
+    }
+    return 1;
+}
+
+// Days from 1970-01-01 to a proleptic Gregorian date.
+static int64_t days_from_civil(int64_t y, int m, int d) {
+    y -= m <= 2;
+    int64_t era = (y >= 0 ? y : y - 399) / 400;
+    int64_t yoe = y - era * 400;
+    int64_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+// YYYY-MM-DD, then optionally a T or space, HH:MM[:SS[.frac]], and Z or
+// an offset such as +02:00. A date alone is midnight UTC.
+static int parse_date(FrontMatterSpan s, int64_t* out) {
+    const char* p = s.data;
+    const char* end = s.data + s.len;
+    if (!all_digits(p, end, 4) || end - p < 10 || p[4] != '-' || p[7] != '-' ||
+        !all_digits(p + 5, end, 2) || !all_digits(p + 8, end, 2)) return 0;
+
+    int year = digits(p, 4), month = digits(p + 5, 2), day = digits(p + 8, 2);
+    if (month < 1 || month > 12 || day < 1 || day > 31) return 0;
+    int64_t seconds = days_from_civil(year, month, day) * 86400;
+    p += 10;
+
+    if (p < end && (*p == 'T' || *p == 't' || *p == ' ')) {
+        p++;
+        if (!all_digits(p, end, 2) || end - p < 5 || p[2] != ':' || !all_digits(p + 3, end, 2)) return 0;
+        seconds += digits(p, 2) * 3600 + digits(p + 3, 2) * 60;
+        p += 5;
+        if (p < end && *p == ':') {
+            if (!all_digits(p + 1, end, 2)) return 0;
+            seconds += digits(p + 1, 2);
+            p += 3;
+            if (p < end && *p == '.') {
+                do p++; while (p < end && is_digit(*p));
+            }
+        }
+        while (p < end && *p == ' ') p++;
+        if (p < end && (*p == 'Z' || *p == 'z')) {
+            p++;
+        } else if (p < end && (*p == '+' || *p == '-')) {
+            int sign = *p++ == '-' ? -1 : 1;
+            if (!all_digits(p, end, 2)) return 0;
+            int offset = digits(p, 2) * 3600;
+            p += 2;
+            if (p < end && *p == ':') p++;
+            if (all_digits(p, end, 2)) {
+                offset += digits(p, 2) * 60;
+                p += 2;
+            }
+            seconds -= sign * offset;
+        }
+    }
+    if (p != end) return 0;
+    *out = seconds;
+    return 1;
+}
+
+// Types a plain (unquoted) scalar.
+static void type_scalar(FrontMatterField* f) {
+    if (span_is_nocase(f->value, "true") || span_is_nocase(f->value, "yes")) {
+        f->type = FM_BOOL;
+        f->number = 1;
+    } else if (span_is_nocase(f->value, "false") || span_is_nocase(f->value, "no")) {
+        f->type = FM_BOOL;
+        f->number = 0;
+    } else if (parse_int(f->value, &f->number)) {
+        f->type = FM_NUMBER;
+    } else if (parse_date(f->value, &f->number)) {
+        f->type = FM_DATE;
+    }
+}
+
+// Splits "[a, 'b, c', d]" on the commas outside quotes. Returns 0 when
+// the bracket is not closed on the line, and the value stays a string.
+static int flow_list(const char* p, const char* end, FrontMatterSpan* items, size_t* count) {
+    const char* item = ++p;
+    size_t n = 0;
+    for (; p < end; p++) {
+        if (*p == '"' || *p == '\'') {
+            const char* q = closing_quote(p, end);
+            if (!q) return 0;
+            p = q;
+        } else if (*p == ',' || *p == ']') {
+            FrontMatterSpan s = unquote(span(item, p));
+            if (s.len || *p == ',') items[n++] = s;
+            if (*p == ']') {
+                *count = n;
+                return 1;
+            }
+            item = p + 1;
+        }
+    }
+    return 0;
+}
+
+// The value after "key:", with a trailing comment dropped.
+static void read_value(FrontMatterField* f, const char* p, const char* end,
+                       FrontMatterSpan* items, size_t* item_count) {
+    FrontMatterSpan raw = span(p, end);
+    f->value = raw;
+    f->type = FM_STRING;
+    if (!raw.len) return;
+
+    p = raw.data;
+    end = raw.data + raw.len;
+    if (*p == '"' || *p == '\'') {
+        const char* q = closing_quote(p, end);
+        if (q) f->value = (FrontMatterSpan){ p + 1, (size_t)(q - p - 1) };
+        return;
+    }
+
+    size_t n;
+    if (*p == '[' && flow_list(p, end, items + *item_count, &n)) {
+        f->type = FM_LIST;
+        f->items = items + *item_count;
+        f->item_count = n;
+        *item_count += n;
+        return;
+    }
+
+    for (const char* c = p; c < end; c++) {
+        if (*c == '#' && c > p && is_blank(c[-1])) {
+            f->value = span(p, c);
+            break;
+        }
+    }
+    type_scalar(f);
+}
+
+static void read_known_fields(FrontMatter* fm) {
+    for (size_t i = 0; i < fm->field_count; i++) {
+        const FrontMatterField* f = &fm->fields[i];
+        if (span_is(f->key, "title")) {
+            fm->title = f->value;
+        } else if (span_is(f->key, "layout")) {
+            fm->layout = f->value;
+        } else if (span_is(f->key, "slug")) {
+            fm->slug = f->value;
+        } else if (span_is(f->key, "tags")) {
+            fm->tags = f->type == FM_LIST ? f->items : &f->value;
+            fm->tag_count = f->type == FM_LIST ? f->item_count : f->value.len != 0;
+        } else if (span_is(f->key, "date")) {
+            fm->has_date = parse_date(f->value, &fm->date);
+            if (!fm->has_date) fm->date = 0;
+        } else if (span_is(f->key, "weight")) {
+            if (!parse_int(f->value, &fm->weight)) fm->weight = 0;
+        } else if (span_is(f->key, "draft")) {
+            fm->draft = f->type == FM_BOOL && f->number;
+        }
+    }
+}
+
+size_t frontmatter_parse(Arena* arena, const char* content, size_t len, FrontMatter* fm) {
+    const char* end = content + len;
+    if (!is_delimiter(content, end)) return 0;
+
+    const char* body = memchr(content, '\n', len);
+    if (!body) return 0;
+    body++;
+
+    const char* close = body;
+    while (!is_delimiter(close, end)) {
+        close = memmem(close, (size_t)(end - close), "\n" FRONTMATTER_DELIMITER, 4);
+        if (!close) return 0;
+        close++;
+    }
+    const char* after = memchr(close, '\n', (size_t)(end - close));
+    after = after ? after + 1 : end;
+
+    // Sizes the tables from the block: a line holds at most one field, and
+    // at most one list item more than it has commas ("[a, b]", "- a").
+    size_t lines = 1, commas = 0;
+    for (const char* c = body; c < close; c++) {
+        lines += *c == '\n';
+        commas += *c == ',';
+    }
+    size_t max_items = lines + commas;
+    size_t max_fields = lines;
+    FrontMatterSpan* items = ARENA_ALLOC_ARRAY(arena, FrontMatterSpan, max_items);
+    FrontMatterField* fields = ARENA_ALLOC_ARRAY(arena, FrontMatterField, max_fields);
+    if (!items || !fields) return (size_t)(after - content);
+
+    // Top-level "key: value" lines. Indented "- item" lines extend the list
+    // of a key with no value; other indented lines, comments and block
+    // scalars are skipped.
+    size_t count = 0, item_count = 0;
+    FrontMatterField* open_list = NULL;
+    for (const char* line = body; line < close;) {
+        const char* eol = memchr(line, '\n', (size_t)(close - line));
+        const char* next = eol ? eol + 1 : close;
+        if (!eol) eol = close;
+
+        FrontMatterSpan text = span(line, eol);
+        if (!text.len || text.data[0] == '#') {
+            line = next;
+            continue;
+        }
+
+        if (text.data[0] == '-' && (text.len == 1 || is_blank(text.data[1]))) {
+            if (open_list) {
+                if (open_list->type != FM_LIST) {
+                    open_list->type = FM_LIST;
+                    open_list->items = items + item_count;
+                    open_list->value = text;
+                }
+                items[item_count++] = unquote(span(text.data + 1, text.data + text.len));
+                open_list->item_count++;
+                open_list->value.len = (size_t)(text.data + text.len - open_list->value.data);
+            }
+            line = next;
+            continue;
+        }
+        if (text.data != line) {
+            line = next;
+            continue;
+        }
+
+        const char* colon = line + 1;
+        while (colon < eol && !(*colon == ':' && (colon + 1 == eol || is_blank(colon[1])))) colon++;
+        open_list = NULL;
+        if (colon < eol) {
+            FrontMatterField* f = &fields[count++];
+            *f = (FrontMatterField){ .key = unquote(span(line, colon)) };
+            read_value(f, colon + 1, eol, items, &item_count);
+            if (!span(colon + 1, eol).len) open_list = f;
+        }
+        line = next;
+    }
+
+    arena_shrink(arena, fields, sizeof(FrontMatterField) * max_fields, sizeof(FrontMatterField) * count);
+    fm->fields = fields;
+    fm->field_count = count;
+    read_known_fields(fm);
+    return (size_t)(after - content);
+}
+
+const FrontMatterField* frontmatter_get(const FrontMatter* fm, const char* key) {
+    for (size_t i = fm->field_count; i > 0; i--) {
+        if (span_is(fm->fields[i - 1].key, key)) return &fm->fields[i - 1];
+    }
+    return NULL;
+}
@@ -1,84 +1,243 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <cmark.h>
 #include "parser/markdown.h"
 #include "parser/mlindown_token.h"
 #include "parser/mlindown_parser.h"
 #include "parser/mlindown_render.h"
+#include "parser/mlindown_stream.h"
 #include "utils/simd.h"
+#include "utils/hash.h"
 #include "arena.h"
 
-#define FRONTMATTER_DELIMITER "---"
-
-static int parse_frontmatter(char* content, FrontMatter* fm, Arena* arena) {
-    char* start = simd_strstr(content, FRONTMATTER_DELIMITER);
-    if (!start) return 0;
-    
-    char* end = simd_strstr(start + 3, FRONTMATTER_DELIMITER);
-    if (!end) return 0;
-    
-    *end = '\0';
-    char* yaml = start + 3;
-    
-    char* title_start = simd_strstr(yaml, "title:");
-    if (title_start) {
-        title_start += 6;
-        while (*title_start == ' ' || *title_start == '"') title_start++;
-        char* title_end = simd_strchr(title_start, '\n');
-        if (title_end) {
-            while (title_end > title_start && 
-                (title_end[-1] == ' ' || title_end[-1] == '"')) {
-                title_end--;
+// Pages this large go through the block memo when there is one.
+#define BLOCK_MEMO_MIN_PAGE (256 * 1024)
+
+// Blocks are grouped into chunks of at least this many bytes. Past that, a
+// chunk ends at the first block whose opening bytes hash to a multiple of
+// four, so the cuts depend on the text around them and an edit moves no
+// cut but its own.
+#define BLOCK_CHUNK_MIN (8 * 1024)
+
+// Top-level fences a line may still be inside, past which the rest of the
+// page stays one chunk.
+#define MAX_OPEN_FENCES 8
+
+typedef struct {
+    char marker;
+    size_t length;
+    int indent;          // columns before the opening run
+    int certain;         // open however the lines before are read
+    int top;             // ... and not in a list item
+    int shallow;         // a line since was indented less than the run
+} OpenFence;
+
+// Whitespace as the block parser counts it.
+static int is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\v' || c == '\f' || c == '\r';
+}
+
+static int is_blank_line(const char* line, const char* end) {
+    while (line < end && is_space(*line)) line++;
+    return line == end;
+}
+
+static size_t fence_run(const char* p, const char* end, char c) {
+    const char* q = p;
+    while (q < end && *q == c) q++;
+    return (size_t)(q - p);
+}
+
+// Columns of whitespace the line starts with; first is set past them.
+static int line_indent(const char* line, const char* end, const char** first) {
+    const char* p = line;
+    int col = 0;
+    for (; p < end && is_space(*p); p++) col = *p == '\t' ? (col / 4 + 1) * 4 : col + 1;
+    *first = p;
+    return col;
+}
+
+// Whether a line closes a top-level fence, as the block parser decides it.
+static int closes_fence(const char* line, const char* end, OpenFence f) {
+    const char* p;
+    int col = line_indent(line, end, &p);
+    if (col >= 4 || p == end || *p != f.marker) return 0;
+    size_t run = fence_run(p, end, f.marker);
+    if (run < f.length) return 0;
+    return is_blank_line(p + run, end);
+}
+
+// Where md can be cut into chunks that render to exactly the HTML of the
+// whole: at a line after a blank one that starts in column 0 and is no
+// list item, since that closes every open container and leaf. The one
+// thing that survives it is a top-level fenced code block. Whether a fence
+// indented one to three columns sits in a list item or opens at the top
+// level depends on the item, so while one may be open both possibilities
+// are followed, and a line is a cut only when no fence can be open. Fills
+// cuts with chunk ends and returns how many.
+static size_t find_chunks(const char* md, size_t len, size_t* cuts) {
+    OpenFence fences[MAX_OPEN_FENCES];
+    size_t open = 0;     // fences that may be open
+    int outside = 1;     // whether none may be open
+    int in_item = 0;     // whether a list item may be open
+    int after_blank = 0;
+    size_t count = 0, chunk_start = 0;
+
+    const char* end = md + len;
+    for (const char* line = md; line < end && open <= MAX_OPEN_FENCES;) {
+        const char* eol = memchr(line, '\n', (size_t)(end - line));
+        const char* next = eol ? eol + 1 : end;
+        if (!eol) eol = end;
+        size_t pos = (size_t)(line - md);
+
+        if (is_blank_line(line, eol)) {
+            after_blank = 1;
+            line = next;
+            continue;
+        }
+
+        char c = *line;
+        int item = c == '-' || c == '+' || c == '*' || (c >= '0' && c <= '9');
+        const char* first;
+        int indent = line_indent(line, eol, &first);
+        if (outside) {
+            // A line like the cut below closes every item; one that starts
+            // with a marker, past any quote markers, may open one.
+            if (after_blank && !is_space(c) && !item) in_item = 0;
+            const char* p = first;
+            while (p < eol && (*p == '>' || is_space(*p))) p++;
+            if (p < eol && (*p == '-' || *p == '+' || *p == '*' || (*p >= '0' && *p <= '9'))) {
+                in_item = 1;
+            }
+        }
+        if (after_blank && outside && !open && !is_space(c) && !item &&
+            pos - chunk_start >= BLOCK_CHUNK_MIN &&
+            (hash_from_memory(line, (size_t)(eol - line) < 16 ? (size_t)(eol - line) : 16) & 3) == 0) {
+            cuts[count++] = pos;
+            chunk_start = pos;
+        }
+        after_blank = 0;
+
+        // Fences that may be open either close here or stay open; where
+        // none is certainly open, a fence line opens one, or, indented, may
+        // be in an item instead. With no item open, or in column 0, which
+        // ends any item, it is top-level, and certainly open if no other
+        // fence may be. A line that closes the one fence that may be open
+        // opens none, when it is certainly open and either top-level or
+        // still in the same item: no line since was indented less than it.
+        size_t kept = 0;
+        int settled = 0, was_outside = outside;
+        outside = 1;
+        for (size_t i = 0; i < open; i++) {
+            OpenFence* f = &fences[i];
+            if (closes_fence(line, eol, *f)) {
+                settled = open == 1 && f->certain && (f->top || (!f->shallow && indent >= f->indent));
+            } else {
+                f->shallow |= indent < f->indent;
+                outside &= !f->top;
+                fences[kept++] = *f;
             }
-            size_t len = title_end - title_start;
-            fm->title = arena_alloc(arena, len + 1);
-            strncpy(fm->title, title_start, len);
-            fm->title[len] = '\0';
         }
-    }    
-    return end - content + 3;
+        int closed = kept < open;
+        open = kept;
+
+        if (!settled && was_outside && (is_space(c) || c == '`' || c == '~')) {
+            Token t = token_classify(md, pos, (size_t)(eol - md));
+            if (t.type == TOKEN_FENCE) {
+                int certain = !open && !closed;
+                int top = certain && (t.indent == 0 || !in_item);
+                if (open < MAX_OPEN_FENCES) {
+                    fences[open] = (OpenFence){ *first, fence_run(first, eol, *first), indent,
+                                                certain, top, 0 };
+                }
+                open++;
+                if (top) outside = 0;
+                if (t.indent == 0) in_item = 0;
+            }
+        }
+        line = next;
+    }
+    cuts[count++] = len;
+    return count;
 }
 
-// MarkdownDoc parse_markdown(Arena* arena, const char* input, size_t len) {
-//     MarkdownDoc doc = {0};
-//     char* content = arena_alloc(arena, len + 1);
-//     memcpy(content, input, len);
-//     content[len] = '\0';
-
-//     int frontmatter_size = parse_frontmatter(content, &doc.frontmatter, arena);
-    
-//     char* md_content = content + frontmatter_size;
-//     cmark_node* node = cmark_parse_document(md_content, strlen(md_content), CMARK_OPT_DEFAULT);
-    
-//     doc.html = cmark_render_html(node, CMARK_OPT_DEFAULT);
-//     cmark_node_free(node);
-    
-//     return doc;
-// }
+static char* render_body(Arena* arena, const char* md, size_t len, size_t* html_len) {
+    // Most pages render in one pass with no intermediate structures.
+    char* html = render_stream(arena, md, len, html_len);
+    if (html) return html;
+
+    // Tokens, tree and HTML live in the page arena, the first two pointing
+    // into the input, which must stay mapped until rendering is done; the
+    // caller's arena reset frees them.
+    TokenList toks = tokenize(arena, md, len);
+    Node *root = parse_tokens(arena, &toks);
+    return render_html_str(arena, root, html_len);
+}
+
+typedef struct {
+    const char* html;
+    size_t len;
+} Fragment;
+
+// Renders the chunks the memo does not have, then copies every chunk's
+// HTML into one buffer.
+static char* render_memoized(Arena* arena, const char* md, size_t len, BlockMemo* memo,
+                             size_t* html_len) {
+    size_t max_chunks = len / BLOCK_CHUNK_MIN + 1;
+    size_t* cuts = ARENA_ALLOC_ARRAY(arena, size_t, max_chunks);
+    Fragment* frags = ARENA_ALLOC_ARRAY(arena, Fragment, max_chunks);
+    if (!cuts || !frags) return render_body(arena, md, len, html_len);
+
+    size_t chunks = find_chunks(md, len, cuts);
+    size_t total = 0, start = 0;
+    for (size_t i = 0; i < chunks; i++) {
+        size_t n = cuts[i] - start;
+        uint64_t hash = hash_from_memory(md + start, n);
+        Fragment* f = &frags[i];
+        f->html = block_memo_find(memo, hash, n, &f->len);
+        if (!f->html) {
+            char* html = render_body(arena, md + start, n, &f->len);
+            if (!html) return NULL;
+            block_memo_store(memo, hash, n, html, f->len);
+            f->html = html;
+        }
+        total += f->len;
+        start = cuts[i];
+    }
+
+    char* html = arena_alloc_aligned(arena, total + 1, 1);
+    if (!html) return NULL;
+    char* out = html;
+    for (size_t i = 0; i < chunks; i++) {
+        memcpy(out, frags[i].html, frags[i].len);
+        out += frags[i].len;
+    }
+    *out = '\0';
+    *html_len = total;
+    return html;
+}
 
 MarkdownDoc parse_markdown(Arena* arena, const char* input, size_t len) {
+    return parse_markdown_memo(arena, input, len, NULL);
+}
+
+MarkdownDoc parse_markdown_memo(Arena* arena, const char* input, size_t len, BlockMemo* memo) {
     MarkdownDoc doc = {0};
-    char* content = arena_alloc(arena, len + 1);
-    memcpy(content, input, len);
-    content[len] = '\0';
-
-    int frontmatter_size = parse_frontmatter(content, &doc.frontmatter, arena);
-    char* md_content = content + frontmatter_size;
-
-    TokenList toks = tokenize(md_content);
-    Node *root = parse_tokens(&toks);
-
-    char *html = render_html_str(root);
-    if (html) {
-        size_t hlen = strlen(html);
-        doc.html = arena_alloc(arena, hlen + 1);
-        memcpy(doc.html, html, hlen + 1);
-        free(html);
-    }
 
-    node_free(root);
-    free_tokens(&toks);
+    // Pages have always ended at the first NUL byte, if they had one.
+    const char* nul = memchr(input, '\0', len);
+    if (nul) len = (size_t)(nul - input);
+
+    size_t frontmatter_size = frontmatter_parse(arena, input, len, &doc.frontmatter);
+    const char* md_content = input + frontmatter_size;
+
+    size_t md_len = len - frontmatter_size;
 
+    if (memo && md_len >= BLOCK_MEMO_MIN_PAGE) {
+        doc.html = render_memoized(arena, md_content, md_len, memo, &doc.html_len);
+    } else {
+        doc.html = render_body(arena, md_content, md_len, &doc.html_len);
+    }
     return doc;
-}
\ No newline at end of file
+}
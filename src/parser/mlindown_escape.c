@@ -0,0 +1,108 @@
+#include <string.h>
+#include <stdint.h>
+#include "parser/mlindown_escape.h"
+#include "parser/mlindown_index.h"
+
+/* " & ' (22 26 27) and < > (3C 3E) by nibble. */
+static const uint8_t ESCAPE_LOW[16] = {
+    [0x2] = 0x01, [0x6] = 0x01, [0x7] = 0x01, [0xC] = 0x02, [0xE] = 0x02,
+};
+
+static const uint8_t ESCAPE_HIGH[16] = {
+    [0x2] = 0x01, [0x3] = 0x02,
+};
+
+/* Spans shorter than a block are cheaper to walk byte by byte than to
+ * copy into a padded block for the classifier. */
+static inline int needs_escape(unsigned char c) {
+    return (ESCAPE_LOW[c & 0x0F] & ESCAPE_HIGH[c >> 4]) != 0;
+}
+
+/* Matches in [base, base + INDEX_BLOCK), or in [base, len) for the last
+ * partial block, which is classified as the input's final 64 bytes with
+ * the ones already seen shifted out. Needs len >= INDEX_BLOCK. */
+static inline uint64_t escape_mask(const char *text, size_t len, size_t base) {
+    const unsigned char *p = (const unsigned char *)text;
+    if (base + INDEX_BLOCK <= len) return index_match_block(p + base, ESCAPE_LOW, ESCAPE_HIGH);
+    return index_match_block(p + len - INDEX_BLOCK, ESCAPE_LOW, ESCAPE_HIGH) >>
+           (INDEX_BLOCK - (len - base));
+}
+
+/* The same entities by the low five bits of the byte they replace, padded
+ * so one fixed-size copy writes any of them. */
+static const char ENTITY[32][8] = {
+    [0x02] = "&quot;", [0x06] = "&amp;", [0x07] = "&#39;", [0x1C] = "&lt;", [0x1E] = "&gt;",
+};
+
+static const uint8_t ENTITY_LEN[32] = {
+    [0x02] = 6, [0x06] = 5, [0x07] = 5, [0x1C] = 4, [0x1E] = 4,
+};
+
+static inline char *put_entity(char *out, char c) {
+    switch (c) {
+    case '<':  memcpy(out, "&lt;", 4);   return out + 4;
+    case '>':  memcpy(out, "&gt;", 4);   return out + 4;
+    case '&':  memcpy(out, "&amp;", 5);  return out + 5;
+    case '"':  memcpy(out, "&quot;", 6); return out + 6;
+    default:   memcpy(out, "&#39;", 5);  return out + 5;
+    }
+}
+
+uint64_t escape_match_block(const unsigned char *p) {
+    return index_match_block(p, ESCAPE_LOW, ESCAPE_HIGH);
+}
+
+size_t escape_count(const char *text, size_t len) {
+    size_t count = 0;
+    if (len < INDEX_BLOCK) {
+        for (size_t i = 0; i < len; i++) count += needs_escape((unsigned char)text[i]);
+        return count;
+    }
+    for (size_t base = 0; base < len; base += INDEX_BLOCK) {
+        count += (size_t)__builtin_popcountll(escape_mask(text, len, base));
+    }
+    return count;
+}
+
+char *escape_html(char *out, const char *text, size_t len) {
+    if (len < INDEX_BLOCK) {
+        for (size_t i = 0; i < len; i++) {
+            if (needs_escape((unsigned char)text[i])) out = put_entity(out, text[i]);
+            else *out++ = text[i];
+        }
+        return out;
+    }
+
+    /* Clean bytes pile up behind cursor and are copied when a match or the
+     * end of the input flushes them, so clean blocks cost no copy calls.
+     *
+     * Away from the end, short runs and entities go out as fixed 16- and
+     * 8-byte copies. Whatever they write past the real output is inside
+     * this call's own output, which is at least len - cursor bytes long,
+     * and gets overwritten by it. */
+    size_t cursor = 0;
+    for (size_t base = 0; base < len; base += INDEX_BLOCK) {
+        uint64_t mask = escape_mask(text, len, base);
+        while (mask) {
+            size_t i = base + (size_t)__builtin_ctzll(mask);
+            size_t run = i - cursor;
+            mask &= mask - 1;
+            if (i + 16 <= len) {
+                unsigned char c = (unsigned char)text[i] & 0x1F;
+                size_t k = 0;
+                do {
+                    memcpy(out + k, text + cursor + k, 16);
+                    k += 16;
+                } while (k < run);
+                memcpy(out + run, ENTITY[c], 8);
+                out += run + ENTITY_LEN[c];
+            } else {
+                memcpy(out, text + cursor, run);
+                out = put_entity(out + run, text[i]);
+            }
+            cursor = i + 1;
+        }
+    }
+    memcpy(out, text + cursor, len - cursor);
+    return out + (len - cursor);
+}
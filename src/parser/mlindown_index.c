@@ -0,0 +1,225 @@
+#include <string.h>
+#include "parser/mlindown_index.h"
+#include "utils/simd.h"
+
+/* Byte classes come from two 16-entry tables, one per nibble, ANDed
+ * together: a class bit survives only if both nibbles allow it.
+ *
+ *   bit  high nibble  low nibbles       bytes
+ *   0    0            9 B C D           \t \v \f \r
+ *   1    0            A                 \n
+ *   2    2            0                 ' '
+ *   3    2            3 A B D           # * + -
+ *   4    3            0-9 A D E         0-9 : = >
+ *   5    6            0                 `
+ *   6    7            C E               | ~
+ *   7    5            F                 _
+ */
+#define CLASS_SPACE   0x05
+#define CLASS_NEWLINE 0x02
+#define CLASS_MARKER  0xF8
+
+static const uint8_t LOW_NIBBLE[16] = {
+    0x04 | 0x10 | 0x20, 0x10, 0x10, 0x08 | 0x10, 0x10, 0x10, 0x10, 0x10,
+    0x10, 0x01 | 0x10, 0x02 | 0x08 | 0x10, 0x01 | 0x08, 0x01 | 0x40, 0x01 | 0x08 | 0x10, 0x10 | 0x40, 0x80,
+};
+
+static const uint8_t HIGH_NIBBLE[16] = {
+    0x01 | 0x02, 0x00, 0x04 | 0x08, 0x10, 0x00, 0x80, 0x20, 0x40,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
+typedef struct {
+    uint64_t newline;
+    uint64_t space;
+    uint64_t marker;
+} BlockMasks;
+
+#if defined(__AVX2__)
+
+uint64_t index_match_block(const unsigned char *p, const uint8_t low[16], const uint8_t high[16]) {
+    const __m256i lo_table = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)low));
+    const __m256i hi_table = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)high));
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+    const __m256i zero = _mm256_setzero_si256();
+    uint64_t mask = 0;
+
+    for (int half = 0; half < 2; half++) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(p + 32 * half));
+        __m256i cls = _mm256_and_si256(
+            _mm256_shuffle_epi8(lo_table, _mm256_and_si256(v, nibble)),
+            _mm256_shuffle_epi8(hi_table, _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble)));
+        uint32_t hits = ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(cls, zero));
+        mask |= (uint64_t)hits << (32 * half);
+    }
+    return mask;
+}
+
+static BlockMasks classify_block(const unsigned char *p) {
+    const __m256i lo_table = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)LOW_NIBBLE));
+    const __m256i hi_table = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)HIGH_NIBBLE));
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+    const __m256i zero = _mm256_setzero_si256();
+    BlockMasks m = {0, 0, 0};
+
+    for (int half = 0; half < 2; half++) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(p + 32 * half));
+        __m256i lo = _mm256_and_si256(v, nibble);
+        __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble);
+        __m256i cls = _mm256_and_si256(_mm256_shuffle_epi8(lo_table, lo),
+                                       _mm256_shuffle_epi8(hi_table, hi));
+
+        uint32_t nl = ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(
+            _mm256_and_si256(cls, _mm256_set1_epi8(CLASS_NEWLINE)), zero));
+        uint32_t sp = ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(
+            _mm256_and_si256(cls, _mm256_set1_epi8(CLASS_SPACE)), zero));
+        uint32_t mk = ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(
+            _mm256_and_si256(cls, _mm256_set1_epi8(CLASS_MARKER)), zero));
+
+        m.newline |= (uint64_t)nl << (32 * half);
+        m.space |= (uint64_t)sp << (32 * half);
+        m.marker |= (uint64_t)mk << (32 * half);
+    }
+    return m;
+}
+
+#elif defined(__aarch64__)
+
+static inline uint64_t neon_bitmask(uint8x16_t v0, uint8x16_t v1, uint8x16_t v2, uint8x16_t v3) {
+    const uint8x16_t bits = {0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80,
+                             0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80};
+    uint8x16_t s0 = vpaddq_u8(vandq_u8(v0, bits), vandq_u8(v1, bits));
+    uint8x16_t s1 = vpaddq_u8(vandq_u8(v2, bits), vandq_u8(v3, bits));
+    s0 = vpaddq_u8(s0, s1);
+    s0 = vpaddq_u8(s0, s0);
+    return vgetq_lane_u64(vreinterpretq_u64_u8(s0), 0);
+}
+
+uint64_t index_match_block(const unsigned char *p, const uint8_t low[16], const uint8_t high[16]) {
+    const uint8x16_t lo_table = vld1q_u8(low);
+    const uint8x16_t hi_table = vld1q_u8(high);
+    const uint8x16_t nibble = vdupq_n_u8(0x0F);
+    uint8x16_t hits[4];
+
+    for (int i = 0; i < 4; i++) {
+        uint8x16_t v = vld1q_u8(p + 16 * i);
+        uint8x16_t cls = vandq_u8(vqtbl1q_u8(lo_table, vandq_u8(v, nibble)),
+                                  vqtbl1q_u8(hi_table, vshrq_n_u8(v, 4)));
+        hits[i] = vtstq_u8(cls, cls);
+    }
+    return neon_bitmask(hits[0], hits[1], hits[2], hits[3]);
+}
+
+static BlockMasks classify_block(const unsigned char *p) {
+    const uint8x16_t lo_table = vld1q_u8(LOW_NIBBLE);
+    const uint8x16_t hi_table = vld1q_u8(HIGH_NIBBLE);
+    const uint8x16_t nibble = vdupq_n_u8(0x0F);
+    uint8x16_t cls[4];
+
+    for (int i = 0; i < 4; i++) {
+        uint8x16_t v = vld1q_u8(p + 16 * i);
+        cls[i] = vandq_u8(vqtbl1q_u8(lo_table, vandq_u8(v, nibble)),
+                          vqtbl1q_u8(hi_table, vshrq_n_u8(v, 4)));
+    }
+
+    const uint8x16_t nl = vdupq_n_u8(CLASS_NEWLINE);
+    const uint8x16_t sp = vdupq_n_u8(CLASS_SPACE);
+    const uint8x16_t mk = vdupq_n_u8(CLASS_MARKER);
+    BlockMasks m = {
+        neon_bitmask(vtstq_u8(cls[0], nl), vtstq_u8(cls[1], nl), vtstq_u8(cls[2], nl), vtstq_u8(cls[3], nl)),
+        neon_bitmask(vtstq_u8(cls[0], sp), vtstq_u8(cls[1], sp), vtstq_u8(cls[2], sp), vtstq_u8(cls[3], sp)),
+        neon_bitmask(vtstq_u8(cls[0], mk), vtstq_u8(cls[1], mk), vtstq_u8(cls[2], mk), vtstq_u8(cls[3], mk)),
+    };
+    return m;
+}
+
+#else
+
+uint64_t index_match_block(const unsigned char *p, const uint8_t low[16], const uint8_t high[16]) {
+    uint64_t mask = 0;
+    for (int i = 0; i < INDEX_BLOCK; i++) {
+        if (low[p[i] & 0x0F] & high[p[i] >> 4]) mask |= 1ULL << i;
+    }
+    return mask;
+}
+
+static BlockMasks classify_block(const unsigned char *p) {
+    BlockMasks m = {0, 0, 0};
+    for (int i = 0; i < INDEX_BLOCK; i++) {
+        uint8_t cls = LOW_NIBBLE[p[i] & 0x0F] & HIGH_NIBBLE[p[i] >> 4];
+        uint64_t bit = 1ULL << i;
+        if (cls & CLASS_NEWLINE) m.newline |= bit;
+        if (cls & CLASS_SPACE) m.space |= bit;
+        if (cls & CLASS_MARKER) m.marker |= bit;
+    }
+    return m;
+}
+
+#endif
+
+void index_load(StructuralIndex *idx, size_t block) {
+    const unsigned char *p = (const unsigned char *)idx->input + block;
+    unsigned char tail[INDEX_BLOCK];
+    if (idx->len - block < INDEX_BLOCK) {
+        /* Zero padding classifies as nothing. */
+        memset(tail, 0, sizeof(tail));
+        memcpy(tail, p, idx->len - block);
+        p = tail;
+    }
+
+    BlockMasks m = classify_block(p);
+    idx->block = block;
+    idx->newline = m.newline;
+    idx->space = m.space;
+    idx->marker = m.marker;
+}
+
+void index_init(StructuralIndex *idx, const char *input, size_t len) {
+    idx->input = input;
+    idx->len = len;
+    idx->block = SIZE_MAX;
+    idx->newline = idx->space = idx->marker = 0;
+}
+
+/* First newline (or first non-space, with skip_space) at or after pos,
+ * bounded by end. Walks forward block by block. */
+size_t index_scan(StructuralIndex *idx, size_t pos, size_t end, int skip_space) {
+    while (pos < end) {
+        size_t block = INDEX_BLOCK_OF(pos);
+        if (block != idx->block) index_load(idx, block);
+
+        uint64_t word = skip_space ? ~idx->space : idx->newline;
+        word &= ~0ULL << (pos % INDEX_BLOCK);
+        if (word) {
+            size_t hit = block + (size_t)__builtin_ctzll(word);
+            return hit < end ? hit : end;
+        }
+        pos = block + INDEX_BLOCK;
+    }
+    return end;
+}
+
+size_t index_count_lines(const char *input, size_t len) {
+    size_t lines = 0;
+    size_t i = 0;
+
+#if defined(__AVX2__)
+    const __m256i nl = _mm256_set1_epi8('\n');
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(input + i));
+        lines += (size_t)__builtin_popcount((uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, nl)));
+    }
+#elif defined(__aarch64__)
+    const uint8x16_t nl = vdupq_n_u8('\n');
+    for (; i + 16 <= len; i += 16) {
+        uint8x16_t hits = vceqq_u8(vld1q_u8((const uint8_t *)input + i), nl);
+        lines += vaddvq_u8(vshrq_n_u8(hits, 7));
+    }
+#endif
+    for (; i < len; i++) {
+        lines += input[i] == '\n';
+    }
+
+    if (len > 0 && input[len - 1] != '\n') lines++;
+    return lines;
+}
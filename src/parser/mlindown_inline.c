@@ -0,0 +1,581 @@
+#include <string.h>
+#include "parser/mlindown_inline.h"
+#include "parser/mlindown_index.h"
+#include "parser/mlindown_escape.h"
+
+/* Delimiter bytes by nibble: * (2A), [ \ ] _ (5B 5C 5D 5F) and ` (60). */
+static const uint8_t DELIM_LOW[16] = {
+    [0x0] = 0x04, [0xA] = 0x01, [0xB] = 0x02, [0xC] = 0x02, [0xD] = 0x02, [0xF] = 0x02,
+};
+
+static const uint8_t DELIM_HIGH[16] = {
+    [0x2] = 0x01, [0x5] = 0x02, [0x6] = 0x04,
+};
+
+/* Longer runs are plain text, which keeps a run's matches in one word. */
+#define MAX_EMPHASIS_RUN 64
+#define MAX_CODE_RUN     255
+#define MAX_DEST_PARENS  32
+
+typedef enum {
+    DELIM_EMPHASIS,    /* run of '*' or '_'; tags come from its matches */
+    DELIM_ESCAPE,      /* backslash and the punctuation it escapes */
+    DELIM_CODE,        /* a whole code span, backticks included */
+    DELIM_BRACKET,     /* '[' or '![' that never became a link: literal */
+    DELIM_LINK_OPEN,
+    DELIM_IMAGE_OPEN,
+    DELIM_LINK_CLOSE   /* '](destination "title")' */
+} DelimKind;
+
+#define CAN_OPEN  1
+#define CAN_CLOSE 2
+
+struct InlineDelim {
+    uint32_t pos, len;   /* source bytes the record stands for */
+    uint8_t  kind;
+    uint8_t  ch;         /* emphasis character, or '!' for an image bracket */
+    uint8_t  flags;
+    uint8_t  left;       /* emphasis chars no match used; code: run length */
+    uint8_t  opened;     /* matches made as an opener... */
+    uint8_t  closed;     /* ...and as a closer */
+    int32_t  prev, next; /* emphasis list; for links, the other half */
+    union {
+        struct { uint64_t strong_open, strong_close; } emph;  /* bit i: match i was strong */
+        struct { uint32_t dest, dest_len, title, title_len; } link;
+    } u;
+};
+
+typedef struct {
+    const char  *text;
+    size_t       len;
+    InlineDelim *d;
+    size_t       count, cap;
+    int32_t      last;        /* newest entry of the emphasis list */
+    int32_t     *brackets;
+    size_t       depth;
+    size_t       inactive;    /* brackets below this depth predate a link */
+    int          backticks_seen;
+    int          backticks_scanned;
+    int          escape;      /* the span has bytes escaping replaces */
+    uint32_t     last_run[MAX_CODE_RUN + 1];
+} InlineParser;
+
+static inline int is_space(unsigned char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+static inline int is_punct(unsigned char c) {
+    return (c >= '!' && c <= '/') || (c >= ':' && c <= '@') ||
+           (c >= '[' && c <= '`') || (c >= '{' && c <= '~');
+}
+
+static inline size_t run_length(const char *t, size_t len, size_t i) {
+    size_t n = 1;
+    while (i + n < len && t[i + n] == t[i]) n++;
+    return n;
+}
+
+/* The span's block at base, zero-padded into tail past the span's end. */
+static const unsigned char *span_block(const char *t, size_t len, size_t base,
+                                       unsigned char tail[INDEX_BLOCK]) {
+    const unsigned char *p = (const unsigned char *)t + base;
+    if (len - base >= INDEX_BLOCK) return p;
+    memset(tail, 0, INDEX_BLOCK);
+    memcpy(tail, p, len - base);
+    return tail;
+}
+
+size_t inline_count_delims(const char *text, size_t len, size_t *escapes) {
+    unsigned char tail[INDEX_BLOCK];
+    size_t count = 0;
+    *escapes = 0;
+    for (size_t base = 0; base < len; base += INDEX_BLOCK) {
+        const unsigned char *block = span_block(text, len, base, tail);
+        count += (size_t)__builtin_popcountll(index_match_block(block, DELIM_LOW, DELIM_HIGH));
+        *escapes += (size_t)__builtin_popcountll(escape_match_block(block));
+    }
+    return count;
+}
+
+int inline_reserve(InlineScratch *scratch, Arena *arena, size_t delims) {
+    if (delims <= scratch->cap) return 1;
+
+    size_t cap = scratch->cap ? scratch->cap * 2 : 16;
+    if (cap < delims) cap = delims;
+    InlineDelim *d = ARENA_ALLOC_ARRAY(arena, InlineDelim, cap);
+    int32_t *brackets = ARENA_ALLOC_ARRAY(arena, int32_t, cap);
+    if (!d || !brackets) return 0;
+
+    scratch->delims = d;
+    scratch->brackets = brackets;
+    scratch->cap = cap;
+    return 1;
+}
+
+/* Records come out in source order, which is also emission order. When
+ * the scratch is full the delimiter simply stays literal text. */
+static InlineDelim *add_delim(InlineParser *p, DelimKind kind, size_t pos, size_t len) {
+    if (p->count == p->cap) return NULL;
+    InlineDelim *d = &p->d[p->count++];
+    memset(d, 0, sizeof(*d));
+    d->pos = (uint32_t)pos;
+    d->len = (uint32_t)len;
+    d->kind = (uint8_t)kind;
+    d->prev = d->next = -1;
+    return d;
+}
+
+static void list_append(InlineParser *p, int32_t i) {
+    p->d[i].prev = p->last;
+    p->d[i].next = -1;
+    if (p->last >= 0) p->d[p->last].next = i;
+    p->last = i;
+}
+
+static void list_remove(InlineParser *p, int32_t i) {
+    InlineDelim *d = &p->d[i];
+    if (d->prev >= 0) p->d[d->prev].next = d->next;
+    if (d->next >= 0) p->d[d->next].prev = d->prev;
+    if (p->last == i) p->last = d->prev;
+}
+
+/* CommonMark's "process emphasis" over the list entries after bottom. A
+ * failed search for an opener records where it gave up, per delimiter
+ * character, closer-can-open and run length mod 3, so no later closer of
+ * the same kind looks past that point again. */
+static void process_emphasis(InlineParser *p, int32_t bottom) {
+    InlineDelim *d = p->d;
+    int32_t openers_bottom[2][2][3];
+    for (int a = 0; a < 2; a++)
+        for (int b = 0; b < 2; b++)
+            for (int c = 0; c < 3; c++) openers_bottom[a][b][c] = bottom;
+
+    int32_t closer = -1;
+    for (int32_t i = p->last; i > bottom; i = d[i].prev) closer = i;
+
+    while (closer >= 0) {
+        InlineDelim *c = &d[closer];
+        if (!(c->flags & CAN_CLOSE)) {
+            closer = c->next;
+            continue;
+        }
+
+        int32_t *floor = &openers_bottom[c->ch == '_'][(c->flags & CAN_OPEN) != 0][c->len % 3];
+        int32_t opener = c->prev;
+        while (opener > bottom && opener > *floor) {
+            InlineDelim *o = &d[opener];
+            if (o->ch == c->ch && (o->flags & CAN_OPEN)) {
+                int odd = ((c->flags & CAN_OPEN) || (o->flags & CAN_CLOSE)) &&
+                          (o->len + c->len) % 3 == 0 && !(o->len % 3 == 0 && c->len % 3 == 0);
+                if (!odd) break;
+            }
+            opener = o->prev;
+        }
+
+        if (opener > bottom && opener > *floor) {
+            InlineDelim *o = &d[opener];
+            int strong = o->left >= 2 && c->left >= 2;
+            if (strong) o->u.emph.strong_open |= 1ULL << o->opened;
+            if (strong) c->u.emph.strong_close |= 1ULL << c->closed;
+            o->opened++;
+            c->closed++;
+            o->left -= (uint8_t)(1 + strong);
+            c->left -= (uint8_t)(1 + strong);
+
+            /* Delimiters between the pair can no longer match anything. */
+            o->next = closer;
+            c->prev = opener;
+            if (!o->left) list_remove(p, opener);
+            if (!c->left) {
+                int32_t next = c->next;
+                list_remove(p, closer);
+                closer = next;
+            }
+        } else {
+            int32_t next = c->next;
+            *floor = c->prev;
+            if (!(c->flags & CAN_OPEN)) list_remove(p, closer);
+            closer = next;
+        }
+    }
+
+    while (p->last > bottom) list_remove(p, p->last);
+}
+
+/* Offset of the first backtick run of exactly run bytes at or after from,
+ * or 0. The first search that fails has seen every run to the end of the
+ * span, so from then on last_run answers "is there one after here?". */
+static size_t code_closer(InlineParser *p, size_t from, size_t run) {
+    if (!p->backticks_seen) {
+        memset(p->last_run, 0, sizeof(p->last_run));
+        p->backticks_seen = 1;
+    }
+    if (p->backticks_scanned && p->last_run[run] < from) return 0;
+
+    const char *t = p->text;
+    size_t q = from;
+    while (q < p->len) {
+        const char *hit = memchr(t + q, '`', p->len - q);
+        if (!hit) break;
+        size_t at = (size_t)(hit - t);
+        size_t n = run_length(t, p->len, at);
+        if (n <= MAX_CODE_RUN) p->last_run[n] = (uint32_t)at;
+        if (n == run) return at;
+        q = at + n;
+    }
+    p->backticks_scanned = 1;
+    return 0;
+}
+
+static size_t skip_link_space(const char *t, size_t len, size_t i) {
+    while (i < len && is_space((unsigned char)t[i])) i++;
+    return i;
+}
+
+/* Parses '(destination "title")' at i, just past a ']'. Returns the offset
+ * after the ')' or 0 if there is no inline link tail. */
+static size_t parse_link_tail(const char *t, size_t len, size_t i, InlineDelim *link) {
+    if (i >= len || t[i] != '(') return 0;
+    i = skip_link_space(t, len, i + 1);
+
+    size_t dest = i, j = i;
+    if (i < len && t[i] == '<') {
+        for (j = i + 1; j < len && t[j] != '>' && t[j] != '<' && t[j] != '\n'; j++) {
+            if (t[j] == '\\' && j + 1 < len) j++;
+        }
+        if (j >= len || t[j] != '>') return 0;
+        dest = i + 1;
+        link->u.link.dest_len = (uint32_t)(j - dest);
+        j++;
+    } else {
+        int depth = 0;
+        while (j < len) {
+            unsigned char c = (unsigned char)t[j];
+            if (c == '\\' && j + 1 < len && is_punct((unsigned char)t[j + 1])) {
+                j += 2;
+                continue;
+            }
+            if (c <= ' ' || c == 0x7F) break;
+            if (c == '(' && ++depth > MAX_DEST_PARENS) return 0;
+            if (c == ')' && depth-- == 0) break;
+            j++;
+        }
+        if (depth > 0) return 0;
+        link->u.link.dest_len = (uint32_t)(j - dest);
+    }
+    link->u.link.dest = (uint32_t)dest;
+
+    size_t after_dest = j;
+    i = skip_link_space(t, len, j);
+    if (i > after_dest && i < len && (t[i] == '"' || t[i] == '\'' || t[i] == '(')) {
+        char close = t[i] == '(' ? ')' : t[i];
+        for (j = i + 1; j < len && t[j] != close; j++) {
+            if (t[j] == '\\' && j + 1 < len) j++;
+        }
+        if (j >= len) return 0;
+        link->u.link.title = (uint32_t)(i + 1);
+        link->u.link.title_len = (uint32_t)(j - i - 1);
+        i = skip_link_space(t, len, j + 1);
+    }
+
+    if (i >= len || t[i] != ')') return 0;
+    return i + 1;
+}
+
+static size_t close_bracket(InlineParser *p, size_t i) {
+    if (p->depth == 0) return i + 1;
+
+    int32_t opener = p->brackets[--p->depth];
+    int active = p->depth >= p->inactive;
+    if (p->inactive > p->depth) p->inactive = p->depth;
+    if (!active) return i + 1;
+
+    InlineDelim link;
+    memset(&link, 0, sizeof(link));
+    size_t end = parse_link_tail(p->text, p->len, i + 1, &link);
+    if (!end) return i + 1;
+
+    InlineDelim *close = add_delim(p, DELIM_LINK_CLOSE, i, end - i);
+    if (!close) return i + 1;
+    close->u.link = link.u.link;
+    close->prev = opener;
+
+    InlineDelim *o = &p->d[opener];
+    int image = o->ch == '!';
+    o->kind = image ? DELIM_IMAGE_OPEN : DELIM_LINK_OPEN;
+    o->next = (int32_t)(p->count - 1);
+
+    process_emphasis(p, opener);
+
+    /* Links cannot contain links: brackets opened earlier stay literal. */
+    if (!image) p->inactive = p->depth;
+    return end;
+}
+
+/* Handles the delimiter byte at i; free_from is the first byte no earlier
+ * record has claimed. Returns the first byte still to scan. */
+static size_t scan_delim(InlineParser *p, size_t i, size_t free_from) {
+    const char *t = p->text;
+    size_t len = p->len;
+
+    switch (t[i]) {
+    case '\\':
+        if (i + 1 < len && is_punct((unsigned char)t[i + 1]) && add_delim(p, DELIM_ESCAPE, i, 2)) {
+            return i + 2;
+        }
+        return i + 1;
+
+    case '`': {
+        size_t n = run_length(t, len, i);
+        if (n <= MAX_CODE_RUN) {
+            size_t close = code_closer(p, i + n, n);
+            InlineDelim *d = close ? add_delim(p, DELIM_CODE, i, close + n - i) : NULL;
+            if (d) {
+                d->left = (uint8_t)n;
+                return close + n;
+            }
+        }
+        return i + n;
+    }
+
+    case '*':
+    case '_': {
+        size_t n = run_length(t, len, i);
+        if (n > MAX_EMPHASIS_RUN) return i + n;
+
+        unsigned char before = i > 0 ? (unsigned char)t[i - 1] : '\n';
+        unsigned char after = i + n < len ? (unsigned char)t[i + n] : '\n';
+        int left = !is_space(after) && (!is_punct(after) || is_space(before) || is_punct(before));
+        int right = !is_space(before) && (!is_punct(before) || is_space(after) || is_punct(after));
+
+        uint8_t flags;
+        if (t[i] == '*') {
+            flags = (uint8_t)((left ? CAN_OPEN : 0) | (right ? CAN_CLOSE : 0));
+        } else {
+            flags = (uint8_t)((left && (!right || is_punct(before)) ? CAN_OPEN : 0) |
+                              (right && (!left || is_punct(after)) ? CAN_CLOSE : 0));
+        }
+        if (!flags) return i + n;
+
+        InlineDelim *d = add_delim(p, DELIM_EMPHASIS, i, n);
+        if (d) {
+            d->ch = (uint8_t)t[i];
+            d->flags = flags;
+            d->left = (uint8_t)n;
+            list_append(p, (int32_t)(p->count - 1));
+        }
+        return i + n;
+    }
+
+    case '[': {
+        int image = i > free_from && t[i - 1] == '!';
+        InlineDelim *d = add_delim(p, DELIM_BRACKET, image ? i - 1 : i, image ? 2 : 1);
+        if (d) {
+            d->ch = image ? '!' : '[';
+            p->brackets[p->depth++] = (int32_t)(p->count - 1);
+        }
+        return i + 1;
+    }
+
+    case ']':
+        return close_bracket(p, i);
+    }
+    return i + 1;
+}
+
+/* Blocks wholly inside a code span or link are skipped, but text runs
+ * only lie in blocks that were classified, so the escape flag covers them. */
+static void scan(InlineParser *p) {
+    unsigned char tail[INDEX_BLOCK];
+    size_t pos = 0;
+    for (size_t base = 0; base < p->len;) {
+        const unsigned char *block = span_block(p->text, p->len, base, tail);
+        uint64_t mask = index_match_block(block, DELIM_LOW, DELIM_HIGH);
+        p->escape |= escape_match_block(block) != 0;
+        while (mask) {
+            size_t i = base + (size_t)__builtin_ctzll(mask);
+            mask &= mask - 1;
+            if (i >= pos) pos = scan_delim(p, i, pos);
+        }
+        base += INDEX_BLOCK;
+        if (base < INDEX_BLOCK_OF(pos)) base = INDEX_BLOCK_OF(pos);
+    }
+}
+
+static inline char *put(char *out, const char *s, size_t n) {
+    memcpy(out, s, n);
+    return out + n;
+}
+
+#define PUT_LITERAL(out, lit) put((out), (lit), sizeof(lit) - 1)
+
+/* Text between delimiters. Most spans have nothing to escape, and then
+ * their runs, often only a few bytes each, are plain copies; scan finds
+ * out while it classifies the span's blocks for delimiters. */
+static inline char *put_text(char *out, const char *s, size_t n, int escape) {
+    return escape ? escape_html(out, s, n) : put(out, s, n);
+}
+
+/* Copies s HTML-escaped, dropping the backslash in front of escaped
+ * punctuation. */
+static char *put_unescaped(char *out, const char *s, size_t n) {
+    size_t run = 0;
+    for (size_t i = 0; i + 1 < n; i++) {
+        if (s[i] == '\\' && is_punct((unsigned char)s[i + 1])) {
+            out = escape_html(out, s + run, i - run);
+            run = ++i;
+        }
+    }
+    return escape_html(out, s + run, n - run);
+}
+
+/* Pages are written as name.html next to where name.md sat in the input
+ * tree, so a relative link to a page keeps working once its suffix swaps.
+ * URLs with a scheme or a host are left alone. */
+static char *put_href(char *out, const char *dest, size_t n) {
+    size_t path = 0;
+    while (path < n && dest[path] != '?' && dest[path] != '#') path++;
+
+    int relative = !(n >= 2 && dest[0] == '/' && dest[1] == '/');
+    for (size_t i = 0; i < path && dest[i] != '/'; i++) {
+        if (dest[i] == ':') relative = 0;
+    }
+
+    if (relative && path >= 3 && memcmp(dest + path - 3, ".md", 3) == 0) {
+        out = put_unescaped(out, dest, path - 2);
+        out = PUT_LITERAL(out, "html");
+        return put_unescaped(out, dest + path, n - path);
+    }
+    return put_unescaped(out, dest, n);
+}
+
+static char *put_title(char *out, const char *t, const InlineDelim *close) {
+    if (!close->u.link.title_len) return out;
+    out = PUT_LITERAL(out, " title=\"");
+    out = put_unescaped(out, t + close->u.link.title, close->u.link.title_len);
+    *out++ = '"';
+    return out;
+}
+
+/* Line endings in a code span read as spaces, and one space of padding on
+ * each side is dropped unless the span is nothing but spaces. */
+static char *put_code(char *out, const char *s, size_t n, int text_only) {
+    if (n >= 2 && (s[0] == ' ' || s[0] == '\n') && (s[n - 1] == ' ' || s[n - 1] == '\n')) {
+        size_t k = 0;
+        while (k < n && (s[k] == ' ' || s[k] == '\n')) k++;
+        if (k < n) {
+            s++;
+            n -= 2;
+        }
+    }
+
+    if (!text_only) out = PUT_LITERAL(out, "<code>");
+    const char *nl;
+    while ((nl = memchr(s, '\n', n))) {
+        out = escape_html(out, s, (size_t)(nl - s));
+        *out++ = ' ';
+        n -= (size_t)(nl - s) + 1;
+        s = nl + 1;
+    }
+    out = escape_html(out, s, n);
+    if (!text_only) out = PUT_LITERAL(out, "</code>");
+    return out;
+}
+
+static char *put_emphasis(char *out, const InlineDelim *d, int text_only) {
+    /* Closing tags come first, innermost match first; the unused run sits
+     * between them and the opening tags, which nest outermost first. */
+    for (int m = 0; m < d->closed && !text_only; m++) {
+        out = (d->u.emph.strong_close >> m) & 1 ? PUT_LITERAL(out, "</strong>") : PUT_LITERAL(out, "</em>");
+    }
+    memset(out, d->ch, d->left);
+    out += d->left;
+    for (int m = d->opened - 1; m >= 0 && !text_only; m--) {
+        out = (d->u.emph.strong_open >> m) & 1 ? PUT_LITERAL(out, "<strong>") : PUT_LITERAL(out, "<em>");
+    }
+    return out;
+}
+
+static char *emit(const InlineParser *p, char *out) {
+    const char *t = p->text;
+    size_t cursor = 0;
+    int alt = 0;  /* image descriptions nest; inside one only text is kept */
+
+    for (size_t k = 0; k < p->count; k++) {
+        const InlineDelim *d = &p->d[k];
+        out = put_text(out, t + cursor, d->pos - cursor, p->escape);
+        cursor = d->pos + d->len;
+
+        switch (d->kind) {
+        case DELIM_EMPHASIS:
+            out = put_emphasis(out, d, alt);
+            break;
+
+        case DELIM_ESCAPE:
+            out = escape_html(out, t + d->pos + 1, 1);
+            break;
+
+        case DELIM_CODE:
+            out = put_code(out, t + d->pos + d->left, d->len - 2u * d->left, alt);
+            break;
+
+        case DELIM_BRACKET:
+            out = put(out, t + d->pos, d->len);
+            break;
+
+        case DELIM_LINK_OPEN:
+            if (!alt) {
+                const InlineDelim *close = &p->d[d->next];
+                out = PUT_LITERAL(out, "<a href=\"");
+                out = put_href(out, t + close->u.link.dest, close->u.link.dest_len);
+                *out++ = '"';
+                out = put_title(out, t, close);
+                *out++ = '>';
+            }
+            break;
+
+        case DELIM_IMAGE_OPEN:
+            if (alt++ == 0) {
+                const InlineDelim *close = &p->d[d->next];
+                out = PUT_LITERAL(out, "<img src=\"");
+                out = put_unescaped(out, t + close->u.link.dest, close->u.link.dest_len);
+                out = PUT_LITERAL(out, "\" alt=\"");
+            }
+            break;
+
+        case DELIM_LINK_CLOSE:
+            if (p->d[d->prev].kind == DELIM_IMAGE_OPEN) {
+                if (--alt == 0) {
+                    *out++ = '"';
+                    out = put_title(out, t, d);
+                    out = PUT_LITERAL(out, " />");
+                }
+            } else if (!alt) {
+                out = PUT_LITERAL(out, "</a>");
+            }
+            break;
+        }
+    }
+
+    return put_text(out, t + cursor, p->len - cursor, p->escape);
+}
+
+char *render_inline(InlineScratch *scratch, char *out, const char *text, size_t len) {
+    InlineParser p;
+    p.text = text;
+    p.len = len;
+    p.d = scratch->delims;
+    p.count = 0;
+    p.cap = scratch->cap;
+    p.last = -1;
+    p.brackets = scratch->brackets;
+    p.depth = 0;
+    p.inactive = 0;
+    p.backticks_seen = 0;
+    p.backticks_scanned = 0;
+    p.escape = 0;
+
+    scan(&p);
+    process_emphasis(&p, -1);
+    return emit(&p, out);
+}
@@ -1,67 +1,572 @@
-#include <stdlib.h>
+#define _GNU_SOURCE
 #include <string.h>
 #include "parser/mlindown_parser.h"
 
-Node *parse_tokens(const TokenList *tokens) {
-    Node *doc = node_new(MLINDOWN_NODE_DOCUMENT, 0, NULL);
-    if (!doc) return NULL;
+/* Blocks are built the CommonMark way, a line at a time. The line first
+ * walks the open containers (block quotes, lists and list items), each
+ * consuming its prefix; what is left may open new containers, and the
+ * rest goes to the open leaf block or starts one. A paragraph also takes
+ * lines that matched too few prefixes: "lazy" continuation lines.
+ *
+ * A leaf keeps its lines as spans until it closes, and only copies them
+ * when they are not consecutive in the source, so top-level paragraphs
+ * and code stay spans of the input.
+ *
+ * Every step is linear in the input. A line walks at most MAX_NESTING
+ * containers and classifies what is left at most once per block it opens,
+ * so the constant holds however deep the markers go. Children are
+ * appended through last_child, line spans have one slot per token from
+ * the start, and a leaf is joined once when it closes. Each container is
+ * closed once; deciding whether a list is tight looks at every child once
+ * and goes down at most MAX_NESTING levels from it. Table rows pad short
+ * rows from a budget of one cell per input byte. Inline markup and
+ * escaping are linear as well, so a page costs time in proportion to its
+ * bytes; bench/adversarial_bench.c checks this on inputs built to break
+ * it. */
 
-    size_t i = 0;
-    while (i < tokens->count) {
-        Token t = tokens->data[i];
+#define MAX_NESTING 32  /* quote and list markers past this are text */
+#define CODE_INDENT 4
 
-        switch (t.type) {
+typedef enum {
+    LEAF_NONE,
+    LEAF_PARAGRAPH,
+    LEAF_FENCED,
+    LEAF_INDENTED,
+    LEAF_TABLE
+} LeafKind;
 
-        case TOKEN_HEADING: {
-            Node *h = node_new(MLINDOWN_NODE_HEADING, t.level, t.text);
-            node_add_child(doc, h);
-            i++;
-            break;
+typedef struct {
+    Node *node;
+    int   content;  /* list items: columns of the marker and its padding */
+    char  marker;   /* lists: the bullet, or '.' / ')' */
+} Container;
+
+typedef struct {
+    size_t start, end;
+} LineSpan;
+
+typedef struct {
+    Arena      *arena;
+    const char *input;
+    size_t      len;
+
+    Container   open[MAX_NESTING];
+    int         depth;         /* open[0] is the document */
+
+    LeafKind    leaf;          /* the open leaf, last child of open[depth - 1] */
+    Node       *leaf_node;
+    LineSpan   *lines;         /* its lines so far; one slot per input line */
+    size_t      line_count;
+    char        fence;         /* fenced code: fence byte, length and indent */
+    size_t      fence_len;
+    int         fence_indent;
+    uint8_t    *align;         /* tables: CellAlign of each column */
+    size_t      columns;
+
+    /* Cursor in the current line. Columns count tabs to the next stop. */
+    size_t      pos, end;
+    int         col;
+    size_t      nonspace;      /* first non-space byte at or after pos */
+    int         indent;        /* columns from pos to nonspace */
+    int         blank;         /* nothing but whitespace from pos */
+} BlockParser;
+
+static inline int is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\v' || c == '\f' || c == '\r';
+}
+
+static void find_nonspace(BlockParser *p) {
+    size_t i = p->pos;
+    int col = p->col;
+    while (i < p->end && is_space(p->input[i])) {
+        col = p->input[i] == '\t' ? (col / 4 + 1) * 4 : col + 1;
+        i++;
+    }
+    p->nonspace = i;
+    p->indent = col - p->col;
+    p->blank = i == p->end;
+}
+
+static void advance_to(BlockParser *p, size_t pos) {
+    for (; p->pos < pos; p->pos++) {
+        p->col = p->input[p->pos] == '\t' ? (p->col / 4 + 1) * 4 : p->col + 1;
+    }
+}
+
+/* A tab that reaches past the last column is consumed whole. */
+static void advance_columns(BlockParser *p, int columns) {
+    int target = p->col + columns;
+    while (p->col < target && p->pos < p->end) advance_to(p, p->pos + 1);
+}
+
+static void add_line(BlockParser *p, size_t start, size_t end) {
+    p->lines[p->line_count].start = start;
+    p->lines[p->line_count].end = end;
+    p->line_count++;
+}
+
+/* The leaf's first n lines as one text: a span of the source when they
+ * follow each other in it, else a copy joined in the arena. Code keeps a
+ * newline after every line. */
+static const char *join_lines(BlockParser *p, size_t n, int newlines, size_t *len) {
+    const LineSpan *l = p->lines;
+    *len = 0;
+    if (n == 0) return NULL;
+
+    size_t total = 0;
+    int consecutive = 1;
+    for (size_t i = 0; i < n; i++) {
+        total += l[i].end - l[i].start + 1;
+        if (i > 0 && l[i].start != l[i - 1].end + 1) consecutive = 0;
+    }
+    if (consecutive && (!newlines || l[n - 1].end < p->len)) {
+        *len = l[n - 1].end + (newlines ? 1 : 0) - l[0].start;
+        return p->input + l[0].start;
+    }
+
+    if (!newlines) total--;
+    char *text = arena_alloc(p->arena, total);
+    if (!text) return NULL;
+    char *out = text;
+    for (size_t i = 0; i < n; i++) {
+        memcpy(out, p->input + l[i].start, l[i].end - l[i].start);
+        out += l[i].end - l[i].start;
+        if (newlines || i + 1 < n) *out++ = '\n';
+    }
+    *len = total;
+    return text;
+}
+
+/* Table rows: an optional pipe at each end, cells split at pipes that are
+ * not escaped, each cell trimmed. */
+static void row_begin(const char *input, LineSpan line, size_t *pos, size_t *end) {
+    size_t s = line.start, e = line.end;
+    while (s < e && is_space(input[s])) s++;
+    while (e > s && is_space(input[e - 1])) e--;
+    if (s < e && input[s] == '|') s++;
+    if (e > s && input[e - 1] == '|' && (e - 1 == s || input[e - 2] != '\\')) e--;
+    *pos = s;
+    *end = e;
+    if (s == e) *pos = e + 1;  /* no cells */
+}
+
+static int row_cell(const char *input, size_t *pos, size_t end, LineSpan *cell) {
+    if (*pos > end) return 0;
+    size_t i = *pos;
+    while (i < end && !(input[i] == '|' && input[i - 1] != '\\')) i++;
+
+    size_t s = *pos, e = i;
+    while (s < e && is_space(input[s])) s++;
+    while (e > s && is_space(input[e - 1])) e--;
+    cell->start = s;
+    cell->end = e;
+    *pos = i + 1;
+    return 1;
+}
+
+/* GFM drops the backslash of "\\|" before inline parsing, so the pipe
+ * survives even inside code spans. Other cells point into the input. */
+static const char *cell_text(BlockParser *p, LineSpan cell, size_t *len) {
+    const char *text = p->input + cell.start;
+    *len = cell.end - cell.start;
+    if (!memmem(text, *len, "\\|", 2)) return text;
+
+    char *copy = arena_alloc(p->arena, *len);
+    if (!copy) return NULL;
+    size_t n = 0;
+    for (size_t i = 0; i < *len; i++) {
+        if (!(text[i] == '\\' && i + 1 < *len && text[i + 1] == '|')) copy[n++] = text[i];
+    }
+    *len = n;
+    return copy;
+}
+
+static size_t row_cells(const char *input, LineSpan line) {
+    size_t pos, end, n = 0;
+    LineSpan cell;
+    row_begin(input, line, &pos, &end);
+    while (row_cell(input, &pos, end, &cell)) n++;
+    return n;
+}
+
+/* Every row gets the header's number of cells: extra ones are dropped and
+ * missing ones filled in, the latter only up to one per input byte so a
+ * wide header over many short rows cannot blow up the tree. */
+static void close_table(BlockParser *p) {
+    Node *table = p->leaf_node;
+    size_t fill_budget = p->len;
+
+    for (size_t r = 0; r < p->line_count; r++) {
+        Node *row = node_new(p->arena, MLINDOWN_NODE_TABLE_ROW, r == 0, NULL, 0);
+        if (!row) return;
+        node_add_child(table, row);
+
+        size_t pos, end;
+        LineSpan cell;
+        row_begin(p->input, p->lines[r], &pos, &end);
+        for (size_t c = 0; c < p->columns; c++) {
+            if (row_cell(p->input, &pos, end, &cell)) {
+                size_t len;
+                const char *text = cell_text(p, cell, &len);
+                node_add_child(row, node_new(p->arena, MLINDOWN_NODE_TABLE_CELL, p->align[c],
+                                             text, text ? len : 0));
+            } else if (fill_budget > 0) {
+                fill_budget--;
+                node_add_child(row, node_new(p->arena, MLINDOWN_NODE_TABLE_CELL, p->align[c], NULL, 0));
+            }
         }
+    }
+}
 
-        case TOKEN_BLANK:
-            i++;
-            break;
+static int is_blank_line(const BlockParser *p, LineSpan line) {
+    for (size_t i = line.start; i < line.end; i++) {
+        if (!is_space(p->input[i])) return 0;
+    }
+    return 1;
+}
+
+static void close_leaf(BlockParser *p) {
+    Node *n = p->leaf_node;
+    if (n && p->leaf == LEAF_PARAGRAPH) {
+        /* Trailing whitespace ends the paragraph, or the setext heading it
+         * becomes, rather than belonging to its text. */
+        LineSpan *last = &p->lines[p->line_count - 1];
+        while (last->end > last->start && is_space(p->input[last->end - 1])) last->end--;
+        n->text = join_lines(p, p->line_count, 0, &n->text_len);
+    } else if (n && (p->leaf == LEAF_FENCED || p->leaf == LEAF_INDENTED)) {
+        /* Blank lines at the end of indented code are not part of it. */
+        while (p->leaf == LEAF_INDENTED && p->line_count > 0 &&
+               is_blank_line(p, p->lines[p->line_count - 1])) p->line_count--;
+        n->text = join_lines(p, p->line_count, 1, &n->text_len);
+    } else if (n && p->leaf == LEAF_TABLE) {
+        close_table(p);
+    }
+    p->leaf = LEAF_NONE;
+    p->leaf_node = NULL;
+    p->line_count = 0;
+}
+
+static int is_list(const Node *n) {
+    return n->type == MLINDOWN_NODE_LIST || n->type == MLINDOWN_NODE_ORDERED_LIST;
+}
+
+/* Goes down through the last children of lists and items. */
+static int ends_with_blank(const Node *n) {
+    while (n) {
+        if (n->flags & MLINDOWN_LAST_LINE_BLANK) return 1;
+        if (!is_list(n) && n->type != MLINDOWN_NODE_LIST_ITEM) return 0;
+        n = n->last_child;
+    }
+    return 0;
+}
+
+/* A list is loose if a blank line separates two of its items, or two
+ * blocks inside one item. */
+static void close_container(BlockParser *p) {
+    Node *list = p->open[--p->depth].node;
+    if (!is_list(list)) return;
+
+    for (const Node *item = list->first_child; item; item = item->next) {
+        if (item->next && ends_with_blank(item)) return;
+        for (const Node *c = item->first_child; c; c = c->next) {
+            if ((item->next || c->next) && ends_with_blank(c)) return;
+        }
+    }
+    list->flags |= MLINDOWN_LIST_TIGHT;
+}
 
-        case TOKEN_LIST_ITEM: {
-            Node *ul = node_new(MLINDOWN_NODE_LIST, 0, NULL);
-            while (i < tokens->count && tokens->data[i].type == TOKEN_LIST_ITEM) {
-                Token li_t = tokens->data[i];
-                Node *li = node_new(MLINDOWN_NODE_LIST_ITEM, 0, li_t.text);
-                node_add_child(ul, li);
-                i++;
+/* Appends a block to open[*target - 1], closing first whatever the line
+ * did not match or the block interrupts, and lists unless it is an item.
+ * Containers are pushed, and *target follows the new innermost one. */
+static Node *add_block(BlockParser *p, int *target, NodeType type, int level) {
+    close_leaf(p);
+    while (p->depth > *target) close_container(p);
+    if (type != MLINDOWN_NODE_LIST_ITEM) {
+        while (is_list(p->open[p->depth - 1].node)) close_container(p);
+    }
+    *target = p->depth;
+
+    Node *n = node_new(p->arena, type, level, NULL, 0);
+    if (!n) return NULL;
+    node_add_child(p->open[p->depth - 1].node, n);
+    return n;
+}
+
+static Node *add_container(BlockParser *p, int *target, NodeType type, int level,
+                           int content, char marker) {
+    Node *n = add_block(p, target, type, level);
+    if (!n) return NULL;
+    p->open[p->depth].node = n;
+    p->open[p->depth].content = content;
+    p->open[p->depth].marker = marker;
+    *target = ++p->depth;
+    return n;
+}
+
+static Node *open_leaf(BlockParser *p, int *target, LeafKind kind, NodeType type) {
+    Node *n = add_block(p, target, type, 0);
+    p->leaf = n ? kind : LEAF_NONE;
+    p->leaf_node = n;
+    p->line_count = 0;
+    return n;
+}
+
+static int closes_fence(const BlockParser *p) {
+    if (p->indent >= CODE_INDENT || p->blank || p->input[p->nonspace] != p->fence) return 0;
+    size_t i = p->nonspace;
+    while (i < p->end && p->input[i] == p->fence) i++;
+    if (i - p->nonspace < p->fence_len) return 0;
+    while (i < p->end && is_space(p->input[i])) i++;
+    return i == p->end;
+}
+
+/* A delimiter row under a paragraph whose last line has as many cells
+ * makes that line the header of a table; earlier lines stay a paragraph. */
+static int open_table(BlockParser *p, size_t start, size_t end) {
+    LineSpan delim = { start, end };
+    LineSpan header = p->lines[p->line_count - 1];
+    size_t columns = row_cells(p->input, delim);
+    if (row_cells(p->input, header) != columns) return 0;
+
+    uint8_t *align = arena_alloc(p->arena, columns);
+    if (!align) return 0;
+    size_t pos, row_end, c = 0;
+    LineSpan cell;
+    row_begin(p->input, delim, &pos, &row_end);
+    while (row_cell(p->input, &pos, row_end, &cell)) {
+        int left = p->input[cell.start] == ':';
+        int right = p->input[cell.end - 1] == ':';
+        align[c++] = (uint8_t)(left && right ? MLINDOWN_ALIGN_CENTER :
+                               left ? MLINDOWN_ALIGN_LEFT :
+                               right ? MLINDOWN_ALIGN_RIGHT : MLINDOWN_ALIGN_NONE);
+    }
+
+    Node *table = p->leaf_node;
+    if (p->line_count > 1) {
+        p->line_count--;
+        close_leaf(p);
+        table = node_new(p->arena, MLINDOWN_NODE_TABLE, 0, NULL, 0);
+        if (!table) return 0;
+        node_add_child(p->open[p->depth - 1].node, table);
+    }
+    table->type = MLINDOWN_NODE_TABLE;
+    p->leaf = LEAF_TABLE;
+    p->leaf_node = table;
+    p->lines[0] = header;
+    p->line_count = 1;
+    p->align = align;
+    p->columns = columns;
+    return 1;
+}
+
+static void process_line(BlockParser *p, size_t start, size_t end, const Token *tok) {
+    const char *input = p->input;
+    p->pos = start;
+    p->end = end;
+    p->col = 0;
+
+    /* Open containers take their prefixes. Lists always match; their
+     * items decide. */
+    int matched = 1;
+    for (; matched < p->depth; matched++) {
+        const Container *c = &p->open[matched];
+        find_nonspace(p);
+        if (c->node->type == MLINDOWN_NODE_BLOCKQUOTE) {
+            if (p->indent >= CODE_INDENT || p->blank || input[p->nonspace] != '>') break;
+            advance_to(p, p->nonspace + 1);
+            if (p->pos < end && (input[p->pos] == ' ' || input[p->pos] == '\t')) advance_columns(p, 1);
+        } else if (c->node->type == MLINDOWN_NODE_LIST_ITEM) {
+            if (p->indent >= c->content) advance_columns(p, c->content);
+            else if (p->blank && c->node->first_child) advance_to(p, p->nonspace);
+            else break;
+        }
+    }
+
+    /* Then the open leaf, if every container matched. */
+    int on_leaf = 0;
+    if (matched == p->depth && p->leaf != LEAF_NONE) {
+        find_nonspace(p);
+        switch (p->leaf) {
+        case LEAF_PARAGRAPH:
+        case LEAF_TABLE:
+            on_leaf = !p->blank;
+            break;
+        case LEAF_INDENTED:
+            if (p->indent >= CODE_INDENT) {
+                advance_columns(p, CODE_INDENT);
+                on_leaf = 1;
+            } else if (p->blank) {
+                advance_to(p, p->nonspace);
+                on_leaf = 1;
             }
-            node_add_child(doc, ul);
+            break;
+        case LEAF_FENCED:
+            if (closes_fence(p)) {
+                close_leaf(p);
+                return;
+            }
+            for (int i = 0; i < p->fence_indent && p->pos < end &&
+                            (input[p->pos] == ' ' || input[p->pos] == '\t'); i++) {
+                advance_to(p, p->pos + 1);
+            }
+            on_leaf = 1;
+            break;
+        case LEAF_NONE:
             break;
         }
+    }
 
-        case TOKEN_TEXT: {
-            size_t j = i, total = 0;
-            while (j < tokens->count && tokens->data[j].type == TOKEN_TEXT) {
-                total += strlen(tokens->data[j].text) + 1; // for newline or space
-                j++;
-            }
-            char *buf = malloc(total + 1);
-            if (!buf) return doc;  
-            buf[0] = '\0';
+    /* What is left may open blocks, containers first. New blocks go into
+     * open[target - 1]; container is the block the line ends up in. */
+    int target = matched;
+    int opened = 0, done = 0;
+    int maybe_lazy = p->leaf == LEAF_PARAGRAPH;
+    Node *container = on_leaf ? p->leaf_node : p->open[matched - 1].node;
+    Node *new_item = NULL;
 
-            for (size_t k = i; k < j; k++) {
-                strcat(buf, tokens->data[k].text);
-                if (k + 1 < j) strcat(buf, "\n");
-            }
+    while (!(on_leaf && (p->leaf == LEAF_FENCED || p->leaf == LEAF_INDENTED))) {
+        find_nonspace(p);
+        int para = on_leaf && p->leaf == LEAF_PARAGRAPH;
+        Token t = p->pos == start ? *tok : token_classify(input, p->pos, end);
 
-            Node *p = node_new(MLINDOWN_NODE_PARAGRAPH, 0, buf);
-            free(buf);
-            node_add_child(doc, p);
-            i = j;
+        if (p->indent >= CODE_INDENT) {
+            if (maybe_lazy || p->blank) break;
+            advance_columns(p, CODE_INDENT);
+            container = open_leaf(p, &target, LEAF_INDENTED, MLINDOWN_NODE_CODE_BLOCK);
+            on_leaf = opened = 1;
             break;
         }
 
-        default:
-            i++;
+        if (t.type == TOKEN_QUOTE && p->depth < MAX_NESTING) {
+            advance_to(p, p->nonspace + 1);
+            if (p->pos < end && (input[p->pos] == ' ' || input[p->pos] == '\t')) advance_columns(p, 1);
+            container = add_container(p, &target, MLINDOWN_NODE_BLOCKQUOTE, 0, 0, 0);
+            on_leaf = 0;
+            opened = 1;
+        } else if (t.type == TOKEN_HEADING) {
+            container = add_block(p, &target, MLINDOWN_NODE_HEADING, t.level);
+            if (container) {
+                container->text = input + t.offset;
+                container->text_len = token_heading_length(container->text, t.length);
+            }
+            done = 1;
+        } else if (t.type == TOKEN_FENCE) {
+            container = open_leaf(p, &target, LEAF_FENCED, MLINDOWN_NODE_CODE_BLOCK);
+            if (container) {
+                size_t info = token_info_length(input + t.offset, t.length);
+                container->info = info ? input + t.offset : NULL;
+                container->info_len = info;
+            }
+            p->fence = (char)t.marker;
+            p->fence_len = t.level;
+            p->fence_indent = p->indent;
+            done = 1;
+        } else if (t.type == TOKEN_UNDERLINE && para) {
+            close_leaf(p);
+            container->type = MLINDOWN_NODE_HEADING;
+            container->level = t.marker == '=' ? 1 : 2;
+            done = 1;
+        } else if (t.type == TOKEN_TABLE_DELIM && para && open_table(p, t.offset, end)) {
+            container = p->leaf_node;
+            done = 1;
+        } else if (t.type == TOKEN_BREAK ||
+                   (t.type == TOKEN_UNDERLINE && t.marker == '-' && t.level >= 3)) {
+            container = add_block(p, &target, MLINDOWN_NODE_THEMATIC_BREAK, 0);
+            done = 1;
+        } else if ((t.type == TOKEN_LIST_ITEM || t.type == TOKEN_ORDERED_ITEM ||
+                    (t.type == TOKEN_UNDERLINE && t.marker == '-' && t.level == 1)) &&
+                   p->depth + 2 <= MAX_NESTING) {
+            int ordered = t.type == TOKEN_ORDERED_ITEM;
+            int empty = t.length == 0 || t.type == TOKEN_UNDERLINE;
+            int width = t.type == TOKEN_UNDERLINE ? 2 : t.level;
+            char marker = t.type == TOKEN_UNDERLINE ? '-' : (char)t.marker;
+            int number = 0;
+            for (size_t i = p->nonspace; ordered && input[i] >= '0' && input[i] <= '9'; i++) {
+                number = number * 10 + (input[i] - '0');
+            }
+            /* Only items with text, and ordered ones from 1, interrupt a
+             * paragraph. */
+            if (para && (empty || (ordered && number != 1))) break;
+
+            int content = p->indent + width;
+            advance_to(p, empty ? (p->nonspace + (size_t)width < end ? p->nonspace + (size_t)width : end)
+                                : t.offset);
+
+            const Node *parent = p->open[target - 1].node;
+            NodeType list_type = ordered ? MLINDOWN_NODE_ORDERED_LIST : MLINDOWN_NODE_LIST;
+            if (parent->type != list_type || p->open[target - 1].marker != marker) {
+                if (!add_container(p, &target, list_type, number, 0, marker)) return;
+            }
+            container = new_item = add_container(p, &target, MLINDOWN_NODE_LIST_ITEM, 0, content, 0);
+            on_leaf = 0;
+            opened = 1;
+        } else {
             break;
         }
+
+        if (!container || done) break;
+        maybe_lazy = 0;
+    }
+    if (!container) return;
+
+    /* Blank lines decide whether lists are loose: a block "ends with a
+     * blank line" until something else is added to it or its parents. */
+    find_nonspace(p);
+    if (p->blank && container->last_child) container->last_child->flags |= MLINDOWN_LAST_LINE_BLANK;
+    int last_blank = p->blank &&
+        container->type != MLINDOWN_NODE_BLOCKQUOTE &&
+        container->type != MLINDOWN_NODE_HEADING &&
+        container->type != MLINDOWN_NODE_THEMATIC_BREAK &&
+        !(p->leaf == LEAF_FENCED && container == p->leaf_node) &&
+        !(container == new_item && !container->first_child);
+    if (last_blank) container->flags |= MLINDOWN_LAST_LINE_BLANK;
+    else container->flags &= ~MLINDOWN_LAST_LINE_BLANK;
+    int ancestors = container == p->open[target - 1].node ? target - 1 : target;
+    for (int i = 0; i < ancestors; i++) p->open[i].node->flags &= ~MLINDOWN_LAST_LINE_BLANK;
+
+    if (done) return;
+
+    /* Paragraph lines start at their first non-space byte. */
+    if (p->leaf == LEAF_PARAGRAPH && !on_leaf && !opened && !p->blank) {
+        add_line(p, p->nonspace, end);  /* lazy continuation */
+        return;
+    }
+
+    if (!on_leaf) close_leaf(p);
+    while (p->depth > target) close_container(p);
+
+    if (on_leaf) {
+        add_line(p, p->leaf == LEAF_PARAGRAPH ? p->nonspace : p->pos, end);
+    } else if (!p->blank && open_leaf(p, &target, LEAF_PARAGRAPH, MLINDOWN_NODE_PARAGRAPH)) {
+        add_line(p, p->nonspace, end);
+    }
+}
+
+Node *parse_tokens(Arena *arena, const TokenList *tokens) {
+    Node *doc = node_new(arena, MLINDOWN_NODE_DOCUMENT, 0, NULL, 0);
+    if (!doc || tokens->count == 0) return doc;
+
+    BlockParser p = {
+        .arena  = arena,
+        .input  = tokens->source,
+        .len    = tokens->length,
+        .depth  = 1,
+        .leaf   = LEAF_NONE,
+    };
+    p.open[0].node = doc;
+    p.lines = ARENA_ALLOC_ARRAY(arena, LineSpan, tokens->count);
+    if (!p.lines) return doc;
+
+    /* Every token's text runs to its line end, so lines are back to back. */
+    size_t start = 0;
+    for (size_t i = 0; i < tokens->count; i++) {
+        const Token *t = &tokens->data[i];
+        size_t end = (size_t)t->offset + t->length;
+        process_line(&p, start, end, t);
+        start = end + 1;
     }
 
+    close_leaf(&p);
+    while (p.depth > 1) close_container(&p);
     return doc;
-}
\ No newline at end of file
+}
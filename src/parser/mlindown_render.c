@@ -1,129 +1,251 @@
-#include <stdlib.h>
-#include <stdarg.h>
 #include <string.h>
 #include "parser/mlindown_render.h"
+#include "parser/mlindown_inline.h"
+#include "parser/mlindown_escape.h"
+
+/* The tree is written in two walks. The first adds up the most each node
+ * can write, so the page's HTML gets one arena buffer before anything is
+ * written; the second copies tags out of the tables below and renders
+ * text straight into it. Nothing is formatted, grown or copied again. */
 
 typedef struct {
-    char *buf;
-    size_t len, cap;
-} HtmlBuf;
-
-static void buf_init(HtmlBuf *b) {
-    b->cap = 1024;
-    b->len = 0;
-    b->buf = malloc(b->cap);
-    if (b->buf) b->buf[0] = '\0';
+    const char *s;
+    size_t      len;
+} Tag;
+
+#define TAG(lit) { (lit), sizeof(lit) - 1 }
+
+/* Most tag bytes one node writes, including the line break a block after
+ * a bare list item paragraph gets: a table's <table>, <thead>, <tbody>
+ * and their closing tags come to 51. */
+#define NODE_MARKUP 64
+
+static const Tag OPEN[] = {
+    [MLINDOWN_NODE_PARAGRAPH]      = TAG("<p>"),
+    [MLINDOWN_NODE_LIST]           = TAG("<ul>\n"),
+    [MLINDOWN_NODE_LIST_ITEM]      = TAG("  <li>"),
+    [MLINDOWN_NODE_ORDERED_LIST]   = TAG("<ol>\n"),
+    [MLINDOWN_NODE_BLOCKQUOTE]     = TAG("<blockquote>\n"),
+    [MLINDOWN_NODE_CODE_BLOCK]     = TAG("<pre><code>"),
+    [MLINDOWN_NODE_THEMATIC_BREAK] = TAG("<hr />\n\n"),
+    [MLINDOWN_NODE_TABLE]          = TAG("<table>\n<thead>\n"),
+    [MLINDOWN_NODE_TABLE_ROW]      = TAG("<tr>\n"),
+};
+
+static const Tag CLOSE[] = {
+    [MLINDOWN_NODE_PARAGRAPH]      = TAG("</p>\n\n"),
+    [MLINDOWN_NODE_LIST]           = TAG("</ul>\n\n"),
+    [MLINDOWN_NODE_LIST_ITEM]      = TAG("</li>\n"),
+    [MLINDOWN_NODE_ORDERED_LIST]   = TAG("</ol>\n\n"),
+    [MLINDOWN_NODE_BLOCKQUOTE]     = TAG("</blockquote>\n\n"),
+    [MLINDOWN_NODE_CODE_BLOCK]     = TAG("</code></pre>\n\n"),
+    [MLINDOWN_NODE_TABLE]          = TAG("</table>\n\n"),
+    [MLINDOWN_NODE_TABLE_ROW]      = TAG("</tr>\n"),
+};
+
+static const Tag HEADING_OPEN[7] = {
+    TAG(""), TAG("<h1>"), TAG("<h2>"), TAG("<h3>"), TAG("<h4>"), TAG("<h5>"), TAG("<h6>"),
+};
+
+static const Tag HEADING_CLOSE[7] = {
+    TAG(""), TAG("</h1>\n\n"), TAG("</h2>\n\n"), TAG("</h3>\n\n"),
+    TAG("</h4>\n\n"), TAG("</h5>\n\n"), TAG("</h6>\n\n"),
+};
+
+/* By header row, then CellAlign. */
+static const Tag CELL_OPEN[2][4] = {
+    { TAG("<td>"), TAG("<td align=\"left\">"), TAG("<td align=\"center\">"), TAG("<td align=\"right\">") },
+    { TAG("<th>"), TAG("<th align=\"left\">"), TAG("<th align=\"center\">"), TAG("<th align=\"right\">") },
+};
+
+static const Tag CELL_CLOSE[2] = { TAG("</td>\n"), TAG("</th>\n") };
+
+static inline char *put(char *out, const char *s, size_t n) {
+    memcpy(out, s, n);
+    return out + n;
+}
+
+static inline char *put_tag(char *out, Tag tag) {
+    return put(out, tag.s, tag.len);
 }
 
-static void buf_grow(HtmlBuf *b, size_t needed) {
-    if (needed <= b->cap) return;
-    while (b->cap < needed) b->cap *= 2;
-    b->buf = realloc(b->buf, b->cap);
+#define PUT_LITERAL(out, lit) put((out), (lit), sizeof(lit) - 1)
+
+static char *put_number(char *out, int n) {
+    char digits[10];
+    int k = 0;
+    do {
+        digits[k++] = (char)('0' + n % 10);
+        n /= 10;
+    } while (n);
+    while (k) *out++ = digits[--k];
+    return out;
 }
 
-static void buf_printf(HtmlBuf *b, const char *fmt, ...) {
-    va_list ap;
-    va_start(ap, fmt);
-    int avail = (int)(b->cap - b->len);
-    int needed = vsnprintf(b->buf + b->len, avail, fmt, ap);
-    va_end(ap);
-    if (needed < 0) return;
-    if ((size_t)needed >= (size_t)avail) {
-        buf_grow(b, b->len + needed + 1);
-        va_start(ap, fmt);
-        vsnprintf(b->buf + b->len, b->cap - b->len, fmt, ap);
-        va_end(ap);
+/* Upper bound on what node and its subtree write; *delims becomes the
+ * most delimiter records any one of their spans needs. */
+static size_t measure(const Node *node, size_t *delims) {
+    size_t n = NODE_MARKUP;
+    if (node->text_len) {
+        size_t escapes;
+        if (node->type == MLINDOWN_NODE_CODE_BLOCK) {
+            escapes = escape_count(node->text, node->text_len);
+        } else {
+            size_t d = inline_count_delims(node->text, node->text_len, &escapes);
+            if (d > *delims) *delims = d;
+            n += d * INLINE_GROWTH;
+        }
+        n += node->text_len + escapes * ESCAPE_GROWTH;
     }
-    b->len += needed;
+    n += node->info_len * (1 + ESCAPE_GROWTH);
+    for (const Node *c = node->first_child; c; c = c->next) n += measure(c, delims);
+    return n;
 }
 
-static void render_node_str(const Node *node, HtmlBuf *b) {
-    if (!node) return;
+static char *render_node(InlineScratch *inl, const Node *node, char *out);
 
+static char *render_children(InlineScratch *inl, const Node *node, char *out) {
+    for (const Node *c = node->first_child; c; c = c->next) out = render_node(inl, c, out);
+    return out;
+}
+
+static inline char *render_text(InlineScratch *inl, const Node *node, char *out) {
+    if (!node->text_len) return out;
+    return render_inline(inl, out, node->text, node->text_len);
+}
+
+/* Items of tight lists show their paragraphs without <p>; a block after
+ * such bare text starts on its own line. */
+static char *render_item(InlineScratch *inl, const Node *item, int tight, char *out) {
+    int bare = 0;
+    out = put_tag(out, OPEN[MLINDOWN_NODE_LIST_ITEM]);
+    for (const Node *c = item->first_child; c; c = c->next) {
+        if (tight && c->type == MLINDOWN_NODE_PARAGRAPH) {
+            out = render_text(inl, c, out);
+            bare = 1;
+            continue;
+        }
+        if (bare) *out++ = '\n';
+        out = render_node(inl, c, out);
+        bare = 0;
+    }
+    return put_tag(out, CLOSE[MLINDOWN_NODE_LIST_ITEM]);
+}
+
+static char *render_list(InlineScratch *inl, const Node *list, char *out) {
+    int tight = list->flags & MLINDOWN_LIST_TIGHT;
+    for (const Node *c = list->first_child; c; c = c->next) out = render_item(inl, c, tight, out);
+    return out;
+}
+
+static char *render_row(InlineScratch *inl, const Node *row, char *out) {
+    int header = row->level != 0;
+    out = put_tag(out, OPEN[MLINDOWN_NODE_TABLE_ROW]);
+    for (const Node *c = row->first_child; c; c = c->next) {
+        out = put_tag(out, CELL_OPEN[header][c->level]);
+        out = render_text(inl, c, out);
+        out = put_tag(out, CELL_CLOSE[header]);
+    }
+    return put_tag(out, CLOSE[MLINDOWN_NODE_TABLE_ROW]);
+}
+
+static char *render_node(InlineScratch *inl, const Node *node, char *out) {
     switch (node->type) {
     case MLINDOWN_NODE_DOCUMENT:
-        for (size_t i = 0; i < node->child_count; i++)
-            render_node_str(node->children[i], b);
-        break;
+        return render_children(inl, node, out);
 
     case MLINDOWN_NODE_HEADING:
-        buf_printf(b, "<h%d>%s</h%d>\n\n",
-                   node->level,
-                   node->text ? node->text : "",
-                   node->level);
-        break;
+        out = put_tag(out, HEADING_OPEN[node->level]);
+        out = render_text(inl, node, out);
+        return put_tag(out, HEADING_CLOSE[node->level]);
 
     case MLINDOWN_NODE_PARAGRAPH:
-        buf_printf(b, "<p>%s</p>\n\n",
-                   node->text ? node->text : "");
-        break;
+        out = put_tag(out, OPEN[node->type]);
+        out = render_text(inl, node, out);
+        return put_tag(out, CLOSE[node->type]);
 
     case MLINDOWN_NODE_LIST:
-        buf_printf(b, "<ul>\n");
-        for (size_t i = 0; i < node->child_count; i++)
-            render_node_str(node->children[i], b);
-        buf_printf(b, "</ul>\n\n");
-        break;
+        out = put_tag(out, OPEN[node->type]);
+        out = render_list(inl, node, out);
+        return put_tag(out, CLOSE[node->type]);
+
+    case MLINDOWN_NODE_ORDERED_LIST:
+        if (node->level == 1) {
+            out = put_tag(out, OPEN[node->type]);
+        } else {
+            out = PUT_LITERAL(out, "<ol start=\"");
+            out = put_number(out, node->level);
+            out = PUT_LITERAL(out, "\">\n");
+        }
+        out = render_list(inl, node, out);
+        return put_tag(out, CLOSE[node->type]);
 
     case MLINDOWN_NODE_LIST_ITEM:
-        buf_printf(b, "  <li>%s</li>\n",
-                   node->text ? node->text : "");
-        break;
+        return render_item(inl, node, 1, out);
+
+    case MLINDOWN_NODE_BLOCKQUOTE:
+        out = put_tag(out, OPEN[node->type]);
+        out = render_children(inl, node, out);
+        return put_tag(out, CLOSE[node->type]);
+
+    case MLINDOWN_NODE_CODE_BLOCK:
+        if (node->info) {
+            out = PUT_LITERAL(out, "<pre><code class=\"language-");
+            out = escape_html(out, node->info, node->info_len);
+            out = PUT_LITERAL(out, "\">");
+        } else {
+            out = put_tag(out, OPEN[node->type]);
+        }
+        out = escape_html(out, node->text, node->text_len);
+        return put_tag(out, CLOSE[node->type]);
+
+    case MLINDOWN_NODE_THEMATIC_BREAK:
+        return put_tag(out, OPEN[node->type]);
+
+    case MLINDOWN_NODE_TABLE: {
+        const Node *row = node->first_child;
+        out = put_tag(out, OPEN[node->type]);
+        if (row) out = render_row(inl, row, out);
+        out = PUT_LITERAL(out, "</thead>\n");
+        if (row && row->next) {
+            out = PUT_LITERAL(out, "<tbody>\n");
+            for (row = row->next; row; row = row->next) out = render_row(inl, row, out);
+            out = PUT_LITERAL(out, "</tbody>\n");
+        }
+        return put_tag(out, CLOSE[node->type]);
+    }
 
     default:
         /* ignore */
-        break;
+        return out;
     }
 }
 
-char *render_html_str(const Node *node) {
-    HtmlBuf buf;
-    buf_init(&buf);
-    if (!buf.buf) return NULL;
+char *render_html_str(Arena *arena, const Node *node, size_t *out_len) {
+    *out_len = 0;
+    if (!node) return NULL;
 
-    render_node_str(node, &buf);
-    /* shrink to fit */
-    buf.buf = realloc(buf.buf, buf.len + 1);
-    return buf.buf;
+    size_t delims = 0;
+    size_t bound = measure(node, &delims) + 1;
+    InlineScratch inl = {0};
+    if (!inline_reserve(&inl, arena, delims)) return NULL;
+
+    char *html = arena_alloc_aligned(arena, bound, 1);
+    if (!html) return NULL;
+
+    char *end = render_node(&inl, node, html);
+    *end = '\0';
+    *out_len = (size_t)(end - html);
+    arena_shrink(arena, html, bound, *out_len + 1);
+    return html;
 }
 
 void render_html(const Node *node, FILE *out) {
-    if (!node) return;
+    Arena arena;
+    arena_init(&arena, 4096);
 
-    switch (node->type) {
-        case MLINDOWN_NODE_DOCUMENT:
-            for (size_t i = 0; i < node->child_count; i++) {
-                render_html(node->children[i], out);
-            }
-            break;
-
-        case MLINDOWN_NODE_HEADING:
-            // <h1>…</h1> up to <h6>
-            fprintf(out, "<h%d>%s</h%d>\n\n",
-                    node->level,
-                    node->text ? node->text : "",
-                    node->level);
-            break;
-
-        case MLINDOWN_NODE_PARAGRAPH:
-            fprintf(out, "<p>%s</p>\n\n",
-                    node->text ? node->text : "");
-            break;
-
-        case MLINDOWN_NODE_LIST:
-            fprintf(out, "<ul>\n");
-            for (size_t i = 0; i < node->child_count; i++) {
-                render_html(node->children[i], out);
-            }
-            fprintf(out, "</ul>\n\n");
-            break;
-
-        case MLINDOWN_NODE_LIST_ITEM:
-            fprintf(out, "  <li>%s</li>\n",
-                    node->text ? node->text : "");
-            break;
-
-        default:
-            break;
-    }
-}
\ No newline at end of file
+    size_t len;
+    char *html = render_html_str(&arena, node, &len);
+    if (html) fwrite(html, 1, len, out);
+    arena_free(&arena);
+}
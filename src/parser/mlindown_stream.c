@@ -0,0 +1,276 @@
+#include <string.h>
+#include <stdint.h>
+#include "parser/mlindown_stream.h"
+#include "parser/mlindown_token.h"
+#include "parser/mlindown_inline.h"
+#include "parser/mlindown_escape.h"
+
+/* Most markup a single line can add around its text: closing the open
+ * block, then '<pre><code class="language-' and '">' for a fence line
+ * (close to the same for "<ol start=...>\n  <li>...</li>\n"). Together
+ * with INLINE_GROWTH per delimiter byte and ESCAPE_GROWTH per byte that
+ * needs escaping this bounds the output, so we allocate once and never
+ * check for room. */
+#define STREAM_LINE_OVERHEAD 40
+#define STREAM_TAIL_OVERHEAD 16
+
+typedef enum {
+    OPEN_NONE,
+    OPEN_PARAGRAPH,
+    OPEN_LIST,   /* a tight list of one-line items */
+    OPEN_CODE    /* a fenced code block */
+} OpenBlock;
+
+static inline char *emit(char *out, const char *s, size_t n) {
+    memcpy(out, s, n);
+    return out + n;
+}
+
+#define EMIT_LITERAL(out, lit) emit((out), (lit), sizeof(lit) - 1)
+
+/* A paragraph's lines are one contiguous span of the input, held back
+ * until the paragraph ends because emphasis and links may cross lines. */
+typedef struct {
+    size_t start, end;
+} Paragraph;
+
+static inline int is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\v' || c == '\f' || c == '\r';
+}
+
+/* The paragraph's text, without the trailing whitespace of its last line. */
+static size_t paragraph_length(const char *input, const Paragraph *para) {
+    size_t end = para->end;
+    while (end > para->start && is_space(input[end - 1])) end--;
+    return end - para->start;
+}
+
+static char *close_block(char *out, OpenBlock open, InlineScratch *inl,
+                         const char *input, const Paragraph *para, char list) {
+    if (open == OPEN_PARAGRAPH) {
+        out = EMIT_LITERAL(out, "<p>");
+        out = render_inline(inl, out, input + para->start, paragraph_length(input, para));
+        return EMIT_LITERAL(out, "</p>\n\n");
+    }
+    if (open == OPEN_LIST) {
+        if (list == '.' || list == ')') return EMIT_LITERAL(out, "</ol>\n\n");
+        return EMIT_LITERAL(out, "</ul>\n\n");
+    }
+    if (open == OPEN_CODE) return EMIT_LITERAL(out, "</code></pre>\n\n");
+    return out;
+}
+
+static char *open_heading(char *out, int level) {
+    out = EMIT_LITERAL(out, "<h");
+    *out++ = (char)('0' + level);
+    *out++ = '>';
+    return out;
+}
+
+static char *emit_number(char *out, int n) {
+    char digits[10];
+    int k = 0;
+    do {
+        digits[k++] = (char)('0' + n % 10);
+        n /= 10;
+    } while (n);
+    while (k) *out++ = digits[--k];
+    return out;
+}
+
+static char *close_heading(char *out, int level) {
+    out = EMIT_LITERAL(out, "</h");
+    *out++ = (char)('0' + level);
+    return EMIT_LITERAL(out, ">\n\n");
+}
+
+char *render_stream(Arena *arena, const char *input, size_t len, size_t *out_len) {
+    if (len > UINT32_MAX) len = UINT32_MAX;
+
+    size_t escapes;
+    size_t delims = inline_count_delims(input, len, &escapes);
+    InlineScratch inl = {0};
+    if (!inline_reserve(&inl, arena, delims)) return NULL;
+
+    size_t bound = len + index_count_lines(input, len) * STREAM_LINE_OVERHEAD +
+                   delims * INLINE_GROWTH + escapes * ESCAPE_GROWTH + STREAM_TAIL_OVERHEAD;
+    char *html = arena_alloc_aligned(arena, bound, 1);
+    if (!html) return NULL;
+
+    char *out = html;
+    OpenBlock open = OPEN_NONE;
+    Paragraph para = {0, 0};
+    char list = 0;        /* the open list's bullet, or its '.' / ')' */
+    int list_gap = 0;     /* blank lines since its last item */
+    char fence = 0;
+    size_t fence_len = 0, fence_indent = 0;
+    StructuralIndex idx;
+    index_init(&idx, input, len);
+    size_t pos = 0;
+
+    while (pos < len) {
+        size_t line = pos;
+        Token t = token_next(&idx, &pos);
+        const char *text = input + t.offset;
+        size_t end = t.offset + t.length;
+
+        if (open == OPEN_CODE) {
+            if (t.type == TOKEN_FENCE && t.marker == fence && t.level >= fence_len && t.length == 0) {
+                out = close_block(out, open, &inl, input, &para, list);
+                open = OPEN_NONE;
+                continue;
+            }
+            for (size_t i = 0; i < fence_indent && line < end &&
+                               (input[line] == ' ' || input[line] == '\t'); i++) line++;
+            out = escape_html(out, input + line, end - line);
+            *out++ = '\n';
+            continue;
+        }
+
+        /* Lines that might continue a list item (indented, lazy, or an
+         * item after a blank line, which makes the list loose) need the
+         * tree parser; anything else after a blank line ends the list. */
+        if (open == OPEN_LIST && t.type != TOKEN_BLANK) {
+            int item = (t.type == TOKEN_LIST_ITEM || t.type == TOKEN_ORDERED_ITEM) && t.marker == list;
+            if (t.indent > 0 || (list_gap && item)) goto fallback;
+            if (list_gap) {
+                out = close_block(out, open, &inl, input, &para, list);
+                open = OPEN_NONE;
+            }
+        }
+
+        switch (t.type) {
+        case TOKEN_HEADING: {
+            size_t n = token_heading_length(text, t.length);
+            out = close_block(out, open, &inl, input, &para, list);
+            open = OPEN_NONE;
+            out = open_heading(out, t.level);
+            out = render_inline(&inl, out, text, n);
+            out = close_heading(out, t.level);
+            break;
+        }
+
+        case TOKEN_BLANK:
+            if (open == OPEN_LIST) {
+                list_gap = 1;
+                break;
+            }
+            out = close_block(out, open, &inl, input, &para, list);
+            open = OPEN_NONE;
+            break;
+
+        case TOKEN_LIST_ITEM:
+        case TOKEN_ORDERED_ITEM: {
+            int ordered = t.type == TOKEN_ORDERED_ITEM;
+            int number = 0;
+            for (const char *d = text - t.level; ordered && t.length && *d >= '0' && *d <= '9'; d++) {
+                number = number * 10 + (*d - '0');
+            }
+            /* Empty items, and ordered ones not from 1, do not interrupt
+             * a paragraph. */
+            if (open == OPEN_PARAGRAPH && (t.length == 0 || (ordered && number != 1))) {
+                if (t.indent > 0) goto fallback;
+                para.end = end;
+                break;
+            }
+            /* Nested lists, empty items, and items that hold code or
+             * another block rather than a line of text. */
+            if (t.indent > 0 || t.length == 0) goto fallback;
+            Token content = token_classify(input, t.offset, end);
+            if (content.type != TOKEN_TEXT || content.indent > 0) goto fallback;
+
+            if (open != OPEN_LIST || (char)t.marker != list) {
+                out = close_block(out, open, &inl, input, &para, list);
+                if (!ordered) {
+                    out = EMIT_LITERAL(out, "<ul>\n");
+                } else if (number == 1) {
+                    out = EMIT_LITERAL(out, "<ol>\n");
+                } else {
+                    out = EMIT_LITERAL(out, "<ol start=\"");
+                    out = emit_number(out, number);
+                    out = EMIT_LITERAL(out, "\">\n");
+                }
+                open = OPEN_LIST;
+                list = (char)t.marker;
+            }
+            list_gap = 0;
+            out = EMIT_LITERAL(out, "  <li>");
+            out = render_inline(&inl, out, text, t.length);
+            out = EMIT_LITERAL(out, "</li>\n");
+            break;
+        }
+
+        case TOKEN_FENCE: {
+            size_t info = token_info_length(text, t.length);
+            out = close_block(out, open, &inl, input, &para, list);
+            open = OPEN_CODE;
+            fence = (char)t.marker;
+            fence_len = t.level;
+            fence_indent = t.indent;
+            if (info) {
+                out = EMIT_LITERAL(out, "<pre><code class=\"language-");
+                out = escape_html(out, text, info);
+                out = EMIT_LITERAL(out, "\">");
+            } else {
+                out = EMIT_LITERAL(out, "<pre><code>");
+            }
+            break;
+        }
+
+        case TOKEN_BREAK:
+            out = close_block(out, open, &inl, input, &para, list);
+            open = OPEN_NONE;
+            out = EMIT_LITERAL(out, "<hr />\n\n");
+            break;
+
+        case TOKEN_UNDERLINE: {
+            /* A setext heading takes the paragraph above as its text. */
+            if (open == OPEN_PARAGRAPH) {
+                int level = t.marker == '=' ? 1 : 2;
+                out = open_heading(out, level);
+                out = render_inline(&inl, out, input + para.start, paragraph_length(input, &para));
+                out = close_heading(out, level);
+                open = OPEN_NONE;
+                break;
+            }
+            if (t.marker == '-' && t.level >= 3) {
+                out = close_block(out, open, &inl, input, &para, list);
+                open = OPEN_NONE;
+                out = EMIT_LITERAL(out, "<hr />\n\n");
+                break;
+            }
+            if (t.marker == '-' && t.level == 1) goto fallback;  /* an empty item */
+            /* "==" and "--" are text. */
+        }
+        /* fall through */
+        case TOKEN_TEXT:
+            if (open == OPEN_LIST) goto fallback;
+            /* A continuation line drops its indentation, which would cut
+             * the paragraph's span. */
+            if (open == OPEN_PARAGRAPH && t.indent > 0) goto fallback;
+            if (open != OPEN_PARAGRAPH) {
+                if (t.indent >= 4) goto fallback;  /* indented code */
+                out = close_block(out, open, &inl, input, &para, list);
+                open = OPEN_PARAGRAPH;
+                para.start = t.offset;
+            }
+            para.end = end;
+            break;
+
+        default:
+            /* Block quotes and tables. */
+            goto fallback;
+        }
+    }
+
+    out = close_block(out, open, &inl, input, &para, list);
+    *out = '\0';
+    *out_len = (size_t)(out - html);
+    arena_shrink(arena, html, bound, *out_len + 1);
+    return html;
+
+fallback:
+    /* Not expressible in one pass: hand the page to the AST path. */
+    arena_shrink(arena, html, bound, 0);
+    return NULL;
+}
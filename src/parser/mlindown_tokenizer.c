@@ -1,82 +1,223 @@
-#include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
 #include "parser/mlindown_token.h"
-#include "utils/simd.h"
+#include "parser/mlindown_index.h"
 
-static char *ltrim(char *s) {
-    while (isspace((unsigned char)*s)) s++;
-    return s;
+static Token make_token(TokenType type, size_t level, size_t indent, int marker,
+                        size_t text, size_t end) {
+    Token t = {
+        .offset = (uint32_t)text,
+        .length = (uint32_t)(end - text),
+        .type   = (uint8_t)type,
+        .level  = (uint8_t)(level < 255 ? level : 255),
+        .indent = (uint8_t)(indent < 255 ? indent : 255),
+        .marker = (uint8_t)marker,
+    };
+    return t;
 }
 
-static void append_token(TokenList *tl, Token t) {
-    Token *new_data = realloc(tl->data, (tl->count + 1) * sizeof(Token));
-    if (!new_data) {
-        /* OOM: drop the token */
-        if (t.text) free(t.text);
-        return;
+/* The structural index's whitespace class. */
+static inline int is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\v' || c == '\f' || c == '\r';
+}
+
+static size_t skip_space(const char *input, size_t pos, size_t end) {
+    while (pos < end && is_space(input[pos])) pos++;
+    return pos;
+}
+
+static size_t run_length(const char *input, size_t pos, size_t end, char c) {
+    size_t n = 0;
+    while (pos + n < end && input[pos + n] == c) n++;
+    return n;
+}
+
+/* Tabs stop every four columns. */
+static size_t indent_columns(const char *input, size_t start, size_t trimmed) {
+    size_t col = 0;
+    for (size_t i = start; i < trimmed; i++) {
+        col = input[i] == '\t' ? (col / 4 + 1) * 4 : col + 1;
     }
-    tl->data = new_data;
-    tl->data[tl->count++] = t;
+    return col;
 }
 
-TokenList tokenize(const char *input) {
-    TokenList tl = { .data = NULL, .count = 0 };
-    const char *line_start = input;
-    while (*line_start) {
-        const char *newline = simd_strchr(line_start, '\n');
-        size_t len = newline ? (size_t)(newline - line_start) : strlen(line_start);
-
-        char *buf = malloc(len + 1);
-        memcpy(buf, line_start, len);
-        buf[len] = '\0';
-
-        Token tok = { .type = TOKEN_TEXT, .level = 0, .text = NULL };
-        char *trimmed = buf;
-        while (*trimmed && isspace((unsigned char)*trimmed)) trimmed++;
-        if (*trimmed == '\0') {
-            tok.type = TOKEN_BLANK;
-            tok.text = NULL;
-            free(buf);
-        }
-        else if (trimmed[0] == '#') {
-            int lvl = 0;
-            while (trimmed[lvl] == '#' && lvl < 6) lvl++;
-            char *rest = trimmed + lvl;
-            if (*rest == ' ') rest++;
-            tok.type  = TOKEN_HEADING;
-            tok.level = lvl;
-            tok.text  = strdup(rest);
-            free(buf);
-        }
-        else if (trimmed[0] == '-' && isspace((unsigned char)trimmed[1])) {
-            char *rest = trimmed + 2;  /* skip "- " */
-            tok.type  = TOKEN_LIST_ITEM;
-            tok.level = 0;
-            tok.text  = strdup(ltrim(rest));
-            free(buf);
+/* Three or more c, with nothing else on the line but whitespace. */
+static int is_break(const char *input, size_t pos, size_t end, char c) {
+    size_t n = 0;
+    for (; pos < end; pos++) {
+        if (input[pos] == c) n++;
+        else if (!is_space(input[pos])) return 0;
+    }
+    return n >= 3;
+}
+
+/* Hyphens with an optional colon at either end. */
+static int is_delim_cell(const char *input, size_t start, size_t end) {
+    start = skip_space(input, start, end);
+    while (end > start && is_space(input[end - 1])) end--;
+    if (start < end && input[start] == ':') start++;
+    if (end > start && input[end - 1] == ':') end--;
+    if (start == end) return 0;
+    for (; start < end; start++) {
+        if (input[start] != '-') return 0;
+    }
+    return 1;
+}
+
+/* Delimiter cells split by pipes, with optional pipes at both ends. A row
+ * needs a pipe somewhere so "---" stays a break. */
+static int is_table_delim(const char *input, size_t pos, size_t end) {
+    int pipes = 0, cells = 0;
+    while (end > pos && is_space(input[end - 1])) end--;
+    if (input[pos] == '|') {
+        pos++;
+        pipes++;
+    }
+    size_t cell = pos;
+    for (size_t i = pos; i <= end; i++) {
+        if (i < end && input[i] != '|') continue;
+        if (i == end && i == cell && pipes) break;  /* trailing pipe */
+        if (!is_delim_cell(input, cell, i)) return 0;
+        cells++;
+        pipes += i < end;
+        cell = i + 1;
+    }
+    return pipes > 0 && cells > 0;
+}
+
+/* Marker byte, padding and content of a list item whose marker of width w
+ * starts at trimmed. An item whose content starts five or more columns in
+ * has one space of padding; the rest is indented code inside it. */
+static Token list_item(TokenType type, const char *input, size_t trimmed, size_t w,
+                       size_t end, size_t indent) {
+    char marker = input[trimmed + w - 1];
+    size_t text = trimmed + w;
+    size_t content = skip_space(input, text, end);
+    if (content == end) return make_token(type, w + 1, indent, marker, end, end);
+    if (content - text >= 5) return make_token(type, w + 1, indent, marker, text + 1, end);
+    return make_token(type, w + (content - text), indent, marker, content, end);
+}
+
+/* Lines whose first non-space byte is a block marker, indented less than
+ * four columns. */
+static Token classify_marker(const char *input, size_t trimmed, size_t end, size_t indent) {
+    char c = input[trimmed];
+    Token text = make_token(TOKEN_TEXT, 0, indent, 0, trimmed, end);
+
+    if (c == '#') {
+        size_t lvl = run_length(input, trimmed, end, '#');
+        size_t rest = trimmed + lvl;
+        if (lvl > 6 || (rest < end && input[rest] != ' ' && input[rest] != '\t')) return text;
+        return make_token(TOKEN_HEADING, lvl, indent, '#', skip_space(input, rest, end), end);
+    }
+    if (c == '>') {
+        size_t rest = trimmed + 1;
+        if (rest < end && (input[rest] == ' ' || input[rest] == '\t')) rest++;
+        return make_token(TOKEN_QUOTE, 0, indent, '>', rest, end);
+    }
+    if (c == '`' || c == '~') {
+        size_t run = run_length(input, trimmed, end, c);
+        if (run < 3) return text;
+        size_t info = skip_space(input, trimmed + run, end);
+        if (c == '`' && memchr(input + info, '`', end - info)) return text;
+        return make_token(TOKEN_FENCE, run, indent, c, info, end);
+    }
+    if (c == '=' || c == '-') {
+        size_t run = run_length(input, trimmed, end, c);
+        if (skip_space(input, trimmed + run, end) == end) {
+            return make_token(TOKEN_UNDERLINE, run, indent, c, trimmed, end);
         }
-        else {
-            tok.type  = TOKEN_TEXT;
-            tok.level = 0;
-            tok.text  = buf;  /* take ownership */
+    }
+    if ((c == '-' || c == '*' || c == '_') && is_break(input, trimmed, end, c)) {
+        return make_token(TOKEN_BREAK, 0, indent, c, trimmed, end);
+    }
+    if ((c == '-' || c == '*' || c == '+') &&
+        (trimmed + 1 == end || input[trimmed + 1] == ' ' || input[trimmed + 1] == '\t')) {
+        return list_item(TOKEN_LIST_ITEM, input, trimmed, 1, end, indent);
+    }
+    if (c >= '0' && c <= '9') {
+        size_t digits = 1;
+        while (digits < 9 && trimmed + digits < end &&
+               input[trimmed + digits] >= '0' && input[trimmed + digits] <= '9') digits++;
+        size_t delim = trimmed + digits;
+        if (delim < end && (input[delim] == '.' || input[delim] == ')') &&
+            (delim + 1 == end || input[delim + 1] == ' ' || input[delim + 1] == '\t')) {
+            return list_item(TOKEN_ORDERED_ITEM, input, trimmed, digits + 1, end, indent);
         }
+        return text;
+    }
+    if ((c == '|' || c == ':' || c == '-') && is_table_delim(input, trimmed, end)) {
+        return make_token(TOKEN_TABLE_DELIM, 0, indent, c, trimmed, end);
+    }
+    return text;
+}
 
-        append_token(&tl, tok);
+Token token_next(StructuralIndex *idx, size_t *pos) {
+    /* Skip the indent and read the marker bit before looking for the line
+     * end, so the cursor only ever moves forward through the blocks. */
+    size_t line_start = *pos;
+    size_t trimmed = index_skip_space(idx, line_start, idx->len);
+    int marker = trimmed < idx->len && index_is_marker(idx, trimmed);
+    size_t end = index_next_newline(idx, trimmed);
+    *pos = end + 1;
 
-        if (!newline) break;
-        line_start = newline + 1;
+    if (trimmed == end) {
+        return make_token(TOKEN_BLANK, 0, 0, 0, end, end);
     }
+    size_t indent = trimmed == line_start ? 0 : indent_columns(idx->input, line_start, trimmed);
+    /* Lines that open with plain text never touch the bytes. */
+    if (!marker || indent >= 4) {
+        return make_token(TOKEN_TEXT, 0, indent, 0, trimmed, end);
+    }
+    return classify_marker(idx->input, trimmed, end, indent);
+}
 
-    return tl;
+Token token_classify(const char *input, size_t start, size_t end) {
+    size_t trimmed = skip_space(input, start, end);
+    if (trimmed == end) {
+        return make_token(TOKEN_BLANK, 0, 0, 0, end, end);
+    }
+    size_t indent = indent_columns(input, start, trimmed);
+    if (indent >= 4) {
+        return make_token(TOKEN_TEXT, 0, indent, 0, trimmed, end);
+    }
+    return classify_marker(input, trimmed, end, indent);
 }
 
-void free_tokens(TokenList *tl) {
-    if (!tl) return;
-    for (size_t i = 0; i < tl->count; i++) {
-        free(tl->data[i].text);
+size_t token_heading_length(const char *text, size_t len) {
+    while (len > 0 && is_space(text[len - 1])) len--;
+    size_t hashes = len;
+    while (hashes > 0 && text[hashes - 1] == '#') hashes--;
+    /* "# foo #" closes; "# foo#" is part of the text. */
+    if (hashes < len && (hashes == 0 || is_space(text[hashes - 1]))) {
+        len = hashes;
+        while (len > 0 && is_space(text[len - 1])) len--;
     }
-    free(tl->data);
-    tl->data  = NULL;
-    tl->count = 0;
-}
\ No newline at end of file
+    return len;
+}
+
+size_t token_info_length(const char *text, size_t len) {
+    size_t n = 0;
+    while (n < len && !is_space(text[n])) n++;
+    return n;
+}
+
+TokenList tokenize(Arena *arena, const char *input, size_t len) {
+    if (len > UINT32_MAX) len = UINT32_MAX;
+    TokenList tl = { .data = NULL, .count = 0, .source = input, .length = len };
+
+    size_t lines = index_count_lines(input, len);
+    if (lines == 0) return tl;
+
+    tl.data = ARENA_ALLOC_ARRAY(arena, Token, lines);
+    if (!tl.data) return tl;
+
+    StructuralIndex idx;
+    index_init(&idx, input, len);
+
+    size_t pos = 0;
+    while (pos < len) {
+        tl.data[tl.count++] = token_next(&idx, &pos);
+    }
+
+    return tl;
+}
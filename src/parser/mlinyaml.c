@@ -5,6 +5,7 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <string.h>
+#include <stdlib.h>
 #include "utils/simd.h"
 #include <stdio.h>
 
@@ -110,6 +111,19 @@ int parse_yaml(const char* filename, YamlConfig* config) {
             else if (key_len == 8 && !memcmp(key_start, "template", 8)) {
                 config->tmpl = strndup(value_start, value_len);
             }
+            else if (key_len == 18 && !memcmp(key_start, "template_directory", 18)) {
+                config->template_dir = strndup(value_start, value_len);
+            }
+            else if (key_len == 7 && !memcmp(key_start, "threads", 7)) {
+                config->threads = atoi(value_start);
+            }
+            // Off by default: a page edited in place leaves its directory's
+            // mtime alone, so with this on it is not rebuilt. See README.md.
+            else if (key_len == 22 && !memcmp(key_start, "trust_directory_mtimes", 22)) {
+                config->trust_dir_mtimes = (value_len == 4 && !memcmp(value_start, "true", 4)) ||
+                                           (value_len == 3 && !memcmp(value_start, "yes", 3)) ||
+                                           (value_len == 1 && value_start[0] == '1');
+            }
         }
 
         p = line_end + 1;
@@ -0,0 +1,506 @@
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "parser/template.h"
+#include "parser/mlindown_escape.h"
+#include "utils/hash.h"
+#include "utils/mmap.h"
+#include "utils/path.h"
+
+// Sections inside sections, and partials inside partials.
+#define TEMPLATE_MAX_DEPTH 16
+
+// Literals and content this long go out as slices of their own; shorter
+// ones are copied into the page's run of written bytes, so a page stays a
+// handful of slices however many tags its template has.
+#define SLICE_MIN 256
+
+typedef struct {
+    Template* tpl;
+    size_t capacity;
+    size_t source_capacity;
+    uint32_t open[TEMPLATE_MAX_DEPTH];   // sections not yet closed
+    int open_count;
+    HashState hash;
+} Compiler;
+
+static int add_source(Compiler* c, char* source) {
+    Template* t = c->tpl;
+    if (t->source_count == c->source_capacity) {
+        size_t capacity = c->source_capacity ? c->source_capacity * 2 : 8;
+        char** sources = realloc(t->sources, capacity * sizeof(char*));
+        if (!sources) return 0;
+        t->sources = sources;
+        c->source_capacity = capacity;
+    }
+    t->sources[t->source_count++] = source;
+    return 1;
+}
+
+static TemplateInstr* add_instr(Compiler* c, TemplateOp op, const char* text, size_t len) {
+    Template* t = c->tpl;
+    if (t->count == c->capacity) {
+        size_t capacity = c->capacity ? c->capacity * 2 : 32;
+        TemplateInstr* code = realloc(t->code, capacity * sizeof(TemplateInstr));
+        if (!code) return NULL;
+        t->code = code;
+        c->capacity = capacity;
+    }
+    TemplateInstr* in = &t->code[t->count++];
+    *in = (TemplateInstr){ .op = (uint8_t)op, .text = text, .len = len };
+    return in;
+}
+
+// A variable or section: key names are kept NUL-terminated for
+// frontmatter_get.
+static TemplateInstr* add_slot(Compiler* c, TemplateOp op, const char* name, size_t len) {
+    TemplateSlot slot = TPL_SLOT_FIELD;
+    char* key = NULL;
+    if (len == 7 && memcmp(name, "content", 7) == 0) {
+        slot = TPL_SLOT_CONTENT;
+    } else if (len == 1 && name[0] == '.') {
+        slot = TPL_SLOT_ITEM;
+    } else {
+        key = strndup(name, len);
+        if (!key || !add_source(c, key)) {
+            free(key);
+            return NULL;
+        }
+    }
+    TemplateInstr* in = add_instr(c, op, key, len);
+    if (in) in->slot = (uint8_t)slot;
+    return in;
+}
+
+static char* read_file(const char* path, size_t* len) {
+    MappedFile file = mmap_file(path);
+    if (!file.data) return NULL;
+    char* copy = malloc(file.size + 1);
+    if (copy) {
+        memcpy(copy, file.data, file.size);
+        copy[file.size] = '\0';
+        *len = file.size;
+    }
+    munmap_file(file);
+    return copy;
+}
+
+static void trim(const char** start, const char** end) {
+    while (*start < *end && (**start == ' ' || **start == '\t' || **start == '\n')) (*start)++;
+    while (*end > *start && ((*end)[-1] == ' ' || (*end)[-1] == '\t' || (*end)[-1] == '\n')) (*end)--;
+}
+
+// The partial's path: beside path, with ".html" added when it has no
+// extension of its own.
+static int partial_path(char* out, const char* path, const char* name, size_t len) {
+    const char* slash = strrchr(path, '/');
+    int dir_len = slash ? (int)(slash - path + 1) : 0;
+    const char* base = memrchr(name, '/', len);
+    base = base ? base + 1 : name;
+    const char* ext = memchr(base, '.', len - (size_t)(base - name)) ? "" : ".html";
+    int n = snprintf(out, PATH_MAX, "%.*s%.*s%s", dir_len, path, (int)len, name, ext);
+    return n > 0 && n < PATH_MAX;
+}
+
+static int compile_file(Compiler* c, const char* path, int depth) {
+    size_t len = 0;
+    char* text = read_file(path, &len);
+    if (!text) {
+        fprintf(stderr, "Cannot read template: %s\n", path);
+        return 0;
+    }
+    if (!add_source(c, text)) {
+        free(text);
+        return 0;
+    }
+    hash_feed(&c->hash, text, len);
+
+    int base = c->open_count;   // sections close in the file that opened them
+    const char* p = text;
+    const char* end = text + len;
+    while (p < end) {
+        const char* tag = memmem(p, (size_t)(end - p), "{{", 2);
+        const char* literal_end = tag ? tag : end;
+        if (literal_end > p && !add_instr(c, TPL_TEXT, p, (size_t)(literal_end - p))) return 0;
+        if (!tag) break;
+
+        int triple = tag + 2 < end && tag[2] == '{';
+        const char* name = tag + 2 + triple;
+        const char* close = memmem(name, (size_t)(end - name), triple ? "}}}" : "}}", 2 + triple);
+        if (!close) {
+            fprintf(stderr, "%s: unclosed {{\n", path);
+            return 0;
+        }
+        p = close + 2 + triple;
+
+        const char* name_end = close;
+        trim(&name, &name_end);
+        char kind = triple ? '{' : name < name_end ? *name : 0;
+        if (!triple && kind && strchr("#^/>!&", kind)) {
+            name++;
+            trim(&name, &name_end);
+        } else if (!triple) {
+            kind = 0;
+        }
+        size_t name_len = (size_t)(name_end - name);
+        if (kind == '!') continue;
+        if (name_len == 0) {
+            fprintf(stderr, "%s: empty {{ }} tag\n", path);
+            return 0;
+        }
+
+        switch (kind) {
+        case '>': {
+            char partial[PATH_MAX];
+            if (depth + 1 >= TEMPLATE_MAX_DEPTH) {
+                fprintf(stderr, "%s: partials nested too deep\n", path);
+                return 0;
+            }
+            if (!partial_path(partial, path, name, name_len) ||
+                !compile_file(c, partial, depth + 1)) return 0;
+            break;
+        }
+        case '#':
+        case '^':
+            if (c->open_count == TEMPLATE_MAX_DEPTH) {
+                fprintf(stderr, "%s: sections nested too deep\n", path);
+                return 0;
+            }
+            if (!add_slot(c, kind == '#' ? TPL_SECTION : TPL_INVERTED, name, name_len)) return 0;
+            c->open[c->open_count++] = (uint32_t)(c->tpl->count - 1);
+            break;
+        case '/': {
+            TemplateInstr* open = c->open_count > base ? &c->tpl->code[c->open[c->open_count - 1]] : NULL;
+            size_t open_len = open ? (open->slot == TPL_SLOT_FIELD ? strlen(open->text) : open->len) : 0;
+            if (!open || open_len != name_len ||
+                (open->slot == TPL_SLOT_FIELD && memcmp(open->text, name, name_len) != 0)) {
+                fprintf(stderr, "%s: {{/%.*s}} closes no section\n", path, (int)name_len, name);
+                return 0;
+            }
+            uint32_t start = c->open[--c->open_count];
+            TemplateInstr* in = add_instr(c, TPL_END, NULL, 0);
+            if (!in) return 0;
+            in->jump = start;
+            c->tpl->code[start].jump = (uint32_t)c->tpl->count;
+            break;
+        }
+        default:
+            if (!add_slot(c, kind ? TPL_RAW : TPL_VAR, name, name_len)) return 0;
+        }
+    }
+
+    if (c->open_count > base) {
+        const TemplateInstr* open = &c->tpl->code[c->open[c->open_count - 1]];
+        fprintf(stderr, "%s: section {{#%s}} is never closed\n", path,
+                open->slot == TPL_SLOT_FIELD ? open->text : open->slot == TPL_SLOT_CONTENT ? "content" : ".");
+        return 0;
+    }
+    return 1;
+}
+
+int template_compile(Template* tpl, const char* path) {
+    memset(tpl, 0, sizeof(*tpl));
+    Compiler c = { .tpl = tpl };
+    hash_init(&c.hash);
+    if (compile_file(&c, path, 0)) {
+        tpl->hash = hash_final(&c.hash);
+        return 1;
+    }
+    template_free(tpl);
+    return 0;
+}
+
+void template_free(Template* tpl) {
+    for (size_t i = 0; i < tpl->source_count; i++) free(tpl->sources[i]);
+    free(tpl->sources);
+    free(tpl->code);
+    memset(tpl, 0, sizeof(*tpl));
+}
+
+// Pages are run twice, like the markdown renderer: once to size the
+// written bytes, once to write them. Both passes make the same slices.
+typedef struct {
+    struct iovec* slices;
+    int count;
+    int max;
+    char* buf;         // NULL while measuring
+    size_t used;       // bytes written, or their upper bound
+    size_t run;        // where the current run of written bytes starts
+} Emitter;
+
+typedef struct {
+    uint32_t start;                  // the section instruction
+    const FrontMatterSpan* items;    // NULL: {{.}} is the enclosing item
+    size_t count;
+    size_t index;
+} Frame;
+
+static void flush_run(Emitter* e) {
+    if (e->used == e->run) return;
+    if (e->buf) e->slices[e->count] = (struct iovec){ e->buf + e->run, e->used - e->run };
+    e->count++;
+    e->run = e->used;
+}
+
+static void emit_copy(Emitter* e, const char* s, size_t len) {
+    if (e->buf && len) memcpy(e->buf + e->used, s, len);
+    e->used += len;
+}
+
+static void emit_escaped(Emitter* e, const char* s, size_t len) {
+    if (e->buf) {
+        e->used = (size_t)(escape_html(e->buf + e->used, s, len) - e->buf);
+    } else {
+        e->used += len + escape_count(s, len) * ESCAPE_GROWTH;
+    }
+}
+
+// Bytes that outlive the page: a slice of their own while one is left
+// after it for the bytes that follow.
+static void emit_ref(Emitter* e, const char* s, size_t len) {
+    if (len == 0) return;
+    if (len >= SLICE_MIN && e->count + (e->used > e->run) + 2 <= e->max) {
+        flush_run(e);
+        if (e->buf) e->slices[e->count] = (struct iovec){ (void*)s, len };
+        e->count++;
+        return;
+    }
+    emit_copy(e, s, len);
+}
+
+static void emit_span(Emitter* e, FrontMatterSpan s, int escape) {
+    if (escape) emit_escaped(e, s.data, s.len);
+    else emit_copy(e, s.data, s.len);
+}
+
+static const FrontMatterSpan* current_item(const Frame* frames, int depth) {
+    for (int i = depth - 1; i >= 0; i--) {
+        if (frames[i].items) return &frames[i].items[frames[i].index];
+    }
+    return NULL;
+}
+
+// What a section over the slot walks: count is 0 when the value is
+// missing, empty or false. Values that are not lists are one item.
+static size_t section_items(const TemplateInstr* in, const FrontMatter* fm, size_t content_len,
+                            const Frame* frames, int depth, const FrontMatterSpan** items) {
+    *items = NULL;
+    if (in->slot == TPL_SLOT_CONTENT) return content_len > 0;
+    if (in->slot == TPL_SLOT_ITEM) {
+        *items = current_item(frames, depth);
+        return *items && (*items)->len > 0;
+    }
+
+    const FrontMatterField* f = frontmatter_get(fm, in->text);
+    if (!f) return 0;
+    if (f->type == FM_LIST) {
+        *items = f->items;
+        return f->item_count;
+    }
+    if (f->type == FM_BOOL) return f->number != 0;
+    *items = &f->value;
+    return f->value.len > 0;
+}
+
+static void emit_slot(Emitter* e, const TemplateInstr* in, const FrontMatter* fm,
+                      const char* content, size_t content_len, const Frame* frames, int depth) {
+    int escape = in->op == TPL_VAR;
+    if (in->slot == TPL_SLOT_CONTENT) {
+        emit_ref(e, content, content_len);
+    } else if (in->slot == TPL_SLOT_ITEM) {
+        const FrontMatterSpan* item = current_item(frames, depth);
+        if (item) emit_span(e, *item, escape);
+    } else {
+        const FrontMatterField* f = frontmatter_get(fm, in->text);
+        if (f && f->type == FM_LIST) {
+            for (size_t i = 0; i < f->item_count; i++) {
+                if (i) emit_copy(e, ", ", 2);
+                emit_span(e, f->items[i], escape);
+            }
+        } else if (f) {
+            emit_span(e, f->value, escape);
+        }
+    }
+}
+
+static void run(const Template* tpl, const FrontMatter* fm, const char* content,
+                size_t content_len, Emitter* e) {
+    Frame frames[TEMPLATE_MAX_DEPTH];
+    int depth = 0;
+
+    for (size_t i = 0; i < tpl->count;) {
+        const TemplateInstr* in = &tpl->code[i];
+        const FrontMatterSpan* items;
+        size_t count;
+
+        switch (in->op) {
+        case TPL_TEXT:
+            emit_ref(e, in->text, in->len);
+            i++;
+            break;
+        case TPL_VAR:
+        case TPL_RAW:
+            emit_slot(e, in, fm, content, content_len, frames, depth);
+            i++;
+            break;
+        case TPL_SECTION:
+            count = section_items(in, fm, content_len, frames, depth, &items);
+            if (count == 0) {
+                i = in->jump;
+                break;
+            }
+            frames[depth++] = (Frame){ (uint32_t)i, items, count, 0 };
+            i++;
+            break;
+        case TPL_INVERTED:
+            if (section_items(in, fm, content_len, frames, depth, &items) != 0) {
+                i = in->jump;
+                break;
+            }
+            frames[depth++] = (Frame){ (uint32_t)i, NULL, 1, 0 };
+            i++;
+            break;
+        case TPL_END: {
+            Frame* f = &frames[depth - 1];
+            if (++f->index < f->count) {
+                i = f->start + 1;
+            } else {
+                depth--;
+                i++;
+            }
+            break;
+        }
+        }
+    }
+    flush_run(e);
+}
+
+int template_render(const Template* tpl, const FrontMatter* fm,
+                    const char* content, size_t content_len,
+                    Arena* arena, struct iovec* slices, int max_slices) {
+    Emitter e = { .slices = slices, .max = max_slices };
+    run(tpl, fm, content, content_len, &e);
+
+    size_t bound = e.used;
+    char* buf = NULL;
+    if (bound) {
+        buf = arena_alloc_aligned(arena, bound, 1);
+        if (!buf) return -1;
+    }
+
+    e = (Emitter){ .slices = slices, .max = max_slices, .buf = buf };
+    run(tpl, fm, content, content_len, &e);
+    if (buf) arena_shrink(arena, buf, bound, e.used);
+    return e.count;
+}
+
+static int registry_add(TemplateRegistry* reg, const char* path, const char* name, size_t len) {
+    TemplateEntry* entry = calloc(1, sizeof(TemplateEntry));
+    if (!entry) return 0;
+    entry->name = strndup(name, len);
+    if (!entry->name || !template_compile(&entry->tpl, path)) {
+        free(entry->name);
+        free(entry);
+        return 0;
+    }
+    HASH_ADD_KEYPTR(hh, reg->entries, entry->name, len, entry);
+    reg->count++;
+    return 1;
+}
+
+// Lists dir/rel, where rel is "" or ends with '/', and compiles its
+// templates. Directories are few and shallow, so this just recurses.
+static int registry_scan(TemplateRegistry* reg, const char* dir, const char* rel, int depth) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", dir, rel);
+    DIR* d = opendir(path);
+    if (!d) {
+        fprintf(stderr, "Cannot open template directory: %s\n", path);
+        return 0;
+    }
+
+    int ok = 1;
+    struct dirent* entry;
+    while (ok && (entry = readdir(d)) != NULL) {
+        if (entry->d_name[0] == '.') continue;
+
+        char name[PATH_MAX];
+        int len = snprintf(name, sizeof(name), "%s%s", rel, entry->d_name);
+        int path_len = snprintf(path, sizeof(path), "%s/%s", dir, name);
+        if (len <= 0 || len >= PATH_MAX - 1 || path_len <= 0 || path_len >= PATH_MAX) continue;
+
+        int is_dir = entry->d_type == DT_DIR;
+        int is_file = entry->d_type == DT_REG;
+        if (entry->d_type == DT_UNKNOWN || entry->d_type == DT_LNK) {
+            struct stat st;
+            if (stat(path, &st) != 0) continue;
+            is_dir = S_ISDIR(st.st_mode);
+            is_file = S_ISREG(st.st_mode);
+        }
+
+        if (is_dir && depth + 1 < TEMPLATE_MAX_DEPTH) {
+            name[len] = '/';
+            name[len + 1] = '\0';
+            ok = registry_scan(reg, dir, name, depth + 1);
+        } else if (is_file && len > 5 && strcmp(name + len - 5, ".html") == 0) {
+            ok = registry_add(reg, path, name, (size_t)len - 5);
+        }
+    }
+    closedir(d);
+    return ok;
+}
+
+int template_registry_load(TemplateRegistry* reg, const char* dir) {
+    memset(reg, 0, sizeof(*reg));
+    if (registry_scan(reg, dir, "", 0)) return 1;
+    template_registry_free(reg);
+    return 0;
+}
+
+void template_registry_free(TemplateRegistry* reg) {
+    TemplateEntry *entry, *tmp;
+    HASH_ITER(hh, reg->entries, entry, tmp) {
+        HASH_DEL(reg->entries, entry);
+        template_free(&entry->tpl);
+        free(entry->name);
+        free(entry);
+    }
+    reg->count = 0;
+}
+
+const Template* template_registry_find(const TemplateRegistry* reg, const char* name, size_t len) {
+    TemplateEntry* entry = NULL;
+    HASH_FIND(hh, reg->entries, name, len, entry);
+    return entry ? &entry->tpl : NULL;
+}
+
+const Template* template_layout(const TemplateRegistry* reg, FrontMatterSpan layout) {
+    size_t len = layout.len;
+    if (len > 5 && memcmp(layout.data + len - 5, ".html", 5) == 0) len -= 5;
+    return len ? template_registry_find(reg, layout.data, len) : NULL;
+}
+
+const Template* template_select(const TemplateRegistry* reg, FrontMatterSpan layout,
+                                const char* rel_path, const Template* fallback) {
+    const Template* tpl = template_layout(reg, layout);
+    if (tpl) return tpl;
+
+    char name[PATH_MAX];
+    const char* slash = strrchr(rel_path, '/');
+    size_t dir_len = slash ? (size_t)(slash - rel_path) : 0;
+    for (;;) {
+        int len = snprintf(name, sizeof(name), "%.*s%sdefault", (int)dir_len, rel_path,
+                           dir_len ? "/" : "");
+        if (len > 0 && len < PATH_MAX) {
+            tpl = template_registry_find(reg, name, (size_t)len);
+            if (tpl) return tpl;
+        }
+        if (dir_len == 0) break;
+        const char* up = memrchr(rel_path, '/', dir_len);
+        dir_len = up ? (size_t)(up - rel_path) : 0;
+    }
+    return fallback;
+}
@@ -46,24 +46,32 @@ void* arena_alloc_aligned(Arena* arena, size_t size, size_t alignment) {
     if (size == 0) return NULL;
     
     ArenaBlock* block = arena->current;
-    size_t aligned_size = align_forward(size, alignment);
+    size_t offset = align_forward(block->used, alignment);
     
-    if (block->used + aligned_size > block->capacity) {
+    // Blocks past current are left over from before a reset; use them
+    // before asking malloc for more.
+    while (offset + size > block->capacity && block->next) {
+        block = block->next;
+        offset = align_forward(block->used, alignment);
+    }
+
+    if (offset + size > block->capacity) {
         // Check if we need a new block
-        size_t new_size = (aligned_size > arena->default_block_size) 
-            ? aligned_size * 2 
+        size_t new_size = (size > arena->default_block_size) 
+            ? size * 2 
             : arena->default_block_size;
         
         ArenaBlock* new_block = create_block(new_size);
         if (!new_block) return NULL;
         
         block->next = new_block;
-        arena->current = new_block;
         block = new_block;
+        offset = 0;
     }
     
-    void* ptr = block->data + block->used;
-    block->used += aligned_size;
+    arena->current = block;
+    void* ptr = block->data + offset;
+    block->used = offset + size;
     return ptr;
 }
 
@@ -79,3 +87,11 @@ void arena_reset(Arena* arena) {
     }
     arena->current = arena->head;
 }
+
+void arena_shrink(Arena* arena, void* ptr, size_t old_size, size_t new_size) {
+    ArenaBlock* block = arena->current;
+    char* p = ptr;
+    if (new_size <= old_size && p + old_size == block->data + block->used) {
+        block->used -= old_size - new_size;
+    }
+}
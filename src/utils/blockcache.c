@@ -0,0 +1,318 @@
+#include "utils/blockcache.h"
+#include "utils/hash.h"
+#include "utils/mmap.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* =============================================================================
+ *                      Block Cache File Format
+ * =============================================================================
+ *
+ * Laid out like the page cache and mapped the same way.
+ *
+ * [Header] (72 bytes)
+ * 8 bytes: magic number 0x535347424C4F434B ("SSGBLOCK")
+ * 4 bytes: format revision (uint32_t), 1
+ * 4 bytes: hash algorithm of the block hashes (HashAlgo)
+ * 4 bytes: BLOCK_CACHE_RENDERER of the fragments
+ * 4 bytes: reserved
+ * 8 bytes: number of records
+ * 8 bytes: number of index slots (a power of two, more than the records)
+ * 8 bytes: offset of the record array
+ * 8 bytes: offset of the index
+ * 8 bytes: offset of the fragment pool
+ * 8 bytes: size of the fragment pool
+ *
+ * [Records]   fixed-width BlockRecord
+ * [Index]     uint32_t per slot, record index + 1, 0 = empty; open
+ *             addressing on the block hash with linear probing
+ * [Fragments] the HTML of every record, back to back
+ *
+ * A file from another hash algorithm or renderer is ignored: none of its
+ * fragments could be trusted, and the next save replaces it.
+ */
+static const uint64_t BLOCK_MAGIC = 0x535347424C4F434B;   // "SSGBLOCK"
+static const uint32_t BLOCK_REVISION = 1;
+
+typedef struct {
+    uint64_t magic;
+    uint32_t revision;
+    uint32_t hash_algo;
+    uint32_t renderer;
+    uint32_t reserved;
+    uint64_t count;
+    uint64_t slot_count;
+    uint64_t records_off;
+    uint64_t slots_off;
+    uint64_t pool_off;
+    uint64_t pool_size;
+} BlockHeader;
+
+// What goes into an image, wherever it came from.
+typedef struct {
+    uint64_t hash;
+    uint64_t source_len;
+    const char* html;
+    size_t html_len;
+    int64_t last_used;
+} BlockImageEntry;
+
+static int snapshot_attach(BlockSnapshot* snap, const char* base, size_t size) {
+    BlockHeader h;
+    if (size < sizeof(h)) return 0;
+    memcpy(&h, base, sizeof(h));
+
+    if (h.magic != BLOCK_MAGIC || h.revision != BLOCK_REVISION ||
+        h.hash_algo != HASH_ALGO_CURRENT || h.renderer != BLOCK_CACHE_RENDERER) return 0;
+    if (h.slot_count == 0 || (h.slot_count & (h.slot_count - 1)) != 0 ||
+        h.slot_count <= h.count) return 0;
+    if (h.count > size / sizeof(BlockRecord) || h.slot_count > size / sizeof(uint32_t)) return 0;
+    if (h.records_off % 8 || h.records_off > size ||
+        h.count * sizeof(BlockRecord) > size - h.records_off) return 0;
+    if (h.slots_off % 4 || h.slots_off > size ||
+        h.slot_count * sizeof(uint32_t) > size - h.slots_off) return 0;
+    if (h.pool_off > size || h.pool_size > size - h.pool_off) return 0;
+
+    snap->base = base;
+    snap->size = size;
+    snap->records = (const BlockRecord*)(base + h.records_off);
+    snap->count = h.count;
+    snap->slots = (const uint32_t*)(base + h.slots_off);
+    snap->slot_mask = h.slot_count - 1;
+    snap->pool = base + h.pool_off;
+    snap->pool_size = h.pool_size;
+    return 1;
+}
+
+int block_cache_load(BlockSnapshot* snap, const char* path) {
+    memset(snap, 0, sizeof(*snap));
+
+    MappedFile file = mmap_file(path);
+    if (!file.data) return 0;
+    if (snapshot_attach(snap, file.data, file.size)) return 1;
+
+    memset(snap, 0, sizeof(*snap));
+    munmap_file(file);
+    return 0;
+}
+
+void block_snapshot_free(BlockSnapshot* snap) {
+    if (snap->base) munmap_file((MappedFile){ .data = snap->base, .size = snap->size });
+    memset(snap, 0, sizeof(*snap));
+}
+
+static const BlockRecord* snapshot_find(const BlockSnapshot* snap, uint64_t hash, size_t source_len) {
+    if (!snap || !snap->slots) return NULL;
+
+    size_t slot = hash & snap->slot_mask;
+    for (size_t probes = 0; probes <= snap->slot_mask && snap->slots[slot]; probes++) {
+        uint32_t idx = snap->slots[slot] - 1;
+        if (idx < snap->count) {
+            const BlockRecord* rec = &snap->records[idx];
+            if (rec->hash == hash && rec->source_len == source_len &&
+                rec->html_off <= snap->pool_size &&
+                rec->html_len <= snap->pool_size - rec->html_off) {
+                return rec;
+            }
+        }
+        slot = (slot + 1) & snap->slot_mask;
+    }
+    return NULL;
+}
+
+static BlockEntry* memo_add(BlockMemo* memo, uint64_t hash, size_t source_len,
+                            const char* html, size_t html_len, int owned) {
+    BlockEntry* entry = malloc(sizeof(BlockEntry));
+    if (!entry) return NULL;
+    entry->key[0] = hash;
+    entry->key[1] = source_len;
+    entry->html = html;
+    entry->html_len = html_len;
+    entry->owned = owned;
+    HASH_ADD(hh, memo->entries, key, sizeof(entry->key), entry);
+    return entry;
+}
+
+const char* block_memo_find(BlockMemo* memo, uint64_t hash, size_t source_len, size_t* html_len) {
+    uint64_t key[2] = { hash, source_len };
+    BlockEntry* entry = NULL;
+    HASH_FIND(hh, memo->entries, key, sizeof(key), entry);
+
+    if (!entry) {
+        const BlockRecord* rec = snapshot_find(memo->snapshot, hash, source_len);
+        if (rec) {
+            entry = memo_add(memo, hash, source_len, memo->snapshot->pool + rec->html_off,
+                             rec->html_len, 0);
+        }
+    }
+    if (!entry) {
+        memo->misses++;
+        return NULL;
+    }
+    memo->hits++;
+    *html_len = entry->html_len;
+    return entry->html;
+}
+
+void block_memo_store(BlockMemo* memo, uint64_t hash, size_t source_len,
+                      const char* html, size_t html_len) {
+    uint64_t key[2] = { hash, source_len };
+    BlockEntry* entry = NULL;
+    HASH_FIND(hh, memo->entries, key, sizeof(key), entry);
+    if (entry) return;
+
+    char* copy = malloc(html_len ? html_len : 1);
+    if (!copy) return;
+    memcpy(copy, html, html_len);
+    if (!memo_add(memo, hash, source_len, copy, html_len, 1)) free(copy);
+}
+
+void block_memo_merge(BlockMemo* dst, BlockMemo* src) {
+    BlockEntry *entry, *tmp, *found;
+    HASH_ITER(hh, src->entries, entry, tmp) {
+        HASH_DEL(src->entries, entry);
+        HASH_FIND(hh, dst->entries, entry->key, sizeof(entry->key), found);
+        if (found) {
+            if (entry->owned) free((void*)entry->html);
+            free(entry);
+        } else {
+            HASH_ADD(hh, dst->entries, key, sizeof(entry->key), entry);
+        }
+    }
+    dst->hits += src->hits;
+    dst->misses += src->misses;
+    src->hits = src->misses = 0;
+}
+
+void block_memo_free(BlockMemo* memo) {
+    BlockEntry *entry, *tmp;
+    HASH_ITER(hh, memo->entries, entry, tmp) {
+        HASH_DEL(memo->entries, entry);
+        if (entry->owned) free((void*)entry->html);
+        free(entry);
+    }
+}
+
+static char* build_image(const BlockImageEntry* entries, size_t count, size_t* out_size) {
+    size_t pool_size = 0;
+    for (size_t i = 0; i < count; i++) pool_size += entries[i].html_len;
+
+    // Keep the table at most half full so probe chains stay short.
+    size_t slot_count = 16;
+    while (slot_count < count * 2) slot_count <<= 1;
+
+    BlockHeader header = {
+        .magic = BLOCK_MAGIC,
+        .revision = BLOCK_REVISION,
+        .hash_algo = HASH_ALGO_CURRENT,
+        .renderer = BLOCK_CACHE_RENDERER,
+        .count = count,
+        .slot_count = slot_count,
+        .records_off = sizeof(BlockHeader),
+    };
+    header.slots_off = header.records_off + count * sizeof(BlockRecord);
+    header.pool_off = header.slots_off + slot_count * sizeof(uint32_t);
+    header.pool_size = pool_size;
+
+    size_t size = header.pool_off + pool_size;
+    char* image = calloc(1, size);
+    if (!image) return NULL;
+    memcpy(image, &header, sizeof(header));
+
+    BlockRecord* records = (BlockRecord*)(image + header.records_off);
+    uint32_t* slots = (uint32_t*)(image + header.slots_off);
+    char* pool = image + header.pool_off;
+    size_t used = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        const BlockImageEntry* src = &entries[i];
+        records[i] = (BlockRecord){
+            .hash = src->hash,
+            .source_len = src->source_len,
+            .html_off = used,
+            .html_len = src->html_len,
+            .last_used = src->last_used,
+        };
+        memcpy(pool + used, src->html, src->html_len);
+        used += src->html_len;
+
+        size_t slot = src->hash & (slot_count - 1);
+        while (slots[slot]) slot = (slot + 1) & (slot_count - 1);
+        slots[slot] = (uint32_t)(i + 1);
+    }
+
+    *out_size = size;
+    return image;
+}
+
+static int newest_first(const void* a, const void* b) {
+    int64_t x = ((const BlockImageEntry*)a)->last_used;
+    int64_t y = ((const BlockImageEntry*)b)->last_used;
+    return (x < y) - (x > y);
+}
+
+int block_cache_save(const BlockMemo* memo, const BlockSnapshot* snap, const char* path,
+                     size_t budget) {
+    size_t used_count = HASH_COUNT(memo->entries);
+    size_t capacity = used_count + snap->count;
+    BlockImageEntry* entries = malloc((capacity + 1) * sizeof(BlockImageEntry));
+    if (!entries) return 0;
+
+    int64_t now = (int64_t)time(NULL);
+    size_t count = 0, total = 0;
+    BlockEntry *entry, *tmp;
+    HASH_ITER(hh, memo->entries, entry, tmp) {
+        entries[count++] = (BlockImageEntry){
+            .hash = entry->key[0],
+            .source_len = entry->key[1],
+            .html = entry->html,
+            .html_len = entry->html_len,
+            .last_used = now,
+        };
+        total += entry->html_len;
+    }
+
+    // Fragments of pages not rebuilt this run, newest first, while they fit.
+    size_t old_start = count;
+    for (size_t i = 0; i < snap->count; i++) {
+        const BlockRecord* rec = &snap->records[i];
+        uint64_t key[2] = { rec->hash, rec->source_len };
+        BlockEntry* found = NULL;
+        HASH_FIND(hh, memo->entries, key, sizeof(key), found);
+        if (found || rec->html_off > snap->pool_size ||
+            rec->html_len > snap->pool_size - rec->html_off) continue;
+
+        entries[count++] = (BlockImageEntry){
+            .hash = rec->hash,
+            .source_len = rec->source_len,
+            .html = snap->pool + rec->html_off,
+            .html_len = rec->html_len,
+            .last_used = rec->last_used,
+        };
+    }
+    qsort(entries + old_start, count - old_start, sizeof(BlockImageEntry), newest_first);
+    size_t kept = old_start;
+    for (size_t i = old_start; i < count && total + entries[i].html_len <= budget; i++) {
+        total += entries[i].html_len;
+        entries[kept++] = entries[i];
+    }
+
+    // The image is complete before the file is opened: snap may be a
+    // mapping of that same file.
+    size_t size;
+    char* image = build_image(entries, kept, &size);
+    free(entries);
+    if (!image) return 0;
+
+    FILE* f = fopen(path, "wb");
+    if (!f) {
+        free(image);
+        return 0;
+    }
+    int ok = fwrite(image, 1, size, f) == size;
+    ok = (fclose(f) == 0) && ok;
+    free(image);
+    return ok;
+}
@@ -1,50 +1,176 @@
 #include "utils/cache.h"
 #include "utils/path.h"
+#include "utils/mmap.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <unistd.h> // For access()
 
 /* =============================================================================
  *                      Binary Cache File Format
  * =============================================================================
  *
- * This implementation uses a simple and robust binary format for speed and
- * to avoid parsing complexities.
+ * The cache is mapped and used in place: loading costs one mmap no matter
+ * how many pages the site has, and lookups go straight to the file.
  *
- * [Header]
- * 8 bytes: magic number 0x5353474341434543 ("SSGCACHE")
- * 8 bytes: number of entries (uint64_t)
+ * [Header] (64 bytes)
+ * 8 bytes: magic number 0x5353474341434852 ("SSGCACHR")
+ * 4 bytes: format revision (uint32_t), 4
+ * 4 bytes: hash algorithm of every hash below (HashAlgo)
+ * 8 bytes: number of records
+ * 8 bytes: number of index slots (a power of two, more than the records)
+ * 8 bytes: offset of the record array
+ * 8 bytes: offset of the index
+ * 8 bytes: offset of the string pool
+ * 8 bytes: size of the string pool
+ *
+ * [Records] fixed-width CacheRecord, paths as string pool offsets
+ * [Index]   uint32_t per slot, record index + 1, 0 = empty; open addressing
+ *           on path_hash with linear probing
+ * [Strings] NUL-terminated input and output paths and layout names
+ *
+ * Revision 3 records had no layout or dependency hash. They are read into
+ * an in-memory image with a dependency hash of 0, which nothing matches,
+ * so each of those pages is rebuilt once but keeps its build time and
+ * output hash.
+ *
+ * Revisions 0-2 were a stream of length-prefixed records:
  *
- * [Entries] (repeated for each entry)
  * 8 bytes: length of input_path string (including null terminator)
  * N bytes: input_path string
  * 8 bytes: length of output_path string (including null terminator)
  * N bytes: output_path string
  * 8 bytes: last_modified timestamp (time_t)
  * 8 bytes: content_hash (uint64_t)
+ * 8 bytes: build_ns, duration of the last build (uint64_t, revision >= 1)
+ * 8 bytes: output_hash, hash of the rendered page (uint64_t, revision >= 2)
+ *
+ * following a header of magic, revision, reserved and a uint64_t count.
+ * Everything before the hash algorithm was recorded used FNV-1a, which
+ * is HASH_ALGO_FNV1A (0), so the old reserved word already reads right.
+ * Files written before the format was revisioned start with the legacy
+ * magic 0x5353474341434543 ("SSGCACHE") and have no revision/reserved
+ * words. Both are still read into an in-memory image; the next save
+ * upgrades them.
+ *
+ * =============================================================================
+ *                      Journal
+ * =============================================================================
+ *
+ * Beside the cache file, as <cache>.journal, an append-only log of the
+ * entries written since the cache file was last compacted:
  *
+ * [Header] (16 bytes)
+ * 8 bytes: magic number 0x5353474A4F55524E ("SSGJOURN")
+ * 4 bytes: format revision (uint32_t), 1
+ * 4 bytes: hash algorithm of the hashes in the records (HashAlgo)
+ *
+ * [Records] back to back, each a JournalRecord and then its input path,
+ *           output path and layout, without terminators. The checksum
+ *           covers everything in the record after it.
+ *
+ * Loading copies records, in one pass and one allocation, into an image
+ * laid out like the cache file's, until the first one that is torn or
+ * fails its checksum; the next build appends from there. Later records win.
+ * cache_save writes the compacted cache to <cache>.tmp, syncs it, renames
+ * it over the cache file and only then removes the journal; a journal that
+ * survives a crash in between only repeats what the new file already has.
  */
-static const uint64_t CACHE_MAGIC = 0x5353474341434543; // "SSGCACHE"
+static const uint64_t CACHE_MAGIC = 0x5353474341434852;        // "SSGCACHR"
+static const uint64_t CACHE_MAGIC_LEGACY = 0x5353474341434543; // "SSGCACHE"
+static const uint32_t CACHE_REVISION = 4;
+static const uint32_t CACHE_FIRST_MAPPED_REVISION = 3;
+static const uint64_t JOURNAL_MAGIC = 0x5353474A4F55524E;      // "SSGJOURN"
+static const uint32_t JOURNAL_REVISION = 1;
+
+#define JOURNAL_BUFFER (64 * 1024)   // buffered records written at once
+#define JOURNAL_COMPACT_MIN 256      // records before compaction is worth it
+
+typedef struct {
+    uint64_t magic;
+    uint32_t revision;
+    uint32_t hash_algo;
+    uint64_t count;
+    uint64_t slot_count;
+    uint64_t records_off;
+    uint64_t slots_off;
+    uint64_t strings_off;
+    uint64_t strings_size;
+} CacheHeader;
+
+typedef struct {
+    uint64_t magic;
+    uint32_t revision;
+    uint32_t hash_algo;
+} JournalHeader;
+
+typedef struct {
+    uint64_t checksum;
+    uint32_t size;           // the whole record, paths included
+    uint32_t input_len;
+    uint32_t output_len;
+    uint32_t layout_len;
+    int64_t last_modified;
+    uint64_t content_hash;
+    uint64_t output_hash;
+    uint64_t build_ns;
+    uint64_t deps_hash;
+} JournalRecord;
+
+// A record as revision 3 laid it out.
+typedef struct {
+    uint64_t path_hash;
+    uint64_t input_off;
+    uint64_t output_off;
+    int64_t last_modified;
+    uint64_t content_hash;
+    uint64_t output_hash;
+    uint64_t build_ns;
+} CacheRecordV3;
+
+// What goes into an image, wherever it came from.
+typedef struct {
+    const char* input_path;
+    const char* output_path;
+    int64_t last_modified;
+    uint64_t content_hash;
+    uint64_t output_hash;
+    uint64_t build_ns;
+    const char* layout;      // NULL reads as ""
+    uint64_t deps_hash;
+} ImageEntry;
 
 
 void cache_update_entry(BuildCache* cache, const char* in_path,
-                       const char* out_path, time_t mtime, uint64_t hash) {
+                       const char* out_path, time_t mtime, uint64_t hash,
+                       uint64_t output_hash, uint64_t build_ns,
+                       const char* layout, uint64_t deps_hash) {
     CacheEntry* entry = NULL;
     HASH_FIND_STR(*cache, in_path, entry);
 
     if (entry) {
         free(entry->output_path);
+        free(entry->layout);
         entry->output_path = strdup(out_path);
         entry->last_modified = mtime;
         entry->content_hash = hash;
+        entry->output_hash = output_hash;
+        entry->build_ns = build_ns;
+        entry->layout = strdup(layout ? layout : "");
+        entry->deps_hash = deps_hash;
     } else {
         entry = malloc(sizeof(CacheEntry));
         entry->input_path = strdup(in_path);
         entry->output_path = strdup(out_path);
         entry->last_modified = mtime;
         entry->content_hash = hash;
+        entry->output_hash = output_hash;
+        entry->build_ns = build_ns;
+        entry->layout = strdup(layout ? layout : "");
+        entry->deps_hash = deps_hash;
 
         HASH_ADD_STR(*cache, input_path, entry);
     }
@@ -57,120 +183,693 @@ void cache_free(BuildCache* cache) {
         HASH_DEL(*cache, current_entry); 
         free(current_entry->input_path);
         free(current_entry->output_path);
+        free(current_entry->layout);
         free(current_entry);
     }
 }
 
-void cache_purge_missing(BuildCache* cache) {
-    CacheEntry *current_entry, *tmp;
-    HASH_ITER(hh, *cache, current_entry, tmp) {
-        if (access(current_entry->input_path, F_OK) != 0) {
-            HASH_DEL(*cache, current_entry);
-            free(current_entry->input_path);
-            free(current_entry->output_path);
-            free(current_entry);
+// Fills in the header of an image of count records whose strings take
+// pool_size bytes, and returns the size of the whole image.
+static size_t image_layout(CacheHeader* header, size_t count, size_t pool_size) {
+    // Keep the table at most half full so probe chains stay short.
+    size_t slot_count = 16;
+    while (slot_count < count * 2) slot_count <<= 1;
+
+    *header = (CacheHeader){
+        .magic = CACHE_MAGIC,
+        .revision = CACHE_REVISION,
+        .hash_algo = HASH_ALGO_CURRENT,
+        .count = count,
+        .slot_count = slot_count,
+        .records_off = sizeof(CacheHeader),
+    };
+    header->slots_off = header->records_off + count * sizeof(CacheRecord);
+    header->strings_off = header->slots_off + slot_count * sizeof(uint32_t);
+    header->strings_size = pool_size;
+    return header->strings_off + pool_size;
+}
+
+// Copies len bytes of s and a terminator into the pool, returning the offset.
+static uint64_t pool_put(char* strings, size_t* used, const char* s, size_t len) {
+    uint64_t off = *used;
+    memcpy(strings + off, s, len);
+    strings[off + len] = '\0';
+    *used += len + 1;
+    return off;
+}
+
+// Lays entries out as a complete cache image: header, records, index,
+// strings. The result is what cache_save writes and what a snapshot reads.
+static char* build_image(const ImageEntry* entries, size_t count, size_t* out_size) {
+    size_t pool_size = 1;
+    for (size_t i = 0; i < count; i++) {
+        pool_size += strlen(entries[i].input_path) + strlen(entries[i].output_path) + 2;
+        if (entries[i].layout && entries[i].layout[0]) pool_size += strlen(entries[i].layout) + 1;
+    }
+
+    CacheHeader header;
+    size_t size = image_layout(&header, count, pool_size);
+    char* image = calloc(1, size);
+    if (!image) return NULL;
+    memcpy(image, &header, sizeof(header));
+
+    CacheRecord* records = (CacheRecord*)(image + header.records_off);
+    uint32_t* slots = (uint32_t*)(image + header.slots_off);
+    char* strings = image + header.strings_off;
+    size_t used = 1;    // offset 0 stays the empty string
+
+    for (size_t i = 0; i < count; i++) {
+        const ImageEntry* src = &entries[i];
+        CacheRecord* rec = &records[i];
+        size_t in_len = strlen(src->input_path);
+
+        rec->input_off = pool_put(strings, &used, src->input_path, in_len);
+        rec->output_off = pool_put(strings, &used, src->output_path, strlen(src->output_path));
+        rec->layout_off = 0;
+        if (src->layout && src->layout[0]) {
+            rec->layout_off = pool_put(strings, &used, src->layout, strlen(src->layout));
         }
+
+        rec->path_hash = hash_from_memory(src->input_path, in_len);
+        rec->last_modified = src->last_modified;
+        rec->content_hash = src->content_hash;
+        rec->output_hash = src->output_hash;
+        rec->build_ns = src->build_ns;
+        rec->deps_hash = src->deps_hash;
+
+        size_t slot = rec->path_hash & (header.slot_count - 1);
+        while (slots[slot]) slot = (slot + 1) & (header.slot_count - 1);
+        slots[slot] = (uint32_t)(i + 1);
     }
+
+    *out_size = size;
+    return image;
 }
 
-int cache_save(const BuildCache* cache, const char* path) {
-    FILE* f = fopen(path, "wb");
-    if (!f) return 0;
+// Points snap into an image after checking that every section lies inside
+// it. Individual records are checked as lookups reach them.
+static int snapshot_attach(CacheSnapshot* snap, const char* base, size_t size) {
+    CacheHeader h;
+    if (size < sizeof(h)) return 0;
+    memcpy(&h, base, sizeof(h));
+
+    if (h.magic != CACHE_MAGIC || h.revision != CACHE_REVISION) return 0;
+    if (h.slot_count == 0 || (h.slot_count & (h.slot_count - 1)) != 0 ||
+        h.slot_count <= h.count) return 0;
+    if (h.count > size / sizeof(CacheRecord) || h.slot_count > size / sizeof(uint32_t)) return 0;
+    if (h.records_off % 8 || h.records_off > size ||
+        h.count * sizeof(CacheRecord) > size - h.records_off) return 0;
+    if (h.slots_off % 4 || h.slots_off > size ||
+        h.slot_count * sizeof(uint32_t) > size - h.slots_off) return 0;
+    if (h.strings_off > size || h.strings_size == 0 ||
+        h.strings_size > size - h.strings_off) return 0;
+    if (base[h.strings_off + h.strings_size - 1] != '\0') return 0;
+
+    snap->base = base;
+    snap->size = size;
+    snap->records = (const CacheRecord*)(base + h.records_off);
+    snap->count = h.count;
+    snap->slots = (const uint32_t*)(base + h.slots_off);
+    snap->slot_mask = h.slot_count - 1;
+    snap->strings = base + h.strings_off;
+    snap->strings_size = h.strings_size;
+    return 1;
+}
 
-    fwrite(&CACHE_MAGIC, sizeof(CACHE_MAGIC), 1, f);
-    const uint64_t count = HASH_COUNT(*cache); 
-    fwrite(&count, sizeof(count), 1, f);
+static const CacheRecord* image_find(const CacheSnapshot* snap, const char* in_path, uint64_t h) {
+    if (!snap->slots) return NULL;
+
+    size_t slot = h & snap->slot_mask;
+
+    // The index always has empty slots, but a damaged file might not;
+    // never probe more than the whole table.
+    for (size_t probes = 0; probes <= snap->slot_mask && snap->slots[slot]; probes++) {
+        uint32_t idx = snap->slots[slot] - 1;
+        if (idx < snap->count) {
+            const CacheRecord* rec = &snap->records[idx];
+            if (rec->path_hash == h &&
+                rec->input_off < snap->strings_size &&
+                rec->output_off < snap->strings_size &&
+                rec->layout_off < snap->strings_size &&
+                strcmp(snap->strings + rec->input_off, in_path) == 0) {
+                return rec;
+            }
+        }
+        slot = (slot + 1) & snap->slot_mask;
+    }
+    return NULL;
+}
 
-    CacheEntry *entry, *tmp;
-    HASH_ITER(hh, *cache, entry, tmp) {
-        const uint64_t in_len = strlen(entry->input_path) + 1;
-        const uint64_t out_len = strlen(entry->output_path) + 1;
+const CacheRecord* cache_snapshot_find(const CacheSnapshot* snap, const char* in_path) {
+    uint64_t h = hash_from_memory(in_path, strlen(in_path));
+    const CacheRecord* rec = snap->journal ? image_find(snap->journal, in_path, h) : NULL;
+    return rec ? rec : image_find(snap, in_path, h);
+}
+
+// Records from the journal keep their strings in the journal's image.
+static const char* record_strings(const CacheSnapshot* snap, const CacheRecord* rec) {
+    const CacheSnapshot* j = snap->journal;
+    if (j && rec >= j->records && rec < j->records + j->count) return j->strings;
+    return snap->strings;
+}
+
+const char* cache_record_input(const CacheSnapshot* snap, const CacheRecord* rec) {
+    return record_strings(snap, rec) + rec->input_off;
+}
 
-        fwrite(&in_len, sizeof(in_len), 1, f);
-        fwrite(entry->input_path, 1, in_len, f);
+const char* cache_record_output(const CacheSnapshot* snap, const CacheRecord* rec) {
+    return record_strings(snap, rec) + rec->output_off;
+}
 
-        fwrite(&out_len, sizeof(out_len), 1, f);
-        fwrite(entry->output_path, 1, out_len, f);
+const char* cache_record_layout(const CacheSnapshot* snap, const CacheRecord* rec) {
+    return record_strings(snap, rec) + rec->layout_off;
+}
 
-        fwrite(&entry->last_modified, sizeof(entry->last_modified), 1, f);
-        fwrite(&entry->content_hash, sizeof(entry->content_hash), 1, f);
+void cache_snapshot_free(CacheSnapshot* snap) {
+    if (snap->journal) {
+        cache_snapshot_free(snap->journal);
+        free(snap->journal);
+    }
+    if (snap->mapped) {
+        munmap_file((MappedFile){ .data = snap->base, .size = snap->size });
+    } else {
+        free((void*)snap->base);
     }
+    memset(snap, 0, sizeof(*snap));
+}
 
-    fclose(f);
+static void journal_path(char* out, const char* path) {
+    snprintf(out, PATH_MAX, "%s.journal", path);
+}
+
+// Adds the records of image that neither cache nor shadow replaces.
+static size_t collect_records(ImageEntry* entries, size_t count, const CacheSnapshot* image,
+                              const CacheSnapshot* shadow, const BuildCache* cache) {
+    for (size_t i = 0; i < image->count; i++) {
+        const CacheRecord* rec = &image->records[i];
+        if (rec->input_off >= image->strings_size || rec->output_off >= image->strings_size ||
+            rec->layout_off >= image->strings_size) continue;
+
+        const char* in_path = image->strings + rec->input_off;
+        CacheEntry* updated = NULL;
+        HASH_FIND_STR(*cache, in_path, updated);
+        if (updated || access(in_path, F_OK) != 0) continue;
+        if (shadow && image_find(shadow, in_path, hash_from_memory(in_path, strlen(in_path)))) continue;
+
+        entries[count++] = (ImageEntry){
+            .input_path = in_path,
+            .output_path = image->strings + rec->output_off,
+            .last_modified = rec->last_modified,
+            .content_hash = rec->content_hash,
+            .output_hash = rec->output_hash,
+            .build_ns = rec->build_ns,
+            .layout = image->strings + rec->layout_off,
+            .deps_hash = rec->deps_hash,
+        };
+    }
+    return count;
+}
+
+// Pages rebuilt this run replace their snapshot and journal records;
+// records for inputs that no longer exist are dropped. The image is
+// complete before the file is opened, because base may be a mapping of the
+// file it replaces.
+int cache_save(const BuildCache* cache, const CacheSnapshot* base, const char* path) {
+    size_t journaled = base->journal ? base->journal->count : 0;
+    size_t capacity = base->count + journaled + HASH_COUNT(*cache);
+    ImageEntry* entries = malloc((capacity + 1) * sizeof(ImageEntry));
+    if (!entries) return 0;
+
+    size_t count = collect_records(entries, 0, base, base->journal, cache);
+    if (base->journal) count = collect_records(entries, count, base->journal, NULL, cache);
+
+    CacheEntry *entry, *tmp;
+    HASH_ITER(hh, *cache, entry, tmp) {
+        if (access(entry->input_path, F_OK) != 0) continue;
+        entries[count++] = (ImageEntry){
+            .input_path = entry->input_path,
+            .output_path = entry->output_path,
+            .last_modified = entry->last_modified,
+            .content_hash = entry->content_hash,
+            .output_hash = entry->output_hash,
+            .build_ns = entry->build_ns,
+            .layout = entry->layout,
+            .deps_hash = entry->deps_hash,
+        };
+    }
+
+    size_t size;
+    char* image = build_image(entries, count, &size);
+    free(entries);
+    if (!image) return 0;
+
+    // Readers see the old file or the new one, never a partial write.
+    char tmp_path[PATH_MAX];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    FILE* f = fopen(tmp_path, "wb");
+    if (!f) {
+        free(image);
+        return 0;
+    }
+    int ok = fwrite(image, 1, size, f) == size;
+    ok = ok && fflush(f) == 0 && fsync(fileno(f)) == 0;
+    ok = (fclose(f) == 0) && ok;
+    free(image);
+    if (!ok || rename(tmp_path, path) != 0) {
+        unlink(tmp_path);
+        return 0;
+    }
+
+    // Everything the journal held is in the new file now.
+    char journal[PATH_MAX];
+    journal_path(journal, path);
+    unlink(journal);
     return 1;
 }
 
-int cache_load(BuildCache* cache, const char* path) {
+// Reads a revision 0-2 stream into an in-memory image.
+static int load_stream(CacheSnapshot* snap, const char* path) {
     FILE* f = fopen(path, "rb");
     if (!f) return 0;
 
+    BuildCache cache = NULL;
     uint64_t magic;
-    if (fread(&magic, sizeof(magic), 1, f) != 1 || magic != CACHE_MAGIC) {
-        fclose(f);
-        return 0;
+    uint32_t revision = 0;
+    if (fread(&magic, sizeof(magic), 1, f) != 1) goto error;
+    if (magic == CACHE_MAGIC) {
+        uint32_t reserved;
+        if (fread(&revision, sizeof(revision), 1, f) != 1 ||
+            fread(&reserved, sizeof(reserved), 1, f) != 1 ||
+            revision >= CACHE_FIRST_MAPPED_REVISION) goto error;
+    } else if (magic != CACHE_MAGIC_LEGACY) {
+        goto error;
     }
 
     uint64_t count;
-    if (fread(&count, sizeof(count), 1, f) != 1) {
-        fclose(f);
-        return 0;
-    }
+    if (fread(&count, sizeof(count), 1, f) != 1) goto error;
 
     for (uint64_t i = 0; i < count; i++) {
         uint64_t in_len, out_len;
         char in_buf[PATH_MAX], out_buf[PATH_MAX];
         time_t mtime;
         uint64_t hash;
+        uint64_t build_ns = 0;
+        uint64_t output_hash = 0;
 
         if (fread(&in_len, sizeof(in_len), 1, f) != 1) goto error;
-        if (in_len > PATH_MAX || fread(in_buf, 1, in_len, f) != in_len) goto error;
+        if (in_len == 0 || in_len > PATH_MAX || fread(in_buf, 1, in_len, f) != in_len) goto error;
 
         if (fread(&out_len, sizeof(out_len), 1, f) != 1) goto error;
-        if (out_len > PATH_MAX || fread(out_buf, 1, out_len, f) != out_len) goto error;
+        if (out_len == 0 || out_len > PATH_MAX || fread(out_buf, 1, out_len, f) != out_len) goto error;
+        in_buf[in_len - 1] = '\0';
+        out_buf[out_len - 1] = '\0';
 
         if (fread(&mtime, sizeof(mtime), 1, f) != 1) goto error;
         if (fread(&hash, sizeof(hash), 1, f) != 1) goto error;
+        if (revision >= 1 && fread(&build_ns, sizeof(build_ns), 1, f) != 1) goto error;
+        if (revision >= 2 && fread(&output_hash, sizeof(output_hash), 1, f) != 1) goto error;
+
+        // Stream revisions all hashed with FNV-1a; those values can never
+        // match a current hash, so drop them instead of carrying them over.
+        (void)hash;
+        (void)output_hash;
+        cache_update_entry(&cache, in_buf, out_buf, mtime, 0, 0, build_ns, NULL, 0);
+    }
+    fclose(f);
 
-        cache_update_entry(cache, in_buf, out_buf, mtime, hash);
+    size_t n = HASH_COUNT(cache);
+    ImageEntry* entries = malloc((n + 1) * sizeof(ImageEntry));
+    size_t i = 0;
+    CacheEntry *entry, *tmp;
+    HASH_ITER(hh, cache, entry, tmp) {
+        entries[i++] = (ImageEntry){
+            .input_path = entry->input_path,
+            .output_path = entry->output_path,
+            .last_modified = entry->last_modified,
+            .content_hash = entry->content_hash,
+            .output_hash = entry->output_hash,
+            .build_ns = entry->build_ns,
+        };
     }
 
-    fclose(f);
+    size_t size;
+    char* image = build_image(entries, n, &size);
+    free(entries);
+    cache_free(&cache);
+    if (!image) return 0;
+
+    snapshot_attach(snap, image, size);
     return 1;
 
 error:
-    cache_free(cache);
+    cache_free(&cache);
     fclose(f);
     return 0;
 }
 
+// A cache written with another hash algorithm has an index nobody can
+// probe and content hashes nothing will match. Keep its records, but
+// re-index them and clear their hashes.
+static int snapshot_rehash(CacheSnapshot* snap) {
+    ImageEntry* entries = malloc((snap->count + 1) * sizeof(ImageEntry));
+    size_t count = 0;
+
+    for (size_t i = 0; i < snap->count; i++) {
+        const CacheRecord* rec = &snap->records[i];
+        if (rec->input_off >= snap->strings_size || rec->output_off >= snap->strings_size ||
+            rec->layout_off >= snap->strings_size) continue;
+        entries[count++] = (ImageEntry){
+            .input_path = cache_record_input(snap, rec),
+            .output_path = cache_record_output(snap, rec),
+            .last_modified = rec->last_modified,
+            .build_ns = rec->build_ns,
+            .layout = cache_record_layout(snap, rec),
+        };
+    }
 
+    size_t size;
+    char* image = build_image(entries, count, &size);
+    free(entries);
+    cache_snapshot_free(snap);
+    if (!image) return 0;
 
-uint64_t file_hash(const char* path) {
-    FILE* f = fopen(path, "rb");
-    if (!f) return 0;
+    snapshot_attach(snap, image, size);
+    return 1;
+}
+
+// Reads a revision 3 file, the mapped layout before layouts and
+// dependency hashes, into an in-memory image.
+static int load_revision3(CacheSnapshot* snap, const char* base, size_t size) {
+    CacheHeader h;
+    if (size < sizeof(h)) return 0;
+    memcpy(&h, base, sizeof(h));
+
+    if (h.magic != CACHE_MAGIC || h.revision != 3) return 0;
+    if (h.count > size / sizeof(CacheRecordV3)) return 0;
+    if (h.records_off % 8 || h.records_off > size ||
+        h.count * sizeof(CacheRecordV3) > size - h.records_off) return 0;
+    if (h.strings_off > size || h.strings_size == 0 ||
+        h.strings_size > size - h.strings_off) return 0;
+    if (base[h.strings_off + h.strings_size - 1] != '\0') return 0;
+
+    const CacheRecordV3* records = (const CacheRecordV3*)(base + h.records_off);
+    const char* strings = base + h.strings_off;
+    ImageEntry* entries = malloc((h.count + 1) * sizeof(ImageEntry));
+    if (!entries) return 0;
+    size_t count = 0;
+
+    // Hashes from another algorithm are dropped, as snapshot_rehash does.
+    int same_algo = h.hash_algo == HASH_ALGO_CURRENT;
+    for (size_t i = 0; i < h.count; i++) {
+        const CacheRecordV3* rec = &records[i];
+        if (rec->input_off >= h.strings_size || rec->output_off >= h.strings_size) continue;
+        entries[count++] = (ImageEntry){
+            .input_path = strings + rec->input_off,
+            .output_path = strings + rec->output_off,
+            .last_modified = rec->last_modified,
+            .content_hash = same_algo ? rec->content_hash : 0,
+            .output_hash = same_algo ? rec->output_hash : 0,
+            .build_ns = rec->build_ns,
+        };
+    }
+
+    size_t image_size;
+    char* image = build_image(entries, count, &image_size);
+    free(entries);
+    if (!image) return 0;
 
-    uint64_t hash = 0xcbf29ce484222325; 
-    const uint64_t prime = 0x100000001b3; 
+    snapshot_attach(snap, image, image_size);
+    return 1;
+}
 
-    unsigned char buf[4096];
-    size_t bytes_read;
-    while ((bytes_read = fread(buf, 1, sizeof(buf), f))) {
-        for (size_t i = 0; i < bytes_read; i++) {
-            hash ^= buf[i];
-            hash *= prime;
+// Reads the journal record at off into rec. Returns 0 if it is torn or
+// fails its checksum, which ends the journal.
+static int journal_record_at(MappedFile file, size_t off, JournalRecord* rec) {
+    if (file.size - off < sizeof(*rec)) return 0;
+    memcpy(rec, file.data + off, sizeof(*rec));
+    uint64_t strings_len = (uint64_t)rec->input_len + rec->output_len + rec->layout_len;
+
+    if (rec->size > file.size - off || rec->size != sizeof(*rec) + strings_len ||
+        rec->input_len == 0 || rec->input_len >= PATH_MAX || rec->output_len >= PATH_MAX ||
+        rec->layout_len >= PATH_MAX) return 0;
+    return hash_from_memory(file.data + off + sizeof(rec->checksum),
+                            rec->size - sizeof(rec->checksum)) == rec->checksum;
+}
+
+// Copies the journal's records straight into an image laid over snap, the
+// way build_image lays one out, and notes where the last intact record
+// ends. A page journaled twice keeps one record, the later.
+static void load_journal(CacheSnapshot* snap, const char* path) {
+    char jpath[PATH_MAX];
+    journal_path(jpath, path);
+    MappedFile file = mmap_file(jpath);
+    if (!file.data) return;
+
+    JournalHeader header;
+    if (file.size < sizeof(header)) goto done;
+    memcpy(&header, file.data, sizeof(header));
+    if (header.magic != JOURNAL_MAGIC || header.revision != JOURNAL_REVISION ||
+        header.hash_algo != HASH_ALGO_CURRENT) goto done;
+
+    // Size the image from the intact records; repeats only leave slack.
+    JournalRecord rec;
+    size_t off = sizeof(header);
+    size_t records = 0;
+    size_t pool_size = 1;
+    while (journal_record_at(file, off, &rec)) {
+        pool_size += (size_t)rec.input_len + rec.output_len + rec.layout_len + 3;
+        off += rec.size;
+        records++;
+    }
+    snap->journal_size = off;
+    snap->journal_records = records;
+    if (records == 0) goto done;
+
+    CacheHeader image_header;
+    size_t size = image_layout(&image_header, records, pool_size);
+    char* image = calloc(1, size);
+    CacheSnapshot* overlay = calloc(1, sizeof(CacheSnapshot));
+    if (!image || !overlay) {
+        free(image);
+        free(overlay);
+        // Without the overlay the records are lost; start the journal over.
+        snap->journal_size = 0;
+        snap->journal_records = 0;
+        goto done;
+    }
+
+    CacheRecord* out = (CacheRecord*)(image + image_header.records_off);
+    uint32_t* slots = (uint32_t*)(image + image_header.slots_off);
+    char* strings = image + image_header.strings_off;
+    size_t slot_mask = image_header.slot_count - 1;
+    size_t used = 1;
+    size_t count = 0;
+
+    for (off = sizeof(header); off < snap->journal_size; off += rec.size) {
+        memcpy(&rec, file.data + off, sizeof(rec));
+        const char* in_path = file.data + off + sizeof(rec);
+        const char* out_path = in_path + rec.input_len;
+        const char* layout = out_path + rec.output_len;
+        uint64_t h = hash_from_memory(in_path, rec.input_len);
+
+        size_t slot = h & slot_mask;
+        CacheRecord* dst = NULL;
+        while (slots[slot]) {
+            CacheRecord* seen = &out[slots[slot] - 1];
+            if (seen->path_hash == h && strncmp(strings + seen->input_off, in_path, rec.input_len) == 0 &&
+                strings[seen->input_off + rec.input_len] == '\0') {
+                dst = seen;
+                break;
+            }
+            slot = (slot + 1) & slot_mask;
+        }
+        if (!dst) {
+            dst = &out[count++];
+            slots[slot] = (uint32_t)count;
+            dst->path_hash = h;
+            dst->input_off = pool_put(strings, &used, in_path, rec.input_len);
         }
+
+        dst->output_off = pool_put(strings, &used, out_path, rec.output_len);
+        dst->layout_off = rec.layout_len ? pool_put(strings, &used, layout, rec.layout_len) : 0;
+        dst->last_modified = rec.last_modified;
+        dst->content_hash = rec.content_hash;
+        dst->output_hash = rec.output_hash;
+        dst->build_ns = rec.build_ns;
+        dst->deps_hash = rec.deps_hash;
     }
-    fclose(f);
-    return hash;
+
+    // The records array keeps room for the repeats; only count of it is used.
+    image_header.count = count;
+    memcpy(image, &image_header, sizeof(image_header));
+    snapshot_attach(overlay, image, size);
+    snap->journal = overlay;
+
+done:
+    munmap_file(file);
+}
+
+static int load_snapshot(CacheSnapshot* snap, const char* path) {
+    MappedFile file = mmap_file(path);
+    if (!file.data) return 0;
+
+    if (snapshot_attach(snap, file.data, file.size)) {
+        snap->mapped = 1;
+
+        CacheHeader header;
+        memcpy(&header, file.data, sizeof(header));
+        if (header.hash_algo != HASH_ALGO_CURRENT) return snapshot_rehash(snap);
+        return 1;
+    }
+    memset(snap, 0, sizeof(*snap));
+    int converted = load_revision3(snap, file.data, file.size);
+    munmap_file(file);
+    if (converted) return 1;
+
+    // Not the mapped format: an older stream, or damaged. Either way the
+    // build starts from whatever load_stream can recover.
+    return load_stream(snap, path);
 }
 
-uint64_t hash_from_memory(const char* data, size_t size) {
-    uint64_t hash = 0xcbf29ce484222325; 
-    const uint64_t prime = 0x100000001b3; 
+int cache_load(CacheSnapshot* snap, const char* path) {
+    memset(snap, 0, sizeof(*snap));
+    int loaded = load_snapshot(snap, path);
 
-    for (size_t i = 0; i < size; i++) {
-        hash ^= data[i];
-        hash *= prime;
+    // A build killed before its first compaction leaves only a journal.
+    load_journal(snap, path);
+    return loaded || snap->journal;
+}
+
+static int write_all(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t n = write(fd, data, size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return 0;
+        data += n;
+        size -= (size_t)n;
+    }
+    return 1;
+}
+
+int cache_journal_open(CacheJournal* journal, const char* path, const CacheSnapshot* snap) {
+    memset(journal, 0, sizeof(*journal));
+    pthread_mutex_init(&journal->lock, NULL);
+
+    char jpath[PATH_MAX];
+    journal_path(jpath, path);
+    journal->fd = open(jpath, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (journal->fd < 0) {
+        journal->failed = 1;
+        return 0;
     }
-    return hash;
-}
\ No newline at end of file
+
+    // Keep what replayed, drop anything after it; a journal that did not
+    // replay at all starts over.
+    int ok;
+    if (snap->journal_size > 0) {
+        ok = ftruncate(journal->fd, (off_t)snap->journal_size) == 0 &&
+             lseek(journal->fd, 0, SEEK_END) >= 0;
+        journal->records = snap->journal_records;
+    } else {
+        JournalHeader header = {
+            .magic = JOURNAL_MAGIC,
+            .revision = JOURNAL_REVISION,
+            .hash_algo = HASH_ALGO_CURRENT,
+        };
+        ok = ftruncate(journal->fd, 0) == 0 &&
+             write_all(journal->fd, (const char*)&header, sizeof(header));
+    }
+    if (!ok) {
+        close(journal->fd);
+        journal->fd = -1;
+        journal->failed = 1;
+        return 0;
+    }
+    return 1;
+}
+
+static int journal_write(CacheJournal* journal) {
+    if (journal->used == 0) return !journal->failed;
+    if (journal->fd < 0 || !write_all(journal->fd, journal->buffer, journal->used)) {
+        journal->failed = 1;
+    }
+    journal->used = 0;
+    return !journal->failed;
+}
+
+void cache_journal_append(CacheJournal* journal, const CacheEntry* entry) {
+    if (journal->fd < 0) return;
+
+    const char* layout = entry->layout ? entry->layout : "";
+    JournalRecord rec = {
+        .input_len = (uint32_t)strlen(entry->input_path),
+        .output_len = (uint32_t)strlen(entry->output_path),
+        .layout_len = (uint32_t)strlen(layout),
+        .last_modified = entry->last_modified,
+        .content_hash = entry->content_hash,
+        .output_hash = entry->output_hash,
+        .build_ns = entry->build_ns,
+        .deps_hash = entry->deps_hash,
+    };
+    size_t size = sizeof(rec) + rec.input_len + rec.output_len + rec.layout_len;
+    rec.size = (uint32_t)size;
+
+    pthread_mutex_lock(&journal->lock);
+    if (journal->used + size > journal->capacity) {
+        size_t capacity = journal->capacity ? journal->capacity : JOURNAL_BUFFER;
+        while (capacity < journal->used + size) capacity *= 2;
+        char* buffer = realloc(journal->buffer, capacity);
+        if (!buffer) {
+            journal->failed = 1;
+            pthread_mutex_unlock(&journal->lock);
+            return;
+        }
+        journal->buffer = buffer;
+        journal->capacity = capacity;
+    }
+
+    char* out = journal->buffer + journal->used;
+    char* strings = out + sizeof(rec);
+    memcpy(strings, entry->input_path, rec.input_len);
+    memcpy(strings + rec.input_len, entry->output_path, rec.output_len);
+    memcpy(strings + rec.input_len + rec.output_len, layout, rec.layout_len);
+    memcpy(out, &rec, sizeof(rec));
+    rec.checksum = hash_from_memory(out + sizeof(rec.checksum), size - sizeof(rec.checksum));
+    memcpy(out, &rec.checksum, sizeof(rec.checksum));
+    journal->used += size;
+    journal->records++;
+
+    if (journal->used >= JOURNAL_BUFFER) journal_write(journal);
+    pthread_mutex_unlock(&journal->lock);
+}
+
+int cache_journal_flush(CacheJournal* journal) {
+    pthread_mutex_lock(&journal->lock);
+    int ok = journal_write(journal);
+    pthread_mutex_unlock(&journal->lock);
+    return ok;
+}
+
+int cache_journal_close(CacheJournal* journal) {
+    int ok = cache_journal_flush(journal);
+    if (journal->fd >= 0) {
+        ok = fsync(journal->fd) == 0 && ok;
+        ok = close(journal->fd) == 0 && ok;
+        journal->fd = -1;
+    }
+    journal->failed = !ok;
+    free(journal->buffer);
+    journal->buffer = NULL;
+    journal->capacity = 0;
+    pthread_mutex_destroy(&journal->lock);
+    return ok;
+}
+
+// Loading copies every journal record, which is cheap next to a compaction
+// rewriting the whole site, so wait until the journal is a fair share of
+// the snapshot.
+int cache_journal_should_compact(const CacheJournal* journal, const CacheSnapshot* snap) {
+    if (journal->failed) return 1;
+    return journal->records >= JOURNAL_COMPACT_MIN && journal->records * 4 >= snap->count;
+}
+
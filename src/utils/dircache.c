@@ -0,0 +1,365 @@
+#include "utils/dircache.h"
+#include "utils/hash.h"
+#include "utils/mmap.h"
+#include "utils/path.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* =============================================================================
+ *                      Directory Cache File Format
+ * =============================================================================
+ *
+ * Laid out like the page cache and mapped the same way.
+ *
+ * [Header] (88 bytes)
+ * 8 bytes: magic number 0x53534744494C5354 ("SSGDILST")
+ * 4 bytes: format revision (uint32_t), 1
+ * 4 bytes: hash algorithm of the path hashes (HashAlgo)
+ * 8 bytes: number of directory records
+ * 8 bytes: number of index slots (a power of two, more than the records)
+ * 8 bytes: offset of the record array
+ * 8 bytes: offset of the index
+ * 8 bytes: offset of the child array
+ * 8 bytes: number of children
+ * 8 bytes: offset of the name pool
+ * 8 bytes: size of the name pool
+ * 8 bytes: reserved
+ *
+ * [Records]  fixed-width DirRecord, each owning a run of the child array
+ * [Index]    uint32_t per slot, record index + 1, 0 = empty; open
+ *            addressing on path_hash with linear probing
+ * [Children] fixed-width DirChild: subdirectories and pages
+ * [Names]    NUL-terminated directory paths and child names
+ *
+ * It is rewritten with a temporary file and a rename, like the page cache
+ * is compacted, so a killed build leaves the old listings or the new ones.
+ */
+static const uint64_t DIR_MAGIC = 0x53534744494C5354;   // "SSGDILST"
+static const uint32_t DIR_REVISION = 1;
+
+typedef struct {
+    uint64_t magic;
+    uint32_t revision;
+    uint32_t hash_algo;
+    uint64_t count;
+    uint64_t slot_count;
+    uint64_t records_off;
+    uint64_t slots_off;
+    uint64_t children_off;
+    uint64_t child_count;
+    uint64_t names_off;
+    uint64_t names_size;
+    uint64_t reserved;
+} DirHeader;
+
+static int snapshot_attach(DirSnapshot* snap, const char* base, size_t size) {
+    DirHeader h;
+    if (size < sizeof(h)) return 0;
+    memcpy(&h, base, sizeof(h));
+
+    if (h.magic != DIR_MAGIC || h.revision != DIR_REVISION ||
+        h.hash_algo != HASH_ALGO_CURRENT) return 0;
+    if (h.slot_count == 0 || (h.slot_count & (h.slot_count - 1)) != 0 ||
+        h.slot_count <= h.count) return 0;
+    if (h.count > size / sizeof(DirRecord) || h.slot_count > size / sizeof(uint32_t) ||
+        h.child_count > size / sizeof(DirChild)) return 0;
+    if (h.records_off % 8 || h.records_off > size ||
+        h.count * sizeof(DirRecord) > size - h.records_off) return 0;
+    if (h.slots_off % 4 || h.slots_off > size ||
+        h.slot_count * sizeof(uint32_t) > size - h.slots_off) return 0;
+    if (h.children_off % 8 || h.children_off > size ||
+        h.child_count * sizeof(DirChild) > size - h.children_off) return 0;
+    if (h.names_off > size || h.names_size == 0 || h.names_size > size - h.names_off) return 0;
+    if (base[h.names_off + h.names_size - 1] != '\0') return 0;
+
+    snap->base = base;
+    snap->size = size;
+    snap->records = (const DirRecord*)(base + h.records_off);
+    snap->count = h.count;
+    snap->slots = (const uint32_t*)(base + h.slots_off);
+    snap->slot_mask = h.slot_count - 1;
+    snap->children = (const DirChild*)(base + h.children_off);
+    snap->child_count = h.child_count;
+    snap->names = base + h.names_off;
+    snap->names_size = h.names_size;
+    return 1;
+}
+
+int dir_cache_load(DirCache* cache, const char* path) {
+    memset(cache, 0, sizeof(*cache));
+    pthread_mutex_init(&cache->lock, NULL);
+
+    MappedFile file = mmap_file(path);
+    if (!file.data) return 0;
+    if (!snapshot_attach(&cache->snapshot, file.data, file.size)) {
+        memset(&cache->snapshot, 0, sizeof(cache->snapshot));
+        munmap_file(file);
+        return 0;
+    }
+
+    cache->replayed = calloc(cache->snapshot.count + 1, 1);
+    if (!cache->replayed) {
+        munmap_file(file);
+        memset(&cache->snapshot, 0, sizeof(cache->snapshot));
+        return 0;
+    }
+    return 1;
+}
+
+void dir_cache_free(DirCache* cache) {
+    DirSnapshot* snap = &cache->snapshot;
+    if (snap->base) munmap_file((MappedFile){ .data = snap->base, .size = snap->size });
+
+    DirUpdate* update = cache->updates;
+    while (update) {
+        DirUpdate* next = update->next;
+        free(update->children);
+        free(update->names);
+        free(update);
+        update = next;
+    }
+    free(cache->replayed);
+    pthread_mutex_destroy(&cache->lock);
+    memset(cache, 0, sizeof(*cache));
+}
+
+static const DirRecord* snapshot_find(const DirSnapshot* snap, const char* rel, size_t rel_len) {
+    if (!snap->slots) return NULL;
+
+    uint64_t h = hash_from_memory(rel, rel_len);
+    size_t slot = h & snap->slot_mask;
+    for (size_t probes = 0; probes <= snap->slot_mask && snap->slots[slot]; probes++) {
+        uint32_t idx = snap->slots[slot] - 1;
+        if (idx < snap->count) {
+            const DirRecord* rec = &snap->records[idx];
+            if (rec->path_hash == h && rec->rel_off < snap->names_size &&
+                strncmp(snap->names + rec->rel_off, rel, rel_len) == 0 &&
+                snap->names[rec->rel_off + rel_len] == '\0') {
+                return rec;
+            }
+        }
+        slot = (slot + 1) & snap->slot_mask;
+    }
+    return NULL;
+}
+
+static int same_mtime(int64_t sec, int64_t nsec, const struct stat* st) {
+    return sec == (int64_t)st->st_mtim.tv_sec && nsec == (int64_t)st->st_mtim.tv_nsec;
+}
+
+const DirRecord* dir_cache_fresh(DirCache* cache, const char* rel, size_t rel_len,
+                                 const struct stat* in, const struct stat* out) {
+    const DirSnapshot* snap = &cache->snapshot;
+    const DirRecord* rec = snapshot_find(snap, rel, rel_len);
+    if (!rec) return NULL;
+
+    if (!same_mtime(rec->mtime_sec, rec->mtime_nsec, in) ||
+        !same_mtime(rec->out_mtime_sec, rec->out_mtime_nsec, out)) return NULL;
+    if (rec->mtime_sec + DIR_MTIME_SLACK > rec->listed_at ||
+        rec->out_mtime_sec + DIR_MTIME_SLACK > rec->listed_at) return NULL;
+    if (rec->first_child > snap->child_count ||
+        rec->child_count > snap->child_count - rec->first_child) return NULL;
+
+    // Each directory is walked once, so no two threads mark the same byte.
+    cache->replayed[rec - snap->records] = 1;
+    return rec;
+}
+
+const DirChild* dir_record_children(const DirCache* cache, const DirRecord* rec) {
+    return cache->snapshot.children + rec->first_child;
+}
+
+const char* dir_child_name(const DirCache* cache, const DirChild* child) {
+    if (child->name_off >= cache->snapshot.names_size) return NULL;
+    return cache->snapshot.names + child->name_off;
+}
+
+static int names_append(char** names, size_t* size, size_t* capacity,
+                        const char* s, size_t len, uint64_t* off) {
+    if (*size + len + 1 > *capacity) {
+        size_t grown = *capacity ? *capacity * 2 : 256;
+        while (grown < *size + len + 1) grown *= 2;
+        char* next = realloc(*names, grown);
+        if (!next) return 0;
+        *names = next;
+        *capacity = grown;
+    }
+    memcpy(*names + *size, s, len);
+    (*names)[*size + len] = '\0';
+    *off = *size;
+    *size += len + 1;
+    return 1;
+}
+
+void dir_listing_add(DirListing* listing, const char* name, size_t name_len,
+                     DirChildType type, uint64_t size, int64_t mtime) {
+    if (listing->count == listing->capacity) {
+        size_t capacity = listing->capacity ? listing->capacity * 2 : 16;
+        DirChild* children = realloc(listing->children, capacity * sizeof(DirChild));
+        if (!children) return;
+        listing->children = children;
+        listing->capacity = capacity;
+    }
+    DirChild child = { .size = size, .mtime = mtime, .type = type };
+    if (!names_append(&listing->names, &listing->names_size, &listing->names_capacity,
+                      name, name_len, &child.name_off)) return;
+    listing->children[listing->count++] = child;
+}
+
+void dir_cache_store(DirCache* cache, const char* rel, size_t rel_len,
+                     const struct stat* in, const struct stat* out, DirListing* listing) {
+    DirUpdate* update = malloc(sizeof(DirUpdate));
+    uint64_t rel_off;
+    if (!update || !names_append(&listing->names, &listing->names_size,
+                                 &listing->names_capacity, rel, rel_len, &rel_off)) {
+        free(update);
+        free(listing->children);
+        free(listing->names);
+        return;
+    }
+
+    update->record = (DirRecord){
+        .path_hash = hash_from_memory(rel, rel_len),
+        .rel_off = rel_off,
+        .mtime_sec = in->st_mtim.tv_sec,
+        .mtime_nsec = in->st_mtim.tv_nsec,
+        .out_mtime_sec = out->st_mtim.tv_sec,
+        .out_mtime_nsec = out->st_mtim.tv_nsec,
+        .listed_at = (int64_t)time(NULL),
+        .child_count = listing->count,
+    };
+    update->children = listing->children;
+    update->names = listing->names;
+    update->names_size = listing->names_size;
+
+    pthread_mutex_lock(&cache->lock);
+    update->next = cache->updates;
+    cache->updates = update;
+    cache->listed++;
+    pthread_mutex_unlock(&cache->lock);
+}
+
+// Appends one directory to the image being built, its names going to the
+// end of the pool.
+static void image_add(DirRecord* records, uint32_t* slots, size_t slot_count,
+                      DirChild* children, char* names, size_t index,
+                      size_t* child_used, size_t* names_used,
+                      const DirRecord* rec, const DirChild* src_children, const char* src_names) {
+    const char* rel = src_names + rec->rel_off;
+    size_t rel_len = strlen(rel) + 1;
+
+    DirRecord* out = &records[index];
+    *out = *rec;
+    out->rel_off = *names_used;
+    out->first_child = *child_used;
+    memcpy(names + *names_used, rel, rel_len);
+    *names_used += rel_len;
+
+    for (size_t i = 0; i < rec->child_count; i++) {
+        const char* name = src_names + src_children[i].name_off;
+        size_t len = strlen(name) + 1;
+        DirChild* child = &children[(*child_used)++];
+        *child = src_children[i];
+        child->name_off = *names_used;
+        memcpy(names + *names_used, name, len);
+        *names_used += len;
+    }
+
+    size_t slot = out->path_hash & (slot_count - 1);
+    while (slots[slot]) slot = (slot + 1) & (slot_count - 1);
+    slots[slot] = (uint32_t)(index + 1);
+}
+
+// Bytes of names a snapshot record needs, or 0 if any of them is out of
+// bounds.
+static size_t record_names_size(const DirSnapshot* snap, const DirRecord* rec) {
+    if (rec->rel_off >= snap->names_size || rec->first_child > snap->child_count ||
+        rec->child_count > snap->child_count - rec->first_child) return 0;
+
+    size_t size = strlen(snap->names + rec->rel_off) + 1;
+    const DirChild* children = snap->children + rec->first_child;
+    for (size_t i = 0; i < rec->child_count; i++) {
+        if (children[i].name_off >= snap->names_size) return 0;
+        size += strlen(snap->names + children[i].name_off) + 1;
+    }
+    return size;
+}
+
+// Directories listed this run, then the ones replayed from the last file;
+// directories the walk never reached are gone from the input.
+int dir_cache_save(const DirCache* cache, const char* path) {
+    if (!cache->updates) return 1;
+    const DirSnapshot* snap = &cache->snapshot;
+
+    size_t count = 0, child_count = 0, names_size = 1;
+    for (const DirUpdate* u = cache->updates; u; u = u->next) {
+        count++;
+        child_count += u->record.child_count;
+        names_size += u->names_size;
+    }
+    for (size_t i = 0; i < snap->count; i++) {
+        size_t rec_names = cache->replayed[i] ? record_names_size(snap, &snap->records[i]) : 0;
+        if (rec_names == 0) continue;
+        count++;
+        child_count += snap->records[i].child_count;
+        names_size += rec_names;
+    }
+
+    size_t slot_count = 16;
+    while (slot_count < count * 2) slot_count <<= 1;
+
+    DirHeader header = {
+        .magic = DIR_MAGIC,
+        .revision = DIR_REVISION,
+        .hash_algo = HASH_ALGO_CURRENT,
+        .count = count,
+        .slot_count = slot_count,
+        .records_off = sizeof(DirHeader),
+        .child_count = child_count,
+    };
+    header.slots_off = header.records_off + count * sizeof(DirRecord);
+    header.children_off = (header.slots_off + slot_count * sizeof(uint32_t) + 7) & ~(uint64_t)7;
+    header.names_off = header.children_off + child_count * sizeof(DirChild);
+    header.names_size = names_size;
+
+    size_t size = header.names_off + names_size;
+    char* image = calloc(1, size);
+    if (!image) return 0;
+    memcpy(image, &header, sizeof(header));
+
+    DirRecord* records = (DirRecord*)(image + header.records_off);
+    uint32_t* slots = (uint32_t*)(image + header.slots_off);
+    DirChild* children = (DirChild*)(image + header.children_off);
+    char* names = image + header.names_off;
+    size_t index = 0, child_used = 0, names_used = 1;
+
+    for (const DirUpdate* u = cache->updates; u; u = u->next) {
+        image_add(records, slots, slot_count, children, names, index++, &child_used, &names_used,
+                  &u->record, u->children, u->names);
+    }
+    for (size_t i = 0; i < snap->count; i++) {
+        const DirRecord* rec = &snap->records[i];
+        if (!cache->replayed[i] || record_names_size(snap, rec) == 0) continue;
+        image_add(records, slots, slot_count, children, names, index++, &child_used, &names_used,
+                  rec, snap->children + rec->first_child, snap->names);
+    }
+
+    char tmp_path[PATH_MAX];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    FILE* f = fopen(tmp_path, "wb");
+    if (!f) {
+        free(image);
+        return 0;
+    }
+    int ok = fwrite(image, 1, size, f) == size;
+    ok = (fclose(f) == 0) && ok;
+    free(image);
+    if (!ok || rename(tmp_path, path) != 0) {
+        unlink(tmp_path);
+        return 0;
+    }
+    return 1;
+}
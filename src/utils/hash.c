@@ -0,0 +1,224 @@
+#include "utils/hash.h"
+#include "utils/simd.h"
+#include <stdio.h>
+#include <string.h>
+
+#define STRIPES_PER_BLOCK 16
+
+static const uint64_t PRIME_1 = 0x9E3779B185EBCA87ULL;
+static const uint64_t PRIME_2 = 0xC2B2AE3D27D4EB4FULL;
+static const uint64_t PRIME_32 = 0x9E3779B1ULL;
+
+// Stripe keys slide one word per stripe through the first 23 words; the
+// last eight scramble the lanes between blocks.
+static const uint64_t SECRET[32] = {
+    0x184d394efc39172aULL, 0x0446af79126cbf55ULL, 0x9fbf372959ca09deULL, 0x6ffdbd67e921a260ULL,
+    0xf028d4de32e887c3ULL, 0x13d8620348d6a5ffULL, 0x8b844a87d50e4971ULL, 0x37f8888c47db91aeULL,
+    0x8e38614b2d72b691ULL, 0xeb9c05c19ab06b22ULL, 0x8c9f80f26007dd3aULL, 0xeee468f8b6eae59aULL,
+    0x49020ce480dca140ULL, 0x3da10b9aa3533d1eULL, 0xe21a627ff729b997ULL, 0x99af907c014abb08ULL,
+    0x5b80c0e7a5930c96ULL, 0x367df2f4a049f100ULL, 0x809b0243601186f6ULL, 0x6290d5ac0a179a9eULL,
+    0xcab250bbf45e68beULL, 0x812f38cc39168e2aULL, 0x49a31fe534c0f6d1ULL, 0x6387855a7ac7340eULL,
+    0xfd607855aab101c1ULL, 0xd11babbbc76f7dfcULL, 0x77dcf77482e81ad8ULL, 0xa6d05b4a2fca2a20ULL,
+    0x160a75d5cac8353eULL, 0x02fc4db20de8bec5ULL, 0xefd6e8aa72b31829ULL, 0x2dc16dee4965608aULL,
+};
+
+static const uint64_t* const SCRAMBLE = SECRET + 24;
+
+static inline uint64_t read64(const unsigned char* p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t mix64(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+// Per lane j: acc[j] += lo32(v ^ key) * hi32(v ^ key), and the raw word is
+// added to the neighbouring lane so no input bit is lost when the product
+// degenerates. Stripe s of a block uses key words s..s+7.
+#if defined(__AVX2__)
+
+static void accumulate(uint64_t* acc, const unsigned char* p, size_t count, size_t first) {
+    __m256i a0 = _mm256_loadu_si256((const __m256i*)acc);
+    __m256i a1 = _mm256_loadu_si256((const __m256i*)(acc + 4));
+
+    for (size_t s = 0; s < count; s++, p += HASH_STRIPE) {
+        const uint64_t* key = SECRET + first + s;
+        __m256i d0 = _mm256_loadu_si256((const __m256i*)p);
+        __m256i d1 = _mm256_loadu_si256((const __m256i*)(p + 32));
+        __m256i k0 = _mm256_xor_si256(d0, _mm256_loadu_si256((const __m256i*)key));
+        __m256i k1 = _mm256_xor_si256(d1, _mm256_loadu_si256((const __m256i*)(key + 4)));
+
+        __m256i p0 = _mm256_mul_epu32(k0, _mm256_srli_epi64(k0, 32));
+        __m256i p1 = _mm256_mul_epu32(k1, _mm256_srli_epi64(k1, 32));
+        __m256i s0 = _mm256_shuffle_epi32(d0, _MM_SHUFFLE(1, 0, 3, 2));
+        __m256i s1 = _mm256_shuffle_epi32(d1, _MM_SHUFFLE(1, 0, 3, 2));
+
+        a0 = _mm256_add_epi64(a0, _mm256_add_epi64(p0, s0));
+        a1 = _mm256_add_epi64(a1, _mm256_add_epi64(p1, s1));
+    }
+
+    _mm256_storeu_si256((__m256i*)acc, a0);
+    _mm256_storeu_si256((__m256i*)(acc + 4), a1);
+}
+
+#elif defined(__aarch64__)
+
+static void accumulate(uint64_t* acc, const unsigned char* p, size_t count, size_t first) {
+    uint64x2_t a[4];
+    for (int l = 0; l < 4; l++) a[l] = vld1q_u64(acc + 2 * l);
+
+    for (size_t s = 0; s < count; s++, p += HASH_STRIPE) {
+        const uint64_t* key = SECRET + first + s;
+        for (int l = 0; l < 4; l++) {
+            uint64x2_t d = vreinterpretq_u64_u8(vld1q_u8(p + 16 * l));
+            uint64x2_t k = veorq_u64(d, vld1q_u64(key + 2 * l));
+            uint64x2_t prod = vmull_u32(vmovn_u64(k), vshrn_n_u64(k, 32));
+            a[l] = vaddq_u64(a[l], vaddq_u64(prod, vextq_u64(d, d, 1)));
+        }
+    }
+
+    for (int l = 0; l < 4; l++) vst1q_u64(acc + 2 * l, a[l]);
+}
+
+#else
+
+static void accumulate(uint64_t* acc, const unsigned char* p, size_t count, size_t first) {
+    for (size_t s = 0; s < count; s++, p += HASH_STRIPE) {
+        const uint64_t* key = SECRET + first + s;
+        for (int j = 0; j < HASH_LANES; j++) {
+            uint64_t v = read64(p + 8 * j);
+            uint64_t k = v ^ key[j];
+            acc[j ^ 1] += v;
+            acc[j] += (k & 0xffffffffULL) * (k >> 32);
+        }
+    }
+}
+
+#endif
+
+static void scramble(uint64_t* acc) {
+    for (int j = 0; j < HASH_LANES; j++) {
+        uint64_t a = acc[j];
+        a ^= a >> 47;
+        a ^= SCRAMBLE[j];
+        acc[j] = a * PRIME_32;
+    }
+}
+
+// Runs whole stripes through the lanes, scrambling at every block edge.
+static void consume_stripes(HashState* state, const unsigned char* p, size_t count) {
+    while (count > 0) {
+        size_t in_block = state->stripes % STRIPES_PER_BLOCK;
+        size_t n = STRIPES_PER_BLOCK - in_block;
+        if (n > count) n = count;
+
+        accumulate(state->acc, p, n, in_block);
+        state->stripes += n;
+        p += n * HASH_STRIPE;
+        count -= n;
+
+        if (state->stripes % STRIPES_PER_BLOCK == 0) scramble(state->acc);
+    }
+}
+
+void hash_init(HashState* state) {
+    for (int j = 0; j < HASH_LANES; j++) {
+        state->acc[j] = SECRET[j] ^ PRIME_1;
+    }
+    state->buffered = 0;
+    state->stripes = 0;
+    state->total = 0;
+}
+
+void hash_feed(HashState* state, const void* data, size_t size) {
+    const unsigned char* p = data;
+    state->total += size;
+
+    if (state->buffered) {
+        size_t take = HASH_STRIPE - state->buffered;
+        if (take > size) take = size;
+        memcpy(state->buffer + state->buffered, p, take);
+        state->buffered += take;
+        p += take;
+        size -= take;
+        if (state->buffered < HASH_STRIPE) return;
+        consume_stripes(state, state->buffer, 1);
+        state->buffered = 0;
+    }
+
+    size_t whole = size / HASH_STRIPE;
+    consume_stripes(state, p, whole);
+    p += whole * HASH_STRIPE;
+    size -= whole * HASH_STRIPE;
+
+    if (size) memcpy(state->buffer, p, size);
+    state->buffered = size;
+}
+
+uint64_t hash_final(const HashState* state) {
+    uint64_t h = state->total * PRIME_1;
+
+    // Short inputs never touch the lanes; skip folding their seed values.
+    if (state->stripes) {
+        for (int j = 0; j < HASH_LANES; j++) {
+            h = rotl64(h ^ mix64(state->acc[j]), 27) * PRIME_1;
+        }
+    } else {
+        h ^= PRIME_2;
+    }
+
+    const unsigned char* tail = state->buffer;
+    size_t rest = state->buffered;
+    int word = 0;
+    while (rest >= 8) {
+        h = rotl64(h ^ mix64(read64(tail) ^ SECRET[word++]), 27) * PRIME_1 + PRIME_2;
+        tail += 8;
+        rest -= 8;
+    }
+    if (rest) {
+        uint64_t last = 0;
+        memcpy(&last, tail, rest);
+        h = rotl64(h ^ mix64(last ^ SECRET[word] ^ rest), 27) * PRIME_1 + PRIME_2;
+    }
+    return mix64(h);
+}
+
+uint64_t hash_from_memory(const char* data, size_t size) {
+    HashState state;
+    hash_init(&state);
+
+    // Stripe straight from the caller's buffer; only the tail is copied.
+    size_t whole = size / HASH_STRIPE;
+    consume_stripes(&state, (const unsigned char*)data, whole);
+    state.total = size;
+    state.buffered = size - whole * HASH_STRIPE;
+    if (state.buffered) memcpy(state.buffer, data + whole * HASH_STRIPE, state.buffered);
+    return hash_final(&state);
+}
+
+uint64_t file_hash(const char* path) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return 0;
+
+    HashState state;
+    hash_init(&state);
+
+    unsigned char buf[16384];
+    size_t bytes_read;
+    while ((bytes_read = fread(buf, 1, sizeof(buf), f))) {
+        hash_feed(&state, buf, bytes_read);
+    }
+    fclose(f);
+    return hash_final(&state);
+}
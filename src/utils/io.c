@@ -2,34 +2,228 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <omp.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <time.h>
 #include <unistd.h>
 
+#define OUTPUT_FLAGS (O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC)
+#define OUTPUT_MODE 0644
 
-void batch_add(WriteBatch* batch, const char* path, const char* content, size_t size) {
+// Each page is three linked operations; user_data keeps the page index
+// above the operation in the low two bits.
+enum { OP_OPEN, OP_WRITE, OP_CLOSE };
+
+static int write_file_sync(const char* path, const struct iovec* slices, int count) {
+    int fd = open(path, OUTPUT_FLAGS, OUTPUT_MODE);
+    if (fd == -1) return -1;
+
+    // writev may stop part way through; resume from a private copy of the
+    // slice list so the caller's stays untouched.
+    struct iovec iov[PAGE_MAX_SLICES];
+    memcpy(iov, slices, (size_t)count * sizeof(*iov));
+    struct iovec* cur = iov;
+
+    while (count > 0) {
+        ssize_t n = writev(fd, cur, count);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            close(fd);
+            return -1;
+        }
+        while (count > 0 && (size_t)n >= cur->iov_len) {
+            n -= (ssize_t)cur->iov_len;
+            cur++;
+            count--;
+        }
+        if (count > 0) {
+            cur->iov_base = (char*)cur->iov_base + n;
+            cur->iov_len -= (size_t)n;
+        }
+    }
+    return close(fd);
+}
+
+static void write_page_sync(WriteBatch* batch, int i) {
+    batch->stats.sync_writes++;
+    batch->done[i] = write_file_sync(batch->paths[i], batch->slices[i], batch->slice_counts[i]) == 0;
+    if (!batch->done[i]) {
+        batch->stats.errors++;
+        fprintf(stderr, "Failed to write file: %s\n", batch->paths[i]);
+    }
+}
+
+int batch_use_uring(WriteBatch* batch) {
+    IoRing* ring = malloc(sizeof(IoRing));
+    if (!ring_init(ring, BATCH_SIZE * 4, BATCH_SIZE)) {
+        free(ring);
+        return 0;
+    }
+    batch->ring = ring;
+    return 1;
+}
+
+void batch_release(WriteBatch* batch) {
+    if (batch->ring) {
+        ring_exit(batch->ring);
+        free(batch->ring);
+        batch->ring = NULL;
+    }
+}
+
+void batch_add(WriteBatch* batch, const char* path, const struct iovec* slices, int count) {
     if (batch->count >= BATCH_SIZE) {
         batch_flush(batch);
     }
-    
-    // Store persistent copies
-    batch->paths[batch->count] = strdup(path);
-    batch->contents[batch->count] = malloc(size);
-    memcpy(batch->contents[batch->count], content, size);
+
+    size_t size = 0;
+    for (int i = 0; i < count; i++) size += slices[i].iov_len;
+
+    batch->paths[batch->count] = path;
+    batch->slices[batch->count] = slices;
+    batch->slice_counts[batch->count] = count;
     batch->sizes[batch->count] = size;
+    batch->done[batch->count] = 0;
     batch->count++;
 }
 
-void batch_flush(WriteBatch* batch) {
+#ifdef CSSG_HAVE_URING
+
+static int submit_uring(WriteBatch* batch) {
+    IoRing* ring = batch->ring;
+
     for (int i = 0; i < batch->count; i++) {
-        int fd = open(batch->paths[i], O_WRONLY | O_CREAT | O_TRUNC, 0644);
-        if (fd != -1) {
-            write(fd, batch->contents[i], batch->sizes[i]);
-            close(fd);
-        } else {
-            fprintf(stderr, "Failed to open file for writing: %s\n", batch->paths[i]);
+        struct io_uring_sqe* open_sqe = ring_get_sqe(ring);
+        struct io_uring_sqe* write_sqe = ring_get_sqe(ring);
+        struct io_uring_sqe* close_sqe = ring_get_sqe(ring);
+        if (!open_sqe || !write_sqe || !close_sqe) return -EBUSY;
+
+        open_sqe->opcode = IORING_OP_OPENAT;
+        open_sqe->fd = AT_FDCWD;
+        open_sqe->addr = (uint64_t)(uintptr_t)batch->paths[i];
+        open_sqe->len = OUTPUT_MODE;
+        // Direct descriptors never reach an exec'd child, and the kernel
+        // rejects O_CLOEXEC alongside file_index.
+        open_sqe->open_flags = OUTPUT_FLAGS & ~O_CLOEXEC;
+        open_sqe->file_index = i + 1;
+        open_sqe->flags = IOSQE_IO_LINK;
+        open_sqe->user_data = ((uint64_t)i << 2) | OP_OPEN;
+
+        write_sqe->opcode = IORING_OP_WRITEV;
+        write_sqe->fd = i;
+        write_sqe->addr = (uint64_t)(uintptr_t)batch->slices[i];
+        write_sqe->len = (uint32_t)batch->slice_counts[i];
+        write_sqe->off = 0;
+        write_sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_LINK;
+        write_sqe->user_data = ((uint64_t)i << 2) | OP_WRITE;
+
+        close_sqe->opcode = IORING_OP_CLOSE;
+        close_sqe->file_index = i + 1;
+        close_sqe->user_data = ((uint64_t)i << 2) | OP_CLOSE;
+    }
+
+    // What the kernel does not take now stays pending in the ring and is
+    // submitted again by wait_uring.
+    int rc = ring_submit(ring, 0);
+    if (rc < 0) return rc;
+
+    batch->in_flight = batch->count * 3;
+    batch->stats.submitted += (size_t)rc;
+    return 0;
+}
+
+static void wait_uring(WriteBatch* batch) {
+    IoRing* ring = batch->ring;
+    unsigned char written[BATCH_SIZE] = {0};
+    int unsupported = 0;
+    int broken = 0;
+
+    while (batch->in_flight > 0) {
+        struct io_uring_cqe* cqe = ring_peek_cqe(ring);
+        if (!cqe && !broken) {
+            int rc = ring_submit(ring, 1);
+            if (rc >= 0) {
+                batch->stats.submitted += (size_t)rc;
+                continue;
+            }
+            // Operations the kernel never took will not complete, but the
+            // ones it took may still be writing pages; reap those before
+            // any page is written again the blocking way.
+            broken = 1;
+            batch->in_flight -= (int)ring->pending;
+            continue;
+        }
+        if (!cqe) {
+            if (ring_wait(ring) < 0) {
+                struct timespec pause = { 0, 1000000 };
+                nanosleep(&pause, NULL);
+            }
+            continue;
         }
-        
+
+        int i = (int)(cqe->user_data >> 2);
+        int op = (int)(cqe->user_data & 3);
+        int res = cqe->res;
+        ring_cqe_seen(ring);
+        batch->in_flight--;
+        batch->stats.completed++;
+
+        // A failed or short operation cancels the rest of its chain; check
+        // the byte count too rather than lean on that alone.
+        if (op == OP_WRITE && res >= 0 && (size_t)res == batch->sizes[i]) written[i] = 1;
+        if (op == OP_CLOSE && res >= 0) batch->done[i] = written[i];
+        if (op == OP_OPEN && res == -EINVAL) unsupported = 1;
+    }
+
+    // Nothing is in flight any more; tearing the ring down drops the
+    // operations it never took.
+    if (broken) batch_release(batch);
+
+    for (int i = 0; i < batch->count; i++) {
+        if (batch->done[i]) continue;
+
+        // A broken chain can leave the opened file in its slot; empty it
+        // so the next batch can reuse the index.
+        if (batch->ring) {
+            int empty = -1;
+            ring_update_files(batch->ring, (unsigned)i, &empty, 1);
+        }
+        write_page_sync(batch, i);
+    }
+
+    batch->in_flight = 0;
+
+    // Kernels without direct-descriptor openat reject every open; stop
+    // paying for the round trip.
+    if (unsupported) batch_release(batch);
+}
+
+#endif
+
+void batch_submit(WriteBatch* batch) {
+#ifdef CSSG_HAVE_URING
+    if (batch->ring && batch->count > 0) {
+        if (submit_uring(batch) == 0) return;
+        // Nothing usable was queued; write this batch the old way.
+        batch_release(batch);
+    }
+#endif
+    for (int i = 0; i < batch->count; i++) {
+        write_page_sync(batch, i);
     }
     batch->count = 0;
 }
+
+void batch_wait(WriteBatch* batch) {
+#ifdef CSSG_HAVE_URING
+    if (batch->ring && batch->count > 0) {
+        wait_uring(batch);
+    }
+#endif
+    batch->count = 0;
+}
+
+void batch_flush(WriteBatch* batch) {
+    batch_submit(batch);
+    batch_wait(batch);
+}
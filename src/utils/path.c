@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include "utils/path.h"
 #include <string.h>
 #include <stdlib.h>
@@ -5,6 +6,11 @@
 #include <dirent.h>
 #include <unistd.h>
 #include <stdio.h>
+#include <fcntl.h>
+#include <stdalign.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
 
 char* strip_extension(const char* filename) {
     char* copy = strdup(filename);
@@ -54,29 +60,260 @@ const char* dirname(const char* path) {
     return copy;
 }
 
-void copy_directory_structure(const char* input_dir, const char* output_dir) {
-    DIR* dir = opendir(input_dir);
-    if (!dir) return;
+#define WALK_MAX_OPEN_FDS 256
+#define WALK_DENTS_BUFFER (32 * 1024)
 
-    // Create output directory if it doesn't exist
-    create_directory(output_dir);
+#ifdef __linux__
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+#endif
 
+// Caller holds walk->lock.
+static void walk_push(DirWalk* walk, int fd, char* rel, size_t rel_len) {
+    if (walk->task_count == walk->task_capacity) {
+        walk->task_capacity = walk->task_capacity ? walk->task_capacity * 2 : 64;
+        walk->tasks = realloc(walk->tasks, walk->task_capacity * sizeof(DirTask));
+    }
+    walk->tasks[walk->task_count++] = (DirTask){ .fd = fd, .rel = rel, .rel_len = rel_len };
+    walk->pending++;
+}
+
+int walk_init(DirWalk* walk, const char* input_dir, const char* output_dir,
+              const char* extension, WalkFileFn on_file) {
+    memset(walk, 0, sizeof(*walk));
+    pthread_mutex_init(&walk->lock, NULL);
+    walk->input_dir = input_dir;
+    walk->input_len = strlen(input_dir);
+    walk->extension = extension;
+    walk->extension_len = strlen(extension);
+    walk->on_file = on_file;
+
+    walk->in_root_fd = open(input_dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    walk->out_root_fd = open(output_dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (walk->in_root_fd < 0 || walk->out_root_fd < 0) return 0;
+
+    walk_push(walk, -1, strdup(""), 0);
+    return 1;
+}
+
+void walk_free(DirWalk* walk) {
+    for (size_t i = 0; i < walk->task_count; i++) {
+        if (walk->tasks[i].fd >= 0) close(walk->tasks[i].fd);
+        free(walk->tasks[i].rel);
+    }
+    free(walk->tasks);
+    if (walk->in_root_fd >= 0) close(walk->in_root_fd);
+    if (walk->out_root_fd >= 0) close(walk->out_root_fd);
+    pthread_mutex_destroy(&walk->lock);
+}
+
+static void visit_entry(DirWalk* walk, int dir_fd, const DirTask* task, void* ctx,
+                        const char* name, unsigned char type,
+                        char* path, size_t prefix_len, DirListing* listing) {
+    if (name[0] == '.') return;
+
+    size_t name_len = strlen(name);
+    if (prefix_len + name_len >= PATH_MAX) return;
+
+    struct stat st;
+    int have_stat = 0;
+    if (type == DT_UNKNOWN) {
+        // Some filesystems don't fill d_type; fall back to one lstat.
+        if (fstatat(dir_fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) return;
+        have_stat = 1;
+        type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN;
+    }
+
+    if (type == DT_DIR) {
+        if (listing) dir_listing_add(listing, name, name_len, DIR_CHILD_DIR, 0, 0);
+
+        size_t rel_len = task->rel_len ? task->rel_len + 1 + name_len : name_len;
+        char* rel = malloc(rel_len + 1);
+        if (task->rel_len) {
+            memcpy(rel, task->rel, task->rel_len);
+            rel[task->rel_len] = '/';
+        }
+        memcpy(rel + rel_len - name_len, name, name_len + 1);
+
+        // Mirror it now, so the directory exists before any of its pages
+        // can be rendered.
+        mkdirat(walk->out_root_fd, rel, 0755);
+
+        int want_fd = 0;
+        pthread_mutex_lock(&walk->lock);
+        if (walk->open_fds < WALK_MAX_OPEN_FDS) {
+            walk->open_fds++;
+            want_fd = 1;
+        }
+        pthread_mutex_unlock(&walk->lock);
+
+        int child_fd = want_fd ? openat(dir_fd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC) : -1;
+
+        pthread_mutex_lock(&walk->lock);
+        if (want_fd && child_fd < 0) walk->open_fds--;
+        walk_push(walk, child_fd, rel, rel_len);
+        pthread_mutex_unlock(&walk->lock);
+    } else if (type == DT_REG) {
+        if (name_len <= walk->extension_len ||
+            memcmp(name + name_len - walk->extension_len, walk->extension, walk->extension_len) != 0) {
+            return;
+        }
+        if (!have_stat && fstatat(dir_fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) return;
+        if (listing) {
+            dir_listing_add(listing, name, name_len, DIR_CHILD_FILE, (uint64_t)st.st_size, st.st_mtime);
+        }
+
+        memcpy(path + prefix_len, name, name_len + 1);
+        walk->on_file(ctx, path, (uint64_t)st.st_size, st.st_mtime, 0);
+    }
+}
+
+// Every file path in the task's directory shares "input_dir/rel/"; writes
+// that into path and returns its length, or 0 if it is too long.
+static size_t dir_prefix(const DirWalk* walk, const DirTask* task, char* path) {
+    size_t prefix_len = walk->input_len;
+    if (prefix_len + task->rel_len + 2 >= PATH_MAX) return 0;
+    memcpy(path, walk->input_dir, prefix_len);
+    if (task->rel_len) {
+        path[prefix_len++] = '/';
+        memcpy(path + prefix_len, task->rel, task->rel_len);
+        prefix_len += task->rel_len;
+    }
+    path[prefix_len++] = '/';
+    return prefix_len;
+}
+
+static void list_directory(DirWalk* walk, int fd, const DirTask* task, void* ctx,
+                           DirListing* listing) {
+    char path[PATH_MAX];
+    size_t prefix_len = dir_prefix(walk, task, path);
+    if (prefix_len == 0) {
+        close(fd);
+        return;
+    }
+
+#ifdef __linux__
+    alignas(8) char buf[WALK_DENTS_BUFFER];
+    long nread;
+    while ((nread = syscall(SYS_getdents64, fd, buf, sizeof(buf))) > 0) {
+        for (long off = 0; off < nread;) {
+            struct linux_dirent64* d = (struct linux_dirent64*)(buf + off);
+            visit_entry(walk, fd, task, ctx, d->d_name, d->d_type, path, prefix_len, listing);
+            off += d->d_reclen;
+        }
+    }
+    close(fd);
+#else
+    DIR* dir = fdopendir(fd);
+    if (!dir) {
+        close(fd);
+        return;
+    }
     struct dirent* entry;
     while ((entry = readdir(dir)) != NULL) {
-        if (entry->d_name[0] == '.') continue;
+        visit_entry(walk, fd, task, ctx, entry->d_name, entry->d_type, path, prefix_len, listing);
+    }
+    closedir(dir);
+#endif
+}
+
+// Reports what the directory held when it was last listed, without
+// reading it.
+static void replay_directory(DirWalk* walk, const DirTask* task, const DirRecord* rec, void* ctx) {
+    char path[PATH_MAX];
+    size_t prefix_len = dir_prefix(walk, task, path);
+    if (prefix_len == 0) return;
 
-        char in_path[PATH_MAX];
-        char out_path[PATH_MAX];
-        snprintf(in_path, sizeof(in_path), "%s/%s", input_dir, entry->d_name);
-        snprintf(out_path, sizeof(out_path), "%s/%s", output_dir, entry->d_name);
+    const DirChild* children = dir_record_children(walk->dirs, rec);
+    for (size_t i = 0; i < rec->child_count; i++) {
+        const char* name = dir_child_name(walk->dirs, &children[i]);
+        if (!name) continue;
+        size_t name_len = strlen(name);
+        if (prefix_len + name_len >= PATH_MAX) continue;
 
-        struct stat st;
-        if (lstat(in_path, &st) != 0) continue;
+        if (children[i].type == DIR_CHILD_DIR) {
+            size_t rel_len = task->rel_len ? task->rel_len + 1 + name_len : name_len;
+            char* rel = malloc(rel_len + 1);
+            if (task->rel_len) {
+                memcpy(rel, task->rel, task->rel_len);
+                rel[task->rel_len] = '/';
+            }
+            memcpy(rel + rel_len - name_len, name, name_len + 1);
 
-        if (S_ISDIR(st.st_mode)) {
-            create_directory(out_path);
-            copy_directory_structure(in_path, out_path);
+            pthread_mutex_lock(&walk->lock);
+            walk_push(walk, -1, rel, rel_len);
+            pthread_mutex_unlock(&walk->lock);
+        } else {
+            memcpy(path + prefix_len, name, name_len + 1);
+            walk->on_file(ctx, path, children[i].size, (time_t)children[i].mtime, 1);
         }
     }
-    closedir(dir);
+}
+
+// Lists the directory, or replays its last listing when the DirCache says
+// neither it nor its output mirror has changed since. Both are stat'ed
+// before reading, so changes made while it is read show up next time.
+static int visit_directory(DirWalk* walk, const DirTask* task, void* ctx) {
+    const char* rel = task->rel_len ? task->rel : ".";
+    int fd = task->fd;
+    if (!walk->dirs) {
+        if (fd < 0) fd = openat(walk->in_root_fd, rel, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd >= 0) list_directory(walk, fd, task, ctx, NULL);
+        return 0;
+    }
+
+    struct stat in, out;
+    int have_in = fd >= 0 ? fstat(fd, &in) == 0 : fstatat(walk->in_root_fd, rel, &in, 0) == 0;
+    int have_out = fstatat(walk->out_root_fd, rel, &out, 0) == 0;
+    if (!have_out) {
+        mkdirat(walk->out_root_fd, rel, 0755);
+        have_out = fstatat(walk->out_root_fd, rel, &out, 0) == 0;
+    }
+
+    const DirRecord* rec = have_in && have_out ?
+        dir_cache_fresh(walk->dirs, task->rel, task->rel_len, &in, &out) : NULL;
+    if (rec) {
+        if (fd >= 0) close(fd);
+        replay_directory(walk, task, rec, ctx);
+        return 1;
+    }
+
+    if (fd < 0) fd = openat(walk->in_root_fd, rel, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return 0;
+    DirListing listing = {0};
+    list_directory(walk, fd, task, ctx, &listing);
+    if (have_in && have_out) {
+        dir_cache_store(walk->dirs, task->rel, task->rel_len, &in, &out, &listing);
+    } else {
+        free(listing.children);
+        free(listing.names);
+    }
+    return 0;
+}
+
+WalkStatus walk_step(DirWalk* walk, void* ctx) {
+    pthread_mutex_lock(&walk->lock);
+    if (walk->task_count == 0) {
+        pthread_mutex_unlock(&walk->lock);
+        return WALK_IDLE;
+    }
+    DirTask task = walk->tasks[--walk->task_count];
+    pthread_mutex_unlock(&walk->lock);
+
+    int replayed = visit_directory(walk, &task, ctx);
+    free(task.rel);
+
+    pthread_mutex_lock(&walk->lock);
+    if (task.fd >= 0) walk->open_fds--;
+    walk->dir_count++;
+    if (replayed) walk->dirs->skipped++;
+    int finished = --walk->pending == 0;
+    pthread_mutex_unlock(&walk->lock);
+
+    return finished ? WALK_FINISHED : WALK_PROGRESS;
 }
@@ -0,0 +1,166 @@
+#include "utils/queue.h"
+#include <stdlib.h>
+#include <string.h>
+
+void queue_init(BoundedQueue* q, size_t capacity, size_t elem_size) {
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->not_empty, NULL);
+    pthread_cond_init(&q->not_full, NULL);
+    q->slots = malloc(capacity * elem_size);
+    q->elem_size = elem_size;
+    q->capacity = capacity;
+    q->head = 0;
+    q->count = 0;
+    q->before = NULL;
+    q->wakeups = 0;
+    q->closed = 0;
+}
+
+void queue_init_ordered(BoundedQueue* q, size_t capacity, size_t elem_size, QueueOrder before) {
+    queue_init(q, capacity, elem_size);
+    q->before = before;
+}
+
+void queue_destroy(BoundedQueue* q) {
+    pthread_mutex_destroy(&q->lock);
+    pthread_cond_destroy(&q->not_empty);
+    pthread_cond_destroy(&q->not_full);
+    free(q->slots);
+    q->slots = NULL;
+}
+
+void queue_close(BoundedQueue* q) {
+    pthread_mutex_lock(&q->lock);
+    q->closed = 1;
+    pthread_cond_broadcast(&q->not_empty);
+    pthread_cond_broadcast(&q->not_full);
+    pthread_mutex_unlock(&q->lock);
+}
+
+static char* slot(BoundedQueue* q, size_t i) {
+    return q->slots + i * q->elem_size;
+}
+
+// Heap insert: move parents down until elem's place is found.
+static void heap_put(BoundedQueue* q, const void* elem) {
+    size_t i = q->count;
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (!q->before(elem, slot(q, parent))) break;
+        memcpy(slot(q, i), slot(q, parent), q->elem_size);
+        i = parent;
+    }
+    memcpy(slot(q, i), elem, q->elem_size);
+}
+
+// Heap removal: the last element sinks from the root's hole.
+static void heap_take(BoundedQueue* q, void* elem) {
+    size_t last = q->count - 1;
+    size_t i = 0;
+    memcpy(elem, slot(q, 0), q->elem_size);
+    for (;;) {
+        size_t child = 2 * i + 1;
+        if (child >= last) break;
+        if (child + 1 < last && q->before(slot(q, child + 1), slot(q, child))) child++;
+        if (!q->before(slot(q, child), slot(q, last))) break;
+        memcpy(slot(q, i), slot(q, child), q->elem_size);
+        i = child;
+    }
+    if (i != last) memcpy(slot(q, i), slot(q, last), q->elem_size);
+}
+
+static void put_locked(BoundedQueue* q, const void* elem) {
+    if (q->before) {
+        heap_put(q, elem);
+    } else {
+        memcpy(slot(q, (q->head + q->count) % q->capacity), elem, q->elem_size);
+    }
+    q->count++;
+    pthread_cond_signal(&q->not_empty);
+}
+
+static void take_locked(BoundedQueue* q, void* elem) {
+    if (q->before) {
+        heap_take(q, elem);
+    } else {
+        memcpy(elem, slot(q, q->head), q->elem_size);
+        q->head = (q->head + 1) % q->capacity;
+    }
+    q->count--;
+    pthread_cond_signal(&q->not_full);
+}
+
+void queue_push(BoundedQueue* q, const void* elem) {
+    pthread_mutex_lock(&q->lock);
+    while (q->count == q->capacity && !q->closed) {
+        pthread_cond_wait(&q->not_full, &q->lock);
+    }
+    if (!q->closed) put_locked(q, elem);
+    pthread_mutex_unlock(&q->lock);
+}
+
+int queue_try_push(BoundedQueue* q, const void* elem) {
+    int pushed = 0;
+    pthread_mutex_lock(&q->lock);
+    if (q->count < q->capacity && !q->closed) {
+        put_locked(q, elem);
+        pushed = 1;
+    }
+    pthread_mutex_unlock(&q->lock);
+    return pushed;
+}
+
+int queue_pop(BoundedQueue* q, void* elem) {
+    pthread_mutex_lock(&q->lock);
+    while (q->count == 0 && !q->closed) {
+        pthread_cond_wait(&q->not_empty, &q->lock);
+    }
+    int popped = q->count > 0;
+    if (popped) take_locked(q, elem);
+    pthread_mutex_unlock(&q->lock);
+    return popped;
+}
+
+int queue_try_pop(BoundedQueue* q, void* elem) {
+    pthread_mutex_lock(&q->lock);
+    int popped = q->count > 0;
+    if (popped) take_locked(q, elem);
+    pthread_mutex_unlock(&q->lock);
+    return popped;
+}
+
+// Takes up to max elements without waiting for any.
+size_t queue_try_pop_batch(BoundedQueue* q, void* elems, size_t max) {
+    size_t n = 0;
+    pthread_mutex_lock(&q->lock);
+    while (n < max && q->count > 0) {
+        take_locked(q, (char*)elems + n * q->elem_size);
+        n++;
+    }
+    pthread_mutex_unlock(&q->lock);
+    return n;
+}
+
+unsigned queue_wakeups(BoundedQueue* q) {
+    pthread_mutex_lock(&q->lock);
+    unsigned wakeups = q->wakeups;
+    pthread_mutex_unlock(&q->lock);
+    return wakeups;
+}
+
+void queue_wake(BoundedQueue* q) {
+    pthread_mutex_lock(&q->lock);
+    q->wakeups++;
+    pthread_cond_broadcast(&q->not_empty);
+    pthread_mutex_unlock(&q->lock);
+}
+
+int queue_wait(BoundedQueue* q, unsigned seen) {
+    pthread_mutex_lock(&q->lock);
+    while (q->count == 0 && !q->closed && q->wakeups == seen) {
+        pthread_cond_wait(&q->not_empty, &q->lock);
+    }
+    int open = q->count > 0 || !q->closed;
+    pthread_mutex_unlock(&q->lock);
+    return open;
+}
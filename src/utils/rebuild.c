@@ -5,31 +5,29 @@
 #include <stdio.h>
 #include <unistd.h>
 
-int needs_rebuild(const char* in_path, BuildCache* cache) {
-    CacheEntry* entry = NULL;
-
-    // HASH_FIND_STR is the uthash macro for a fast (O(1) average) lookup.
-    // It searches the hash table pointed to by `*cache` for a key matching `in_path`.
-    // If found, it sets `entry` to point to the found struct.
-    HASH_FIND_STR(*cache, in_path, entry);
+int needs_rebuild(const char* in_path, time_t mtime, int output_known,
+                  const CacheSnapshot* snap, DepsHashFn deps_hash, void* ctx) {
+    // The snapshot is immutable during the build, so this lookup and the
+    // syscalls below run on every worker at once without any lock.
+    const CacheRecord* entry = cache_snapshot_find(snap, in_path);
 
     // Case 1: Not in cache. Must be a new file, so rebuild.
     if (!entry) {
         return 1;
     }
 
-    // Case 2: In cache. Check modification time.
-    struct stat st;
-    if (stat(in_path, &st) != 0) {
-        // Source file was deleted. Don't try to build it.
-        return 0;
-    }
-    if (st.st_mtime > entry->last_modified) {
+    // Case 2: In cache. Check the modification time the walk saw.
+    if (mtime > entry->last_modified) {
         return 1; // Source file is newer than our cache record. Rebuild.
     }
 
-    // Case 3: Check if the output file was deleted manually.
-    if (access(entry->output_path, F_OK) != 0) {
+    // Case 3: The template, config or generator changed since the last build.
+    if (deps_hash(ctx, in_path, cache_record_layout(snap, entry)) != entry->deps_hash) {
+        return 1;
+    }
+
+    // Case 4: Check if the output file was deleted manually.
+    if (!output_known && access(cache_record_output(snap, entry), F_OK) != 0) {
         return 1; // Output is missing. Rebuild.
     }
 
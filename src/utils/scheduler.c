@@ -0,0 +1,101 @@
+#include "utils/scheduler.h"
+#include <stdlib.h>
+#include <string.h>
+
+int scheduler_default_workers(void) {
+    int procs = omp_get_num_procs();
+    return procs > 0 ? procs : 1;
+}
+
+void scheduler_init(WorkScheduler* sched, int workers) {
+    if (workers < 1) workers = 1;
+
+    sched->worker_count = workers;
+    sched->queues = aligned_alloc(SCHED_CACHE_LINE, sizeof(WorkerQueue) * workers);
+    memset(sched->queues, 0, sizeof(WorkerQueue) * workers);
+
+    for (int i = 0; i < workers; i++) {
+        omp_init_lock(&sched->queues[i].lock);
+    }
+}
+
+void scheduler_free(WorkScheduler* sched) {
+    for (int i = 0; i < sched->worker_count; i++) {
+        omp_destroy_lock(&sched->queues[i].lock);
+        free(sched->queues[i].items);
+    }
+    free(sched->queues);
+    sched->queues = NULL;
+    sched->worker_count = 0;
+}
+
+int scheduler_costlier(const void* a, const void* b) {
+    const WorkItem* wa = a;
+    const WorkItem* wb = b;
+    return wa->cost > wb->cost;
+}
+
+static void queue_append(WorkerQueue* q, const WorkItem* item) {
+    if (q->tail == q->capacity) {
+        // Compact consumed slots before growing
+        if (q->head > 0) {
+            memmove(q->items, q->items + q->head, (q->tail - q->head) * sizeof(WorkItem));
+            q->tail -= q->head;
+            q->head = 0;
+        }
+        if (q->tail == q->capacity) {
+            q->capacity = q->capacity ? q->capacity * 2 : 64;
+            q->items = realloc(q->items, q->capacity * sizeof(WorkItem));
+        }
+    }
+    q->items[q->tail++] = *item;
+}
+
+void scheduler_push(WorkScheduler* sched, int worker, const WorkItem* items, size_t count) {
+    WorkerQueue* q = &sched->queues[worker];
+    omp_set_lock(&q->lock);
+    for (size_t i = 0; i < count; i++) {
+        queue_append(q, &items[i]);
+    }
+    omp_unset_lock(&q->lock);
+}
+
+static int try_steal(WorkScheduler* sched, int thief, WorkItem* out) {
+    for (int n = 1; n < sched->worker_count; n++) {
+        WorkerQueue* victim = &sched->queues[(thief + n) % sched->worker_count];
+        int found = 0;
+
+        omp_set_lock(&victim->lock);
+        if (victim->head < victim->tail) {
+            *out = victim->items[--victim->tail];
+            found = 1;
+        }
+        omp_unset_lock(&victim->lock);
+
+        if (found) {
+            sched->queues[thief].steals++;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int scheduler_next(WorkScheduler* sched, int worker, WorkItem* out) {
+    WorkerQueue* q = &sched->queues[worker];
+    int found = 0;
+
+    omp_set_lock(&q->lock);
+    if (q->head < q->tail) {
+        *out = q->items[q->head++];
+        found = 1;
+    }
+    omp_unset_lock(&q->lock);
+
+    return found || try_steal(sched, worker, out);
+}
+
+void scheduler_account(WorkScheduler* sched, int worker, double elapsed) {
+    WorkerQueue* q = &sched->queues[worker];
+    q->busy_time += elapsed;
+    q->completed++;
+}
@@ -0,0 +1,182 @@
+#define _GNU_SOURCE
+#include "utils/uring.h"
+
+#ifdef CSSG_HAVE_URING
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+static int sys_setup(unsigned entries, struct io_uring_params* p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int sys_register(int fd, unsigned opcode, const void* arg, unsigned nr_args) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static int ops_supported(int fd) {
+    static const int needed[] = { IORING_OP_OPENAT, IORING_OP_WRITE, IORING_OP_WRITEV, IORING_OP_CLOSE };
+    size_t size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe* probe = calloc(1, size);
+    int ok = sys_register(fd, IORING_REGISTER_PROBE, probe, 256) == 0;
+
+    for (size_t i = 0; ok && i < sizeof(needed) / sizeof(needed[0]); i++) {
+        ok = needed[i] <= probe->last_op && (probe->ops[needed[i]].flags & IO_URING_OP_SUPPORTED);
+    }
+    free(probe);
+    return ok;
+}
+
+int ring_init(IoRing* ring, unsigned entries, unsigned fixed_files) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    memset(ring, 0, sizeof(*ring));
+
+    ring->fd = sys_setup(entries, &p);
+    if (ring->fd < 0) return 0;
+
+    ring->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    ring->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sq_ring == MAP_FAILED || ring->cq_ring == MAP_FAILED || ring->sqes == MAP_FAILED) {
+        ring_exit(ring);
+        return 0;
+    }
+
+    char* sq = ring->sq_ring;
+    char* cq = ring->cq_ring;
+    ring->sq_head = (unsigned*)(sq + p.sq_off.head);
+    ring->sq_tail = (unsigned*)(sq + p.sq_off.tail);
+    ring->sq_mask = (unsigned*)(sq + p.sq_off.ring_mask);
+    ring->sq_array = (unsigned*)(sq + p.sq_off.array);
+    ring->cq_head = (unsigned*)(cq + p.cq_off.head);
+    ring->cq_tail = (unsigned*)(cq + p.cq_off.tail);
+    ring->cq_mask = (unsigned*)(cq + p.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+    ring->sq_entries = p.sq_entries;
+
+    if (!ops_supported(ring->fd)) {
+        ring_exit(ring);
+        return 0;
+    }
+
+    // Sparse table of direct descriptors; openat fills slots, close empties
+    // them, so linked open/write/close never round-trips an fd to userspace.
+    if (fixed_files) {
+        int* fds = malloc(fixed_files * sizeof(int));
+        for (unsigned i = 0; i < fixed_files; i++) fds[i] = -1;
+        int rc = sys_register(ring->fd, IORING_REGISTER_FILES, fds, fixed_files);
+        free(fds);
+        if (rc < 0) {
+            ring_exit(ring);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+void ring_exit(IoRing* ring) {
+    if (ring->sqes && ring->sqes != MAP_FAILED) munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_ring && ring->cq_ring != MAP_FAILED) munmap(ring->cq_ring, ring->cq_ring_size);
+    if (ring->sq_ring && ring->sq_ring != MAP_FAILED) munmap(ring->sq_ring, ring->sq_ring_size);
+    if (ring->fd >= 0) close(ring->fd);
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+}
+
+struct io_uring_sqe* ring_get_sqe(IoRing* ring) {
+    unsigned head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    unsigned tail = *ring->sq_tail + ring->prepared;
+    if (tail - head >= ring->sq_entries) return NULL;
+
+    unsigned idx = tail & *ring->sq_mask;
+    ring->sq_array[idx] = idx;
+    ring->prepared++;
+
+    struct io_uring_sqe* sqe = &ring->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+// Publishes every prepared SQE, submits them along with any the kernel
+// did not take last time, and optionally blocks until wait_nr completions
+// are available. The kernel may take fewer than offered; the rest stay
+// pending for the next call. Returns the number submitted or -errno.
+int ring_submit(IoRing* ring, unsigned wait_nr) {
+    __atomic_store_n(ring->sq_tail, *ring->sq_tail + ring->prepared, __ATOMIC_RELEASE);
+    ring->pending += ring->prepared;
+    ring->prepared = 0;
+
+    unsigned flags = wait_nr ? IORING_ENTER_GETEVENTS : 0;
+    int rc;
+    do {
+        rc = sys_enter(ring->fd, ring->pending, wait_nr, flags);
+    } while (rc < 0 && errno == EINTR);
+
+    if (rc < 0) return -errno;
+    ring->pending -= (unsigned)rc;
+    return rc;
+}
+
+int ring_wait(IoRing* ring) {
+    int rc;
+    do {
+        rc = sys_enter(ring->fd, 0, 1, IORING_ENTER_GETEVENTS);
+    } while (rc < 0 && errno == EINTR);
+    return rc < 0 ? -errno : 0;
+}
+
+struct io_uring_cqe* ring_peek_cqe(IoRing* ring) {
+    unsigned head = *ring->cq_head;
+    unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+    if (head == tail) return NULL;
+    return &ring->cqes[head & *ring->cq_mask];
+}
+
+void ring_cqe_seen(IoRing* ring) {
+    __atomic_store_n(ring->cq_head, *ring->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+int ring_update_files(IoRing* ring, unsigned offset, const int* fds, unsigned count) {
+    struct io_uring_files_update update = {
+        .offset = offset,
+        .fds = (uint64_t)(uintptr_t)fds,
+    };
+    return sys_register(ring->fd, IORING_REGISTER_FILES_UPDATE, &update, count);
+}
+
+#else
+
+int ring_init(IoRing* ring, unsigned entries, unsigned fixed_files) {
+    (void)entries;
+    (void)fixed_files;
+    ring->fd = -1;
+    return 0;
+}
+
+void ring_exit(IoRing* ring) {
+    ring->fd = -1;
+}
+
+int ring_submit(IoRing* ring, unsigned wait_nr) {
+    (void)ring;
+    (void)wait_nr;
+    return -1;
+}
+
+#endif
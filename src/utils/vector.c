@@ -8,12 +8,14 @@ void vec_init(FileVector* vec) {
     vec->capacity = 128;
 }
 
-void vec_push(FileVector* vec, const char* item) {
+// Returns the vector's own copy of item.
+const char* vec_push(FileVector* vec, const char* item) {
     if (vec->count >= vec->capacity) {
         vec->capacity *= 2;
         vec->items = realloc(vec->items, sizeof(char*) * vec->capacity);
     }
-    vec->items[vec->count++] = strdup(item);
+    vec->items[vec->count] = strdup(item);
+    return vec->items[vec->count++];
 }
 
 void vec_free(FileVector* vec) {
@@ -0,0 +1,144 @@
+/* Checks that pages rendered a chunk at a time through the block memo get
+ * exactly the HTML of rendering them whole, cold and with every chunk
+ * reused, on pages built around the fences the chunk finder has to follow:
+ * top-level and indented ones, fences in list items, and closing lines
+ * that may open another fence. Pages whose fences all close must still be
+ * cut into many chunks. Run with `make test`. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+#include "parser/markdown.h"
+
+#define PAGE_SIZE   (400u << 10)  /* past the size pages are chunked at */
+#define ARENA_SIZE  (4u << 20)
+#define MIN_CHUNKS  16            /* about one per 8-32 KB */
+#define RANDOM_PAGES 64
+
+typedef struct {
+    char  *data;
+    size_t len, cap;
+} Page;
+
+static void puts_page(Page *p, const char *s) {
+    size_t n = strlen(s);
+    if (p->len + n > p->cap) n = p->cap - p->len;
+    memcpy(p->data + p->len, s, n);
+    p->len += n;
+}
+
+/* Distinct paragraphs, so that no two chunks have the same bytes. */
+static void filler(Page *p, size_t until) {
+    for (size_t i = 0; p->len < until && p->len < p->cap; i++) {
+        char para[160];
+        snprintf(para, sizeof(para),
+                 "Paragraph %zu at byte %zu, with *emphasis* and `code` in it.\n\n", i, p->len);
+        puts_page(p, para);
+    }
+}
+
+static size_t seed = 1;
+
+static size_t next_random(void) {
+    seed = seed * 6364136223846793005u + 1442695040888963407u;
+    return (size_t)(seed >> 33);
+}
+
+/* Lines that open, close or sit inside fences, in and out of list items,
+ * with paragraphs between them. */
+static void random_fences(Page *p) {
+    static const char *const LINES[] = {
+        "- a\n", "1. b\n", "  - x\n", "- ```\n", "   - ```\n", "> ```\n",
+        "```\n", "~~~\n", "````\n", " ```\n", "  ```\n", "   ```\n", "    ```\n",
+        "   ~~~~\n", "\t```\n", "```c\n", "  code\n", "x\n", "\n", "\n",
+    };
+    size_t n = sizeof(LINES) / sizeof(LINES[0]);
+    while (p->len < p->cap) {
+        for (size_t i = next_random() % 12; i > 0; i--) puts_page(p, LINES[next_random() % n]);
+        filler(p, p->len + next_random() % 6000);
+    }
+}
+
+/* Renders page whole, chunked with an empty memo, and chunked again with
+ * every chunk in the memo. Returns the number of chunks, or 0 on a
+ * mismatch. */
+static size_t check(const char *name, const Page *page) {
+    Arena arena;
+    arena_init(&arena, ARENA_SIZE);
+    BlockSnapshot snap = {0};
+    BlockMemo memo = { .snapshot = &snap };
+
+    MarkdownDoc whole = parse_markdown(&arena, page->data, page->len);
+    MarkdownDoc cold = parse_markdown_memo(&arena, page->data, page->len, &memo);
+    size_t chunks = memo.misses + memo.hits;
+    MarkdownDoc warm = parse_markdown_memo(&arena, page->data, page->len, &memo);
+
+    int same = whole.html && cold.html && warm.html &&
+               cold.html_len == whole.html_len && !memcmp(cold.html, whole.html, whole.html_len) &&
+               warm.html_len == whole.html_len && !memcmp(warm.html, whole.html, whole.html_len);
+    if (!same) printf("FAIL %s: chunked HTML differs from the whole page's\n", name);
+
+    block_memo_free(&memo);
+    arena_free(&arena);
+    return same ? chunks : 0;
+}
+
+static int expect(const char *name, const Page *page, size_t min_chunks) {
+    size_t chunks = check(name, page);
+    if (chunks && chunks < min_chunks) {
+        printf("FAIL %s: %zu chunks, expected at least %zu\n", name, chunks, min_chunks);
+        return 1;
+    }
+    if (chunks) printf("%-24s %3zu chunks\n", name, chunks);
+    return !chunks;
+}
+
+int main(void) {
+    Page page = { malloc(PAGE_SIZE), 0, PAGE_SIZE };
+    if (!page.data) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    int failed = 0;
+
+    /* A closed fence, however indented, leaves the rest of the page free
+     * to be cut. */
+    static const char *const CLOSED[][2] = {
+        { "top fence",      "```\ncode\n```\n\n" },
+        { "indented fence", " ````\ncode\n ````\n\n" },
+        { "fence in item",  "- step\n\n  ```sh\n  make\n  ```\n\n" },
+        { "deeper closer",  "- step\n  ```\n  code\n   ```\n\n" },
+    };
+    for (size_t i = 0; i < sizeof(CLOSED) / sizeof(CLOSED[0]); i++) {
+        page.len = 0;
+        puts_page(&page, CLOSED[i][1]);
+        filler(&page, PAGE_SIZE);
+        failed |= expect(CLOSED[i][0], &page, MIN_CHUNKS);
+    }
+
+    /* Where a fence may be in an item, a closing line indented less than
+     * the item's content ends the item and opens a fence instead. */
+    static const char *const AMBIGUOUS[][2] = {
+        { "closer ends item",  "- a\n  ```\n```\n\n" },
+        { "shallow content",   "- a\n  ```\nx\n  ```\n\n" },
+        { "fence after item",  "- a\n\n  ```\n\nx\n\n  ```\n\n" },
+        { "quoted item",       "> - a\n  ```\n```\n\n" },
+    };
+    for (size_t i = 0; i < sizeof(AMBIGUOUS) / sizeof(AMBIGUOUS[0]); i++) {
+        page.len = 0;
+        puts_page(&page, AMBIGUOUS[i][1]);
+        filler(&page, PAGE_SIZE);
+        failed |= expect(AMBIGUOUS[i][0], &page, 1);
+    }
+
+    size_t mismatches = 0;
+    for (int i = 0; i < RANDOM_PAGES; i++) {
+        page.len = 0;
+        random_fences(&page);
+        mismatches += !check("random fences", &page);
+    }
+    printf("%d random pages, %zu mismatches\n", RANDOM_PAGES, mismatches);
+
+    free(page.data);
+    return failed || mismatches;
+}
@@ -0,0 +1,340 @@
+/* Renders every example in tests/spec.txt through the tree path and the
+ * one-pass stream renderer, and compares the HTML with the spec's. Only
+ * the layout between tags is ignored; whitespace in text must match. The examples in EXPECTED_FAILURES,
+ * by spec number, are expected to fail; the run fails on any other
+ * mismatch, or when the stream renderer's HTML differs from the tree's.
+ * Expected failures that pass are listed so they can be dropped. Then
+ * reports rendering throughput over all the examples.
+ * Run with `make test`. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+#include "arena.h"
+#include "parser/mlindown_token.h"
+#include "parser/mlindown_parser.h"
+#include "parser/mlindown_render.h"
+#include "parser/mlindown_stream.h"
+
+#define SPEC_PATH   "tests/spec.txt"
+#define FENCE       "````````````````````````````````"
+#define ARENA_SIZE  (64u << 10)
+#define MIN_SECONDS 0.25
+
+/* Examples, by spec number, that mlindown does not render as the spec
+ * does yet. Entries that start passing are reported and can go. */
+static const int EXPECTED_FAILURES[] = {
+    /* Tabs */
+    5, 6, 7, 9,
+    /* Backslash escapes */
+    12, 14, 16, 20, 21, 23, 24,
+    /* Entity and numeric character references */
+    25, 26, 27, 31, 32, 33, 34, 37, 38, 39, 40, 41,
+    /* Setext headings */
+    91,
+    /* HTML blocks */
+    148, 149, 150, 151, 152, 153, 154, 155, 156, 157, 158, 159, 160, 161, 162,
+    163, 164, 165, 166, 167, 168, 169, 170, 171, 172, 173, 174, 175, 176, 177,
+    178, 179, 180, 181, 182, 183, 184, 185, 186, 187, 188, 189, 190, 191,
+    /* Link reference definitions */
+    192, 193, 194, 195, 196, 197, 198, 200, 201, 202, 203, 204, 205, 206, 207,
+    208, 209, 210, 211, 214, 215, 216, 217, 218,
+    /* Paragraphs */
+    226,
+    /* Lists */
+    308, 309, 317,
+    /* Code spans */
+    343, 344, 346,
+    /* Emphasis and strong emphasis */
+    352, 353, 354, 359, 363, 380, 385, 395, 475, 476, 477, 480, 481,
+    /* Links */
+    484, 489, 491, 494, 502, 503, 504, 506, 507, 508, 520, 524, 526, 527, 528,
+    529, 530, 531, 532, 533, 534, 535, 536, 537, 538, 539, 540, 541, 542, 543,
+    544, 545, 549, 550, 553, 554, 555, 556, 557, 558, 559, 560, 561, 562, 563,
+    564, 565, 566, 567, 568, 569, 570, 571,
+    /* Images */
+    573, 575, 576, 577, 582, 583, 584, 585, 586, 587, 588, 589, 590, 591, 592,
+    593,
+    /* Autolinks */
+    594, 595, 596, 597, 598, 599, 600, 601, 603, 604, 605,
+    /* Raw HTML */
+    613, 614, 615, 616, 617, 619, 620, 622, 623, 624, 625, 626, 627, 628, 629,
+    630, 631, 632,
+    /* Hard line breaks */
+    633, 634, 635, 636, 637, 638, 639, 642, 643,
+    /* Soft line breaks */
+    649,
+    /* Textual content */
+    650,
+};
+
+typedef struct {
+    const char *section;
+    int number;              /* as the spec numbers it, from 1 */
+    char *markdown;
+    size_t markdown_len;
+    char *html;
+    size_t html_len;
+    int line;
+} Example;
+
+typedef struct {
+    Example *items;
+    size_t count, cap;
+} ExampleList;
+
+static char *read_file(const char *path, size_t *len) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *data = size >= 0 ? malloc((size_t)size + 1) : NULL;
+    if (!data || fread(data, 1, (size_t)size, f) != (size_t)size) {
+        free(data);
+        fclose(f);
+        return NULL;
+    }
+    fclose(f);
+    data[size] = '\0';
+    *len = (size_t)size;
+    return data;
+}
+
+/* Copies the lines in [start, end) with each "→" turned back into a tab. */
+static char *take(const char *start, const char *end, size_t *len) {
+    char *out = malloc((size_t)(end - start) + 1);
+    if (!out) return NULL;
+    char *o = out;
+    for (const char *p = start; p < end; p++) {
+        if (end - p >= 3 && !memcmp(p, "\xe2\x86\x92", 3)) {
+            *o++ = '\t';
+            p += 2;
+        } else {
+            *o++ = *p;
+        }
+    }
+    *o = '\0';
+    *len = (size_t)(o - out);
+    return out;
+}
+
+static const char *next_line(const char *p, const char *end) {
+    const char *eol = memchr(p, '\n', (size_t)(end - p));
+    return eol ? eol + 1 : end;
+}
+
+static int line_is(const char *p, const char *end, const char *text) {
+    size_t n = strlen(text);
+    return (size_t)(end - p) >= n + 1 && !memcmp(p, text, n) && p[n] == '\n';
+}
+
+/* Splits the spec into examples. Section names point into spec. */
+static int parse_spec(char *spec, size_t len, ExampleList *list) {
+    const char *end = spec + len;
+    const char *section = "";
+    int line = 1;
+    for (char *p = spec; p < end;) {
+        char *eol = (char *)next_line(p, end);
+        if (!strncmp(p, "## ", 3)) {
+            eol[-1] = '\0';
+            section = p + 3;
+        } else if (line_is(p, end, FENCE " example")) {
+            const char *md = eol, *dot = md;
+            while (dot < end && !line_is(dot, end, ".")) dot = next_line(dot, end);
+            const char *html = next_line(dot, end), *close = html;
+            while (close < end && !line_is(close, end, FENCE)) close = next_line(close, end);
+            if (close >= end) {
+                fprintf(stderr, "Unterminated example at line %d\n", line);
+                return 0;
+            }
+
+            if (list->count == list->cap) {
+                list->cap = list->cap ? list->cap * 2 : 256;
+                Example *items = realloc(list->items, list->cap * sizeof(Example));
+                if (!items) return 0;
+                list->items = items;
+            }
+            Example *ex = &list->items[list->count++];
+            ex->section = section;
+            ex->number = (int)list->count;
+            ex->line = line;
+            ex->markdown = take(md, dot, &ex->markdown_len);
+            ex->html = take(html, close, &ex->html_len);
+            if (!ex->markdown || !ex->html) return 0;
+
+            for (const char *q = p; q < close; q = next_line(q, end)) line++;
+            eol = (char *)next_line(close, end);
+        }
+        line++;
+        p = eol;
+    }
+    return 1;
+}
+
+static int is_ws(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+/* The HTML without the layout between block tags: whitespace runs with a
+ * tag on both sides, and line breaks alone next to one. Spaces in text,
+ * and every byte inside <pre>, are kept. */
+static size_t normalize(const char *html, size_t len, char *out) {
+    size_t n = 0;
+    for (size_t i = 0; i < len;) {
+        if (len - i >= 5 && !memcmp(html + i, "<pre>", 5)) {
+            const char *close = strstr(html + i, "</pre>");
+            size_t stop = close ? (size_t)(close - html) + 6 : len;
+            memcpy(out + n, html + i, stop - i);
+            n += stop - i;
+            i = stop;
+        } else if (is_ws(html[i])) {
+            size_t start = i;
+            int breaks_only = 1;
+            for (; i < len && is_ws(html[i]); i++) breaks_only &= html[i] == '\n';
+            int after_tag = !n || out[n - 1] == '>';
+            int before_tag = i == len || html[i] == '<';
+            if (!(after_tag && before_tag) && !(breaks_only && (after_tag || before_tag))) {
+                memcpy(out + n, html + start, i - start);
+                n += i - start;
+            }
+        } else {
+            out[n++] = html[i++];
+        }
+    }
+    out[n] = '\0';
+    return n;
+}
+
+static int same_html(const char *got, size_t got_len, const Example *ex) {
+    char *a = malloc(got_len + 1);
+    char *b = malloc(ex->html_len + 1);
+    int same = a && b &&
+               normalize(got, got_len, a) == normalize(ex->html, ex->html_len, b) &&
+               !strcmp(a, b);
+    free(a);
+    free(b);
+    return same;
+}
+
+static int expected_to_fail(int number) {
+    for (size_t i = 0; i < sizeof(EXPECTED_FAILURES) / sizeof(EXPECTED_FAILURES[0]); i++) {
+        if (EXPECTED_FAILURES[i] == number) return 1;
+    }
+    return 0;
+}
+
+static char *render_tree(Arena *arena, const Example *ex, size_t *len) {
+    TokenList toks = tokenize(arena, ex->markdown, ex->markdown_len);
+    Node *root = parse_tokens(arena, &toks);
+    return render_html_str(arena, root, len);
+}
+
+enum { SPEC_OK, SPEC_MISMATCH, STREAM_MISMATCH };
+
+/* Whether ex renders as the spec says, and the stream renderer, when it
+ * takes the page, as the tree path does. Prints why not. */
+static int check(Arena *arena, const Example *ex, int quiet) {
+    size_t tree_len = 0, stream_len = 0;
+    char *tree = render_tree(arena, ex, &tree_len);
+    char *stream = render_stream(arena, ex->markdown, ex->markdown_len, &stream_len);
+    int stream_ok = !stream || (stream_len == tree_len && !memcmp(stream, tree, tree_len));
+    int ok = tree && same_html(tree, tree_len, ex);
+
+    if (!stream_ok) {
+        printf("FAIL example %d, line %d (%s): stream renderer differs\n  tree:   %s\n  stream: %.*s\n",
+               ex->number, ex->line, ex->section, tree, (int)stream_len, stream);
+    } else if (!ok && !quiet) {
+        printf("FAIL example %d, line %d (%s)\n  markdown: %s  expected: %s  got:      %s\n",
+               ex->number, ex->line, ex->section, ex->markdown, ex->html, tree ? tree : "(null)\n");
+    }
+    return !stream_ok ? STREAM_MISMATCH : ok ? SPEC_OK : SPEC_MISMATCH;
+}
+
+/* Renders every example the way a page is rendered, until MIN_SECONDS
+ * have passed. Returns MB/s. */
+static double throughput(Arena *arena, const ExampleList *list) {
+    size_t bytes = 0, sink = 0;
+    double start = omp_get_wtime(), elapsed;
+    do {
+        for (size_t i = 0; i < list->count; i++) {
+            const Example *ex = &list->items[i];
+            size_t len = 0;
+            if (!render_stream(arena, ex->markdown, ex->markdown_len, &len)) {
+                render_tree(arena, ex, &len);
+            }
+            sink += len;
+            bytes += ex->markdown_len;
+            arena_reset(arena);
+        }
+        elapsed = omp_get_wtime() - start;
+    } while (elapsed < MIN_SECONDS);
+    return sink ? (double)bytes / elapsed / 1e6 : 0;
+}
+
+int main(int argc, char **argv) {
+    const char *path = argc > 1 ? argv[1] : SPEC_PATH;
+    size_t len;
+    char *spec = read_file(path, &len);
+    if (!spec) {
+        fprintf(stderr, "Cannot read %s\n", path);
+        return 1;
+    }
+
+    ExampleList list = {0};
+    if (!parse_spec(spec, len, &list) || !list.count) {
+        fprintf(stderr, "No examples in %s\n", path);
+        return 1;
+    }
+
+    Arena arena;
+    arena_init(&arena, ARENA_SIZE);
+    size_t passed = 0, failed = 0, expected = 0, now_passing = 0;
+    const char *section = NULL;
+    size_t section_passed = 0, section_total = 0, section_expected = 0;
+    for (size_t i = 0; i <= list.count; i++) {
+        const Example *ex = i < list.count ? &list.items[i] : NULL;
+        if (section && (!ex || strcmp(ex->section, section))) {
+            printf("  %-42s %3zu/%zu", section, section_passed, section_total);
+            if (section_expected) printf("  (%zu expected to fail)", section_expected);
+            printf("\n");
+        }
+        if (!ex) break;
+        if (!section || strcmp(ex->section, section)) {
+            section = ex->section;
+            section_passed = section_total = section_expected = 0;
+        }
+
+        int xfail = expected_to_fail(ex->number);
+        int result = check(&arena, ex, xfail);
+        arena_reset(&arena);
+        section_total++;
+        section_passed += result == SPEC_OK;
+        section_expected += xfail;
+        if (result == SPEC_OK) {
+            passed++;
+            if (xfail) {
+                printf("PASS example %d, line %d (%s), listed in EXPECTED_FAILURES\n",
+                       ex->number, ex->line, ex->section);
+                now_passing++;
+            }
+        } else if (xfail && result == SPEC_MISMATCH) {
+            expected++;
+        } else {
+            failed++;
+        }
+    }
+
+    printf("%zu passed, %zu failed, %zu expected failures", passed, failed, expected);
+    if (now_passing) printf(" (%zu more pass)", now_passing);
+    printf("\nthroughput %.1f MB/s over %zu examples\n", throughput(&arena, &list), list.count);
+
+    arena_free(&arena);
+    for (size_t i = 0; i < list.count; i++) {
+        free(list.items[i].markdown);
+        free(list.items[i].html);
+    }
+    free(list.items);
+    free(spec);
+    return failed != 0;
+}